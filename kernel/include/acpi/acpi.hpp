@@ -0,0 +1,109 @@
+#ifndef KERNEL_INCLUDE_ACPI_ACPI_HPP_
+#define KERNEL_INCLUDE_ACPI_ACPI_HPP_
+
+#include <boot/bootinfo.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <system/compiler.h>
+
+namespace acpi {
+// clang-format off
+
+/// \brief Structure representing the Root System Description Pointer (RSDP).
+///
+/// The `xsdt_address` and following fields are only present from revision 2 on.
+struct rsdp {
+    char signature[8];  ///< "RSD PTR ".
+    uint8_t checksum;  ///< Checksum of the first 20 bytes.
+    char oem_id[6];  ///< OEM identifier.
+    uint8_t revision;  ///< 0 for ACPI 1.0, 2 for ACPI 2.0 and later.
+    uint32_t rsdt_address;  ///< 32-bit physical address of the RSDT.
+    uint32_t length;  ///< Length of the whole structure.
+    uint64_t xsdt_address;  ///< 64-bit physical address of the XSDT.
+    uint8_t extended_checksum;  ///< Checksum of the whole structure.
+    uint8_t reserved[3];  ///< Reserved field.
+} __PACKED;
+
+/// \brief Structure representing the header shared by all System Description Tables.
+struct sdt_header {
+    char signature[4];  ///< Signature identifying the table.
+    uint32_t length;  ///< Length of the table, including the header.
+    uint8_t revision;  ///< Revision of the table's structure.
+    uint8_t checksum;  ///< Makes the bytes of the whole table sum up to zero.
+    char oem_id[6];  ///< OEM identifier.
+    char oem_table_id[8];  ///< OEM table identifier.
+    uint32_t oem_revision;  ///< OEM revision.
+    uint32_t creator_id;  ///< Identifier of the utility which created the table.
+    uint32_t creator_revision;  ///< Revision of the utility which created the table.
+} __PACKED;
+
+/// \brief Structure representing the System Resource Affinity Table (SRAT) header.
+struct srat_header {
+    sdt_header header;  ///< Common table header, signature "SRAT".
+    uint32_t reserved0;  ///< Reserved, must be 1.
+    uint64_t reserved1;  ///< Reserved field.
+} __PACKED;
+
+/// \brief Structure representing the header of every SRAT entry.
+struct srat_entry {
+    uint8_t type;  ///< Type of the entry (see \ref srat_entry_type).
+    uint8_t length;  ///< Length of the entry in bytes.
+} __PACKED;
+
+/// \brief Types of the SRAT entries used by the kernel.
+enum srat_entry_type : uint8_t {
+    SratProcessorAffinity = 0,  ///< \ref srat_processor_affinity.
+    SratMemoryAffinity = 1,  ///< \ref srat_memory_affinity.
+    SratX2ApicAffinity = 2,  ///< \ref srat_x2apic_affinity.
+};
+
+/// \brief Flag marking an SRAT entry as enabled.
+constexpr uint32_t srat_enabled = 1 << 0;
+
+/// \brief Structure representing the SRAT Processor Local APIC Affinity entry.
+struct srat_processor_affinity {
+    srat_entry entry;  ///< Entry header.
+    uint8_t proximity_domain_low;  ///< Bits 0-7 of the proximity domain.
+    uint8_t apic_id;  ///< Local APIC ID of the processor.
+    uint32_t flags;  ///< Flags, see \ref srat_enabled.
+    uint8_t sapic_eid;  ///< Local SAPIC EID of the processor.
+    uint8_t proximity_domain_high[3];  ///< Bits 8-31 of the proximity domain.
+    uint32_t clock_domain;  ///< Clock domain of the processor.
+} __PACKED;
+
+/// \brief Structure representing the SRAT Memory Affinity entry.
+struct srat_memory_affinity {
+    srat_entry entry;  ///< Entry header.
+    uint32_t proximity_domain;  ///< Proximity domain of the memory range.
+    uint16_t reserved0;  ///< Reserved field.
+    uint64_t base;  ///< Physical base address of the memory range.
+    uint64_t length;  ///< Length of the memory range.
+    uint32_t reserved1;  ///< Reserved field.
+    uint32_t flags;  ///< Flags, see \ref srat_enabled.
+    uint64_t reserved2;  ///< Reserved field.
+} __PACKED;
+
+/// \brief Structure representing the SRAT Processor Local x2APIC Affinity entry.
+struct srat_x2apic_affinity {
+    srat_entry entry;  ///< Entry header.
+    uint16_t reserved0;  ///< Reserved field.
+    uint32_t proximity_domain;  ///< Proximity domain of the processor.
+    uint32_t x2apic_id;  ///< x2APIC ID of the processor.
+    uint32_t flags;  ///< Flags, see \ref srat_enabled.
+    uint32_t clock_domain;  ///< Clock domain of the processor.
+    uint32_t reserved1;  ///< Reserved field.
+} __PACKED;
+
+// clang-format on
+
+/// \brief Initialize ACPI table lookup.
+/// \param bootinfo Pointer to the boot information.
+void initialize(bootinfo_t* bootinfo);
+
+/// \brief Find a System Description Table by its signature.
+/// \param signature The four character signature of the table.
+/// \return Pointer to the table, or nullptr if it is missing or invalid.
+const sdt_header* find_table(const char* signature);
+}  // namespace acpi
+
+#endif  // KERNEL_INCLUDE_ACPI_ACPI_HPP_
@@ -43,6 +43,10 @@
 /// It typically has a value of 0x28 and is used to access the TSS in protected mode.
 #define TSS_SELECTOR 0x28
 
+/// \def DOUBLE_FAULT_IST
+/// \brief Interrupt Stack Table slot of the double fault handler's stack.
+#define DOUBLE_FAULT_IST 1
+
 #if !defined(__ASSEMBLER__)
 
 #include <stddef.h>
@@ -50,6 +54,10 @@
 #include <system/compiler.h>
 
 namespace arch {
+/// \var constexpr size_t double_fault_stack_size
+/// \brief Size of the stack every CPU handles double faults on.
+constexpr size_t double_fault_stack_size = 8 * 1024;
+
 /// \brief Structure representing the GDT (Global Descriptor Table) register in x86_64 architecture.
 ///
 /// This structure defines the format of the GDT register, which contains information about
@@ -168,6 +176,15 @@ x86_tss_entry make_tss_entry(x86_tss* tss);
 /// x86_gdt_initialize(0);
 /// ```
 void x86_gdt_initialize(size_t cpu_id = 0);
+
+/// \brief Set the stack the CPU switches to when entering the kernel.
+///
+/// The stack is stored as RSP0 of the CPU's Task State Segment, which is used on
+/// privilege level changes.
+///
+/// \param cpu_id The CPU identifier whose TSS is updated.
+/// \param stack Top of the kernel stack.
+void x86_set_kernel_stack(size_t cpu_id, uintptr_t stack);
 }  // namespace arch
 
 #endif  // !defined(__ASSEMBLER__)
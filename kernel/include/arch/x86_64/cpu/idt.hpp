@@ -99,6 +99,12 @@ constexpr x86_idt_entry make_idt_entry(uint64_t offset, uint16_t selector,
 /// x86_idt_initialize();
 /// \endcode
 void x86_idt_initialize();
+
+/// \brief Load the x86 Interrupt Descriptor Table (IDT) on the current CPU.
+///
+/// Application processors share the table built by \ref x86_idt_initialize
+/// on the bootstrap processor, which has to run first.
+void x86_idt_load();
 }  // namespace arch
 
 #endif  // KERNEL_INCLUDE_ARCH_X86_64_CPU_IDT_HPP_
\ No newline at end of file
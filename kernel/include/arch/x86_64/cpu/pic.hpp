@@ -16,6 +16,17 @@ void pic_map(uint8_t pic1, uint8_t pic2);
 ///
 /// This function disables the Programmable Interrupt Controller (PIC) or interrupt handling.
 void pic_disable();
+
+/// \brief Mask or unmask one IRQ line.
+///
+/// \param irq The IRQ line, 0 to 15.
+/// \param masked Whether the line is masked.
+void pic_set_mask(uint8_t irq, bool masked);
+
+/// \brief Acknowledge an IRQ, letting the controllers deliver the next one.
+///
+/// \param irq The IRQ line, 0 to 15.
+void pic_eoi(uint8_t irq);
 }  // namespace arch
 
 #endif  // KERNEL_INCLUDE_ARCH_X86_64_CPU_PIC_HPP_
\ No newline at end of file
@@ -0,0 +1,94 @@
+#ifndef KERNEL_INCLUDE_ARCH_X86_64_CPU_SMP_HPP_
+#define KERNEL_INCLUDE_ARCH_X86_64_CPU_SMP_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <boot/bootinfo.h>
+
+namespace arch {
+/// \brief Function run on another processor through \ref smp_call.
+using smp_function = void (*)(void* argument);
+
+/// \var constexpr size_t ap_stack_size
+/// \brief Size of the kernel stack of an application processor.
+constexpr size_t ap_stack_size = 16 * 1024;
+
+/// \var constexpr size_t bsp_stack_size
+/// \brief Size of the kernel stack of the bootstrap processor, which also
+///        runs the benchmarks and the idle loop.
+constexpr size_t bsp_stack_size = 64 * 1024;
+
+/// \brief Start the application processors.
+///
+/// Every processor gets an index, its own GDT and TSS and the shared IDT,
+/// and then waits in an idle loop for work handed to it by \ref smp_call.
+/// The processors keep running on the bootloader's stacks and page tables
+/// until \ref smp_enter_kernel moves them over.
+///
+/// \param bootinfo Pointer to the boot information.
+void smp_initialize(bootinfo_t* bootinfo);
+
+/// \brief Move the application processors onto the kernel's page tables and
+///        stacks of their own.
+///
+/// Needs the kernel's page tables and the vmalloc region. The processors
+/// move over once they are done with their current work, without waiting.
+void smp_enter_kernel();
+
+/// \brief Move the bootstrap processor onto a kernel stack of its own.
+///
+/// Needs the kernel's page tables and the vmalloc region. Nothing on the
+/// bootloader's stack may be used past this point, so the caller's frame is
+/// left behind for good.
+///
+/// \param function Function continuing on the new stack, which must not
+///                 return.
+/// \param argument Argument passed to the function.
+/// \return False, without calling the function, if the processor has to
+///         stay on the bootloader's stack.
+bool smp_move_bsp_stack(smp_function function, void* argument);
+
+/// \brief Wait for the application processors to leave the bootloader
+///        memory.
+/// \return True if every processor runs on its own stack, false if some had
+///         none and still depend on the bootloader's stack.
+bool smp_wait_for_aps();
+
+/// \brief Get the number of running processors.
+/// \return The number of processors, the bootstrap processor included.
+size_t smp_cpu_count();
+
+/// \brief Get the local APIC ID of a processor.
+/// \param cpu Index of the processor.
+/// \return The local APIC ID.
+uint32_t smp_apic_id(size_t cpu);
+
+/// \brief Run a function on an application processor.
+///
+/// Waits until the processor finished the previous function handed to it,
+/// but not for the new one.
+///
+/// \param cpu Index of the processor, not the current one.
+/// \param function The function.
+/// \param argument Argument passed to the function.
+/// \return False if there is no such processor.
+bool smp_call(size_t cpu, smp_function function, void* argument);
+
+/// \brief Wait until an application processor finished its function.
+/// \param cpu Index of the processor.
+void smp_wait(size_t cpu);
+
+/// \brief Flush the TLB of every processor.
+///
+/// Needed before memory or address space unmapped from the kernel's page
+/// tables is reused, or after the cache type of a mapping changed. Waits
+/// for the application processors to finish their current function, so the
+/// caller blocks behind whatever work \ref smp_call handed them, e.g. the
+/// background initialization of physical memory.
+///
+/// \return True once every processor flushed its TLB, false if called on
+///         an application processor, which only flushed its own.
+bool smp_flush_tlbs();
+}  // namespace arch
+
+#endif  // KERNEL_INCLUDE_ARCH_X86_64_CPU_SMP_HPP_
@@ -0,0 +1,25 @@
+#ifndef KERNEL_INCLUDE_ARCH_X86_64_CPU_TSC_HPP_
+#define KERNEL_INCLUDE_ARCH_X86_64_CPU_TSC_HPP_
+
+#include <stdint.h>
+
+namespace arch {
+/// \brief Measure the frequency of the Time Stamp Counter.
+///
+/// This function counts TSC ticks while channel 2 of the Programmable
+/// Interval Timer (PIT) runs for a fixed amount of time.
+void tsc_calibrate();
+
+/// \brief Get the frequency of the Time Stamp Counter.
+///
+/// \return The frequency in Hz, or 0 if the TSC is not calibrated.
+uint64_t tsc_frequency();
+
+/// \brief Convert a number of TSC ticks to nanoseconds.
+///
+/// \param ticks The number of ticks.
+/// \return The number of nanoseconds, or 0 if the TSC is not calibrated.
+uint64_t tsc_to_ns(uint64_t ticks);
+}  // namespace arch
+
+#endif  // KERNEL_INCLUDE_ARCH_X86_64_CPU_TSC_HPP_
@@ -8,6 +8,10 @@
 /// \brief Base address for COM1 serial port.
 #define SERIAL_COM1 0x3F8
 
+/// \def SERIAL_COM1_IRQ
+/// \brief Legacy IRQ line of the COM1 serial port.
+#define SERIAL_COM1_IRQ 4
+
 /// \def SERIAL_COM2
 /// \brief Base address for COM2 serial port.
 #define SERIAL_COM2 0x2F8
@@ -137,6 +141,14 @@ class serial_device {
     /// \return The received 8-bit character.
     uint8_t getc();
 
+    /// \brief Check if a received character is waiting to be read.
+    ///
+    /// \return True if \ref getc would return without waiting.
+    bool received();
+
+    /// \brief Raise the port's IRQ whenever a character is received.
+    void enable_receive_irq();
+
     /// \brief Write a null-terminated string to the serial port.
     ///
     /// \param str Pointer to the null-terminated string to be written.
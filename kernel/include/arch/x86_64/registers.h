@@ -19,6 +19,14 @@
 #define X86_CR0_PG   0x80000000 ///< Paging
 /// \}
 
+///
+/// \defgroup X86_CR3 Control Register 3 (CR3) Bits
+/// \{
+///
+#define X86_CR3_PCID_MASK  0x00000fffull ///< Process-Context Identifier (with CR4.PCIDE)
+#define X86_CR3_NOFLUSH    (1ull << 63)  ///< Keep the PCID's TLB entries on load (with CR4.PCIDE)
+/// \}
+
 ///
 /// \defgroup X86_CR4 Control Register 4 (CR4) Bits
 /// \{
@@ -37,6 +45,17 @@
 #define X86_CR4_PKE        0x00400000 ///< Protection Key Enable
 /// \}
 
+///
+/// \defgroup X86_PF Page Fault Error Code Bits
+/// \{
+///
+#define X86_PF_PRESENT  0x00000001 ///< The page was present, a protection violation
+#define X86_PF_WRITE    0x00000002 ///< The access was a write
+#define X86_PF_USER     0x00000004 ///< The access came from user mode
+#define X86_PF_RSVD     0x00000008 ///< A reserved bit was set in a paging structure
+#define X86_PF_INSTR    0x00000010 ///< The access was an instruction fetch
+/// \}
+
 ///
 /// \defgroup X86_EFER Extended Feature Enable Register (EFER) Bits
 /// \{
@@ -143,10 +162,35 @@
 /// IA32 PAT (Page Attribute Table) MSR
 #define X86_MSR_IA32_PAT 0x00000277
 
+/// IA32 EFER (Extended Feature Enable Register) MSR
+#define X86_MSR_IA32_EFER 0xc0000080
+
+/// IA32 GS Base MSR, base address of the %gs segment
+#define X86_MSR_IA32_GS_BASE 0xc0000101
+
+/// IA32 Kernel GS Base MSR, exchanged with the GS base by SWAPGS
+#define X86_MSR_IA32_KERNEL_GS_BASE 0xc0000102
+
+/// IA32 TSC Auxiliary MSR, returned by RDTSCP and RDPID
+#define X86_MSR_IA32_TSC_AUX 0xc0000103
+
 /// IA32 TSC Deadline MSR
 #define X86_MSR_IA32_TSC_DEADLINE 0x000006e0
 /// \}
 
+///
+/// \defgroup X86_PAT Page Attribute Table (PAT) Memory Types
+/// \{
+///
+#define X86_PAT_UC   0x00 ///< Uncacheable
+#define X86_PAT_WC   0x01 ///< Write Combining
+#define X86_PAT_WT   0x04 ///< Write Through
+#define X86_PAT_WP   0x05 ///< Write Protected
+#define X86_PAT_WB   0x06 ///< Write Back
+#define X86_PAT_UCM  0x07 ///< Uncached, overridable by WC MTRRs (UC-)
+#define X86_PAT_ENTRY(index, type) ((uint64_t)(type) << ((index) * 8)) ///< PAT MSR field of an entry
+/// \}
+
 ///
 /// \defgroup X86_MSR_IA32_X2APIC x2APIC MSRs
 /// \{
@@ -479,6 +479,39 @@ static inline bool interrupt_status() {
     return interrupts_enabled;
 }
 
+/// \def MAX_CPUS
+/// \brief Maximum number of processors supported by the kernel.
+#define MAX_CPUS 64
+
+/// \brief Index of the processor, a per-CPU variable.
+extern uint32_t x86_cpu_index;
+
+/// \brief Get the index of the processor executing the caller.
+///
+/// The result is only stable while the caller cannot be migrated, i.e. with
+/// interrupts disabled.
+///
+/// \return Index of the current processor, in the range [0, MAX_CPUS).
+static inline uint32_t arch_current_cpu() {
+    uint32_t index;
+
+    // Read the processor's own copy, see utils::per_cpu
+    asm volatile("movl %%gs:%1, %0" : "=r"(index) : "m"(x86_cpu_index));
+    return index;
+}
+
+/// \brief Read the Time Stamp Counter (TSC).
+///
+/// The counter increments at a constant rate on processors with an invariant
+/// TSC, see \ref arch::tsc_frequency for its rate.
+///
+/// \return The current value of the Time Stamp Counter.
+static inline uint64_t x86_rdtsc() {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
 ///
 /// \brief Invalidate the Translation Lookaside Buffer (TLB) entry for the specified virtual address.
 ///
@@ -488,6 +521,30 @@ static inline void x86_invlpg(uint64_t address) {
     asm volatile("invlpg (%0)" : : "r"(address));
 }
 
+///
+/// \brief Write back and invalidate every cache line of the processor's caches.
+///
+static inline void x86_wbinvd() {
+    asm volatile("wbinvd" : : : "memory");
+}
+
+///
+/// \brief Invalidate Translation Lookaside Buffer (TLB) entries by process-context identifier (PCID).
+///
+/// \param type Invalidation type: 0 for one address of a PCID, 1 for a whole PCID, 2 for everything
+///             including global translations and 3 for everything else.
+/// \param pcid The PCID, for types 0 and 1.
+/// \param address Virtual address to invalidate, for type 0.
+///
+static inline void x86_invpcid(uint64_t type, uint64_t pcid, uint64_t address) {
+    struct {
+        uint64_t pcid;
+        uint64_t address;
+    } descriptor = {pcid, address};
+
+    asm volatile("invpcid %0, %1" : : "m"(descriptor), "r"(type) : "memory");
+}
+
 ///
 /// \brief Define accessor functions for x86_64 segment registers.
 ///
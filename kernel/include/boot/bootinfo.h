@@ -90,6 +90,12 @@ typedef struct {
     uint64_t hhdm_offset;         ///< Offset for HHDM (Higher Half Direct Map).
     void* virtual_base_address;   ///< Kernel's virtual base address
     void* physical_base_address;  ///< Kernel's physical base address
+    void* rsdp_address;           ///< Address of the ACPI RSDP, or NULL
+    char* cmdline;                ///< Kernel command line, or NULL
+    struct limine_smp_info** cpus;  ///< Processors from the bootloader, or NULL
+    size_t cpu_count;               ///< Number of entries in `cpus`
+    uint32_t bsp_lapic_id;          ///< Local APIC ID of the BSP
+    uintptr_t stack_top;  ///< Stack pointer the BSP entered the kernel with, 0 once it left that stack
 } bootinfo_t;
 
 #endif  // KERNEL_INCLUDE_BOOT_BOOTINFO_H_
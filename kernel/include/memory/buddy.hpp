@@ -0,0 +1,140 @@
+#ifndef KERNEL_INCLUDE_MEMORY_BUDDY_HPP_
+#define KERNEL_INCLUDE_MEMORY_BUDDY_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/bitmap.hpp>
+
+namespace memory {
+/// \var constexpr size_t max_order
+/// \brief The largest block order managed by the buddy allocator.
+///
+/// A block of order `n` spans `2^n` contiguous pages, so with 4 KiB pages the
+/// largest block is 1 GiB.
+constexpr size_t max_order = 18;
+
+/// \brief Get the smallest order whose block can hold the given page count.
+/// \param count Number of pages.
+/// \return The order `n` such that `2^(n-1) < count <= 2^n`.
+constexpr inline size_t order_for_count(size_t count) {
+    size_t order = 0;
+
+    while ((static_cast<size_t>(1) << order) < count) {
+        ++order;
+    }
+
+    return order;
+}
+
+/// \class buddy_allocator
+/// \brief Binary buddy allocator over a range of physical page frames.
+///
+/// Free blocks are kept on one list per order. The list nodes live inside the
+/// free pages themselves (accessed through the HHDM), while a bitmap per order
+/// records which frames currently head a free block of that order. Allocation
+/// and free are O(max_order), and freed blocks are coalesced with their buddy
+/// whenever it is free as well.
+///
+/// \note The allocator does not lock; callers must serialize access.
+class buddy_allocator {
+   public:
+    /// \brief Value returned by \ref allocate when no block is available.
+    static constexpr size_t npos = SIZE_MAX;
+
+    /// \brief Default constructor.
+    constexpr buddy_allocator() = default;
+
+    /// \brief Copy constructor (deleted).
+    buddy_allocator(const buddy_allocator&) = delete;
+
+    /// \brief Copy assignment operator (deleted).
+    buddy_allocator& operator=(const buddy_allocator&) = delete;
+
+    /// \brief Get the size of the metadata needed to track a frame range.
+    /// \param base_pfn First page frame number of the range.
+    /// \param end_pfn Page frame number one past the end of the range.
+    /// \return Size of the metadata in bytes.
+    static size_t metadata_size(size_t base_pfn, size_t end_pfn);
+
+    /// \brief Initialize the allocator with every frame marked as used.
+    /// \param base_pfn First page frame number of the range.
+    /// \param end_pfn Page frame number one past the end of the range.
+    /// \param page_size Size of a page frame in bytes.
+    /// \param metadata Buffer of at least \ref metadata_size bytes.
+    void initialize(size_t base_pfn, size_t end_pfn, size_t page_size,
+                    void* metadata);
+
+    /// \brief Allocate a naturally aligned block of `2^order` frames.
+    /// \param order Order of the block.
+    /// \return Page frame number of the block, or \ref npos.
+    size_t allocate(size_t order);
+
+    /// \brief Free a block previously returned by \ref allocate.
+    /// \param pfn Page frame number of the block.
+    /// \param order Order of the block.
+    void free(size_t pfn, size_t order);
+
+    /// \brief Free an arbitrary range of frames.
+    /// \param pfn First page frame number of the range.
+    /// \param count Number of frames in the range.
+    void free_range(size_t pfn, size_t count);
+
+    /// \brief Remove an arbitrary range of free frames from the free lists.
+    /// \param pfn First page frame number of the range.
+    /// \param count Number of frames in the range.
+    /// \return True if every frame of the range was free, false otherwise.
+    bool reserve_range(size_t pfn, size_t count);
+
+    /// \brief Get the number of free frames.
+    /// \return The number of free frames.
+    size_t free_frames() const { return this->free_frames_; }
+
+    /// \brief Get the number of free blocks of a given order.
+    /// \param order Order of the blocks.
+    /// \return The number of free blocks of that order.
+    size_t free_blocks(size_t order) const {
+        return this->free_blocks_[order];
+    }
+
+   private:
+    /// \brief Free list node stored in the first page of every free block.
+    struct free_block {
+        free_block* next;  ///< Next free block of the same order.
+        free_block* prev;  ///< Previous free block of the same order.
+    };
+
+    /// \brief Get the free list node of a frame.
+    free_block* block_of(size_t pfn) const;
+
+    /// \brief Get the page frame number of a free list node.
+    size_t pfn_of(free_block* block) const;
+
+    /// \brief Check if a frame heads a free block of the given order.
+    bool is_free_head(size_t pfn, size_t order);
+
+    /// \brief Find the free block containing a frame.
+    size_t find_free_block(size_t pfn, size_t* head);
+
+    /// \brief Push a block onto the free list of its order.
+    void push(size_t pfn, size_t order);
+
+    /// \brief Unlink a block from the free list of its order.
+    void remove(size_t pfn, size_t order);
+
+   private:
+    size_t base_pfn_ = 0;   ///< First managed frame.
+    size_t end_pfn_ = 0;    ///< One past the last managed frame.
+    size_t index_base_ = 0;  ///< `base_pfn_` aligned down to the largest block.
+    size_t page_size_ = 0;  ///< Size of a page frame in bytes.
+
+    size_t free_frames_ = 0;  ///< Number of free frames.
+
+    // clang-format off
+    free_block* free_lists_[max_order + 1] = {};  ///< Free list per order.
+    size_t free_blocks_[max_order + 1] = {};  ///< Free block count per order.
+    utils::bitmap<uint8_t> heads_[max_order + 1];  ///< Free block heads per order.
+    // clang-format on
+};
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_BUDDY_HPP_
@@ -0,0 +1,108 @@
+#ifndef KERNEL_INCLUDE_MEMORY_FRAME_STACK_HPP_
+#define KERNEL_INCLUDE_MEMORY_FRAME_STACK_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory/page.hpp>
+
+#include <atomic>
+
+namespace memory {
+/// \class frame_stack
+/// \brief Lock-free LIFO of free page frames.
+///
+/// The frames are linked through the `private_data` field of their page frame
+/// database entries, so the stack needs no storage of its own. The head packs
+/// the page frame number of the top frame (plus one, 0 meaning empty) with a
+/// tag which changes on every operation, which keeps a pop from succeeding
+/// when the top frame was popped and pushed again in the meantime (ABA).
+class frame_stack {
+   public:
+    /// \brief Value returned by \ref pop if the stack is empty.
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /// \brief Default constructor.
+    constexpr frame_stack() = default;
+
+    /// \brief Copy constructor (deleted).
+    frame_stack(const frame_stack&) = delete;
+
+    /// \brief Copy assignment operator (deleted).
+    frame_stack& operator=(const frame_stack&) = delete;
+
+    /// \brief Push a free frame.
+    /// \param database The page frame database.
+    /// \param pfn Page frame number of the frame.
+    void push(page* database, size_t pfn) {
+        std::atomic_ref<uintptr_t> link(database[pfn].private_data);
+        uint64_t head = this->head_.load(std::memory_order_relaxed);
+        uint64_t next;
+
+        do {
+            link.store(index_of(head), std::memory_order_relaxed);
+            next = make_head(tag_of(head) + 1, pfn + 1);
+        } while (!this->head_.compare_exchange_weak(
+            head, next, std::memory_order_release, std::memory_order_relaxed));
+
+        this->count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// \brief Pop a free frame.
+    /// \param database The page frame database.
+    /// \return Page frame number of the frame, or \ref npos.
+    size_t pop(page* database) {
+        uint64_t head = this->head_.load(std::memory_order_acquire);
+
+        while (index_of(head) != 0) {
+            size_t pfn = index_of(head) - 1;
+
+            // The frame may be taken and reused concurrently, in which case
+            // the link is garbage but the tag makes the exchange fail
+            std::atomic_ref<uintptr_t> link(database[pfn].private_data);
+            uint64_t index = link.load(std::memory_order_relaxed);
+            uint64_t next = make_head(tag_of(head) + 1, index);
+
+            if (this->head_.compare_exchange_weak(head, next,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_acquire)) {
+                this->count_.fetch_sub(1, std::memory_order_relaxed);
+                return pfn;
+            }
+        }
+
+        return npos;
+    }
+
+    /// \brief Get the number of frames on the stack.
+    /// \return The number of frames, only a snapshot under concurrent use.
+    size_t size() const { return this->count_.load(std::memory_order_relaxed); }
+
+   private:
+    /// \brief Number of head bits holding the page frame number.
+    static constexpr unsigned index_bits = 40;
+
+    /// \brief Mask of the head bits holding the page frame number.
+    static constexpr uint64_t index_mask = (1ul << index_bits) - 1;
+
+    /// \brief Build a head value.
+    static constexpr uint64_t make_head(uint64_t tag, uint64_t index) {
+        return (tag << index_bits) | (index & index_mask);
+    }
+
+    /// \brief Get the tag of a head value.
+    static constexpr uint64_t tag_of(uint64_t head) {
+        return head >> index_bits;
+    }
+
+    /// \brief Get the page frame number plus one of a head value.
+    static constexpr uint64_t index_of(uint64_t head) {
+        return head & index_mask;
+    }
+
+   private:
+    std::atomic<uint64_t> head_ = 0;  ///< Tag and top frame of the stack.
+    std::atomic<size_t> count_ = 0;   ///< Number of frames on the stack.
+};
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_FRAME_STACK_HPP_
@@ -0,0 +1,44 @@
+#ifndef KERNEL_INCLUDE_MEMORY_NUMA_HPP_
+#define KERNEL_INCLUDE_MEMORY_NUMA_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace memory {
+/// \var constexpr size_t max_numa_nodes
+/// \brief Upper bound for the number of NUMA nodes the kernel keeps apart.
+constexpr size_t max_numa_nodes = 8;
+
+/// \enum numa_fallback
+/// \brief What happens when the node of the calling CPU is out of memory.
+enum numa_fallback : uint32_t {
+    NumaFallbackAny = 0,        ///< Fall back to the other nodes.
+    NumaFallbackLocalOnly = 1,  ///< Fail the allocation.
+};
+
+/// \brief Discover the NUMA topology from the ACPI SRAT.
+/// \note Without a usable SRAT all memory and CPUs belong to node 0.
+void numa_initialize();
+
+/// \brief Get the number of NUMA nodes.
+/// \return The number of nodes, at least 1.
+size_t numa_node_count();
+
+/// \brief Get the NUMA node a physical address belongs to.
+/// \param address The physical address.
+/// \param end Optionally receives the address at which the answer may change.
+/// \return The node of the address, 0 if it is not described by the SRAT.
+size_t numa_node_of(paddr_t address, paddr_t* end = nullptr);
+
+/// \brief Assign a CPU to the NUMA node of its local APIC.
+/// \param cpu The CPU number.
+/// \param apic_id The local APIC ID of the CPU.
+void numa_register_cpu(uint32_t cpu, uint32_t apic_id);
+
+/// \brief Get the NUMA node of the current CPU.
+/// \return The node of the current CPU.
+size_t numa_current_node();
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_NUMA_HPP_
@@ -0,0 +1,89 @@
+#ifndef KERNEL_INCLUDE_MEMORY_PAGE_HPP_
+#define KERNEL_INCLUDE_MEMORY_PAGE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <memory/zone.hpp>
+
+#include <atomic>
+
+namespace memory {
+/// \enum page_flags
+/// \brief State bits of a page frame.
+enum page_flags : uint16_t {
+    PageReserved = 1 << 0,  ///< Not managed by the allocator (hole, firmware, kernel, ...).
+    PageHead = 1 << 1,      ///< First frame of a block from \ref request_pages.
+    PageSlab = 1 << 2,      ///< Owned by a slab cache.
+    PageLRU = 1 << 3,       ///< Linked into an LRU list.
+    PageDirty = 1 << 4,     ///< Contents differ from the backing store.
+};
+
+/// \struct page
+/// \brief Metadata of one physical page frame.
+///
+/// Every frame up to the highest managed address has one entry in the page
+/// frame database, indexed by its page frame number. An entry takes 32 bytes,
+/// i.e. 0.78% of the memory it describes with 4 KiB pages, and two entries
+/// share a cache line without straddling it.
+///
+/// Frames handed out by the allocator start with a reference count of 1. The
+/// reference count of a block from \ref request_pages lives in its head frame.
+struct page {
+    page* next;  ///< Next entry of the list the frame is on.
+    page* prev;  ///< Previous entry of the list the frame is on.
+
+    uintptr_t private_data;  ///< Owner-defined data, e.g. the owning slab.
+
+    std::atomic<uint32_t> refcount;  ///< Number of users of the frame.
+    uint16_t flags;  ///< State bits, see \ref page_flags.
+    uint8_t order;   ///< Order of the block if \ref PageHead is set.
+    uint8_t zone;    ///< NUMA node times \ref zone_count plus the \ref zone_type.
+};
+
+static_assert(sizeof(page) == 32, "struct page must stay 32 bytes large");
+
+/// \brief Get the page frame database entry of a page frame number.
+/// \param pfn The page frame number.
+/// \return Pointer to the entry, or nullptr if the frame is not covered.
+page* pfn_to_page(size_t pfn);
+
+/// \brief Get the page frame database entry of a physical address.
+/// \param address The physical address.
+/// \return Pointer to the entry, or nullptr if the frame is not covered.
+page* phys_to_page(paddr_t address);
+
+/// \brief Get the page frame number of a page frame database entry.
+/// \param frame Pointer to the entry.
+/// \return The page frame number.
+size_t page_to_pfn(const page* frame);
+
+/// \brief Get the physical address of a page frame database entry.
+/// \param frame Pointer to the entry.
+/// \return The physical address of the frame.
+paddr_t page_to_phys(const page* frame);
+
+/// \brief Take an additional reference to an allocated frame.
+/// \param frame Pointer to the entry.
+void page_get(page* frame);
+
+/// \brief Drop a reference to an allocated frame, freeing it on the last one.
+/// \param frame Pointer to the entry.
+void page_put(page* frame);
+
+/// \brief Get the NUMA node of a frame.
+/// \param frame Pointer to the entry.
+/// \return The NUMA node.
+inline size_t page_node(const page* frame) {
+    return frame->zone / zone_count;
+}
+
+/// \brief Get the zone type of a frame.
+/// \param frame Pointer to the entry.
+/// \return The zone type.
+inline zone_type page_zone(const page* frame) {
+    return static_cast<zone_type>(frame->zone % zone_count);
+}
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_PAGE_HPP_
@@ -4,6 +4,8 @@
 #include <boot/bootinfo.h>
 #include <sys/types.h>
 #include <memory/memory.hpp>
+#include <memory/numa.hpp>
+#include <memory/zone.hpp>
 #include <utils/bitmap.hpp>
 #include <utils/mutex.hpp>
 
@@ -12,23 +14,125 @@ namespace memory {
 /// \brief The default page size based on a 4 KiB shift.
 constexpr size_t default_page_size = get_page_size(KiB4);
 
+/// \enum alloc_flags
+/// \brief Flags controlling how pages are handed out by \ref request_page.
+enum alloc_flags : uint32_t {
+    AllocAny = 0,          ///< The contents of the pages do not matter.
+    AllocZeroed = 1 << 0,  ///< The pages must be filled with zeroes.
+};
+
+/// \struct phys_node_info_t
+/// \brief Structure describing the memory managed on a NUMA node.
+struct phys_node_info_t {
+    size_t free_memory;   ///< The amount of free memory on the node in bytes.
+    size_t used_memory;   ///< The amount of allocated memory on the node in bytes.
+    size_t total_memory;  ///< The amount of usable memory on the node in bytes.
+};
+
 /// \struct phys_metadata_t
 /// \brief Structure representing physical memory metadata.
 struct phys_metadata_t {
     size_t free_memory;   ///< The amount of free physical memory in bytes.
     size_t used_memory;   ///< The amount of used physical memory in bytes.
     size_t total_memory;  ///< The total physical memory size in bytes.
+    size_t reclaimed_memory;  ///< Bootloader memory given back after boot in bytes.
+    size_t highest_address;   ///< End of the highest usable memory region.
+
+    size_t node_count;  ///< The number of valid entries in `nodes`.
+    phys_node_info_t nodes[max_numa_nodes];  ///< Usable memory of every NUMA node.
+};
+
+/// \struct phys_zone_info_t
+/// \brief Structure describing a physical memory zone.
+struct phys_zone_info_t {
+    const char* name;     ///< The name of the zone.
+    size_t free_memory;   ///< The amount of free memory in the zone in bytes.
+    size_t total_memory;  ///< The amount of usable memory in the zone in bytes.
+};
+
+/// \struct phys_frag_stats_t
+/// \brief Structure representing the fragmentation of one page size class.
+struct phys_frag_stats_t {
+    size_t free_blocks;    ///< Free naturally aligned blocks of the size class.
+    size_t ideal_blocks;   ///< Blocks available if free memory were contiguous.
+    size_t fragmentation;  ///< Share of free memory unusable for the class, in percent.
 };
 
 /// \brief Get information about the physical memory.
 /// \return A structure containing metadata about the physical memory.
 phys_metadata_t get_phys_info();
 
+/// \brief Get information about a physical memory zone.
+/// \param zone The zone.
+/// \return A structure describing the zone.
+phys_zone_info_t get_phys_zone_info(zone_type zone);
+
+/// \brief Get fragmentation statistics for a page size class.
+/// \param shift The page size class.
+/// \return A structure containing the fragmentation statistics.
+phys_frag_stats_t get_phys_frag_stats(page_size_shift shift);
+
+/// \brief Print allocator telemetry to the serial port.
+///
+/// The dump covers the free blocks of every order, the longest free run of
+/// every zone, the fragmentation of every order and the request counters of
+/// every caller of \ref request_page and \ref request_pages.
+void phys_dump_telemetry();
+
+/// \var constexpr size_t max_page_cache_size
+/// \brief Upper bound for the number of pages held by a per-CPU page cache.
+constexpr size_t max_page_cache_size = 256;
+
+/// \struct phys_cache_stats_t
+/// \brief Structure representing statistics of the per-CPU page caches.
+struct phys_cache_stats_t {
+    size_t hits;           ///< Single-page requests served from a cache.
+    size_t misses;         ///< Single-page requests which found the cache empty.
+    size_t refills;        ///< Batches moved from the global allocator.
+    size_t drains;         ///< Batches moved back to the global allocator.
+    size_t cached_pages;   ///< Pages currently held by the caches.
+    size_t zeroed_hits;    ///< Zeroed single-page requests served from the pool.
+    size_t zeroed_pages;   ///< Pages currently held by the pre-zeroed pool.
+    size_t stacked_pages;  ///< Pages currently held by the lock-free free stacks.
+};
+
+/// \brief Get statistics about the per-CPU page caches, summed over all CPUs.
+/// \return A structure containing the cache statistics.
+phys_cache_stats_t get_phys_cache_stats();
+
+/// \brief Tune the per-CPU page caches.
+/// \param size Maximum number of pages held by each cache (0 disables them).
+/// \param batch Number of pages moved from or to the global allocator at once.
+void set_phys_cache_size(size_t size, size_t batch);
+
+/// \brief Choose what happens when the node of the calling CPU runs out of memory.
+/// \param policy The fallback policy (default is \ref NumaFallbackAny).
+void set_numa_fallback(numa_fallback policy);
+
 /// \brief Request a specific number of pages from the physical memory.
 /// \param count Number of pages to request (default is 1).
+/// \param flags Allocation flags (default is \ref AllocZeroed).
+/// \param zones Zones the pages may come from (default is \ref ZoneMaskAny).
 /// \return A pointer to the allocated memory.
 /// \note The memory must be freed using \ref free_page when it is no longer needed.
-void* request_page(size_t count = 1);
+void* request_page(size_t count = 1, alloc_flags flags = AllocZeroed,
+                   zone_mask zones = ZoneMaskAny);
+
+/// \brief Request a naturally aligned block of `2^order` contiguous pages.
+/// \param order Order of the block, e.g. 9 for 2 MiB with 4 KiB pages.
+/// \param align Alignment of the block as an order (default is the block's own).
+/// \param flags Allocation flags (default is \ref AllocZeroed).
+/// \param zones Zones the block may come from (default is \ref ZoneMaskAny).
+/// \return A pointer to the allocated memory, or nullptr if no such block is available.
+/// \note The memory must be freed using \ref free_pages when it is no longer needed.
+void* request_pages(size_t order, size_t align = 0,
+                    alloc_flags flags = AllocZeroed,
+                    zone_mask zones = ZoneMaskAny);
+
+/// \brief Free a block of pages obtained through \ref request_pages.
+/// \param address Pointer to the starting address of the block.
+/// \param order Order of the block.
+void free_pages(void* address, size_t order);
 
 /// \brief Free a specific number of pages in the physical memory.
 /// \param address Pointer to the starting address of the memory to free.
@@ -36,6 +140,18 @@ void* request_page(size_t count = 1);
 /// \note This function should be used to release memory obtained through \ref request_page.
 void free_page(void* address, size_t count = 1);
 
+/// \brief Zero one free page in the background for later zeroed requests.
+/// \return True if a page was added to the pre-zeroed pool, false if there
+///         is nothing left to do.
+/// \note This function is meant to be called from the idle loop.
+bool phys_zero_idle_page();
+
+/// \brief Hand the bootloader-reclaimable memory over to the allocator.
+/// \param bootinfo Pointer to boot information, updated to point to kernel copies.
+/// \note The bootloader's page tables are kept while they are in use, and
+///       nothing is reclaimed while a processor runs on its stacks.
+void phys_reclaim_bootloader_memory(bootinfo_t* bootinfo);
+
 /// \brief Initialize physical memory management.
 /// \param bootinfo Pointer to boot information.
 /// \param page_size The size of a page (default is default_page_size).
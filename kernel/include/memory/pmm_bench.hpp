@@ -0,0 +1,17 @@
+#ifndef KERNEL_INCLUDE_MEMORY_PMM_BENCH_HPP_
+#define KERNEL_INCLUDE_MEMORY_PMM_BENCH_HPP_
+
+#include <stddef.h>
+
+namespace memory {
+/// \brief Run the physical memory allocator benchmarks.
+///
+/// Results are printed as `pmm-bench` lines of `key=value` pairs.
+///
+/// \param selection Comma separated names of the workloads to run, all of
+///                  them if empty.
+/// \param length Length of `selection`.
+void phys_run_benchmarks(const char* selection, size_t length);
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_PMM_BENCH_HPP_
@@ -0,0 +1,237 @@
+#ifndef KERNEL_INCLUDE_MEMORY_SLAB_HPP_
+#define KERNEL_INCLUDE_MEMORY_SLAB_HPP_
+
+#include <arch/arch.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory/pmm.hpp>
+#include <utils/mutex.hpp>
+
+namespace memory {
+/// \brief Function bringing a fresh object of a cache into its constructed
+///        state.
+using slab_ctor = void (*)(void* object);
+
+/// \enum slab_flags
+/// \brief Flags changing the behaviour of a \ref slab_cache.
+enum slab_flags : uint32_t {
+    SlabDefault = 0,           ///< Objects pass through per-CPU magazines.
+    SlabNoMagazines = 1 << 0,  ///< Objects come straight from the slabs.
+};
+
+/// \var constexpr size_t magazine_size
+/// \brief Number of objects a magazine holds.
+constexpr size_t magazine_size = 14;
+
+/// \var constexpr size_t max_depot_magazines
+/// \brief Number of full magazines a depot holds before objects go back to
+///        the slabs.
+constexpr size_t max_depot_magazines = 16;
+
+/// \var constexpr size_t max_slab_order
+/// \brief Order of the largest block of pages a slab is carved from.
+constexpr size_t max_slab_order = 3;
+
+/// \var constexpr size_t kmalloc_max_size
+/// \brief Largest request \ref kmalloc serves from a slab cache, larger ones
+///        get whole pages.
+constexpr size_t kmalloc_max_size = 2048;
+
+/// \class slab_cache
+/// \brief A cache of equally sized objects carved from blocks of pages.
+///
+/// Every slab is a naturally aligned block from \ref request_pages holding
+/// the objects at its start and its bookkeeping at its end, so objects are
+/// aligned to their size if it is a power of two. Free objects are tracked
+/// by index rather than through a link stored in them, which lets objects
+/// keep their constructed state: the constructor runs once when a slab is
+/// created, and objects must be freed in their constructed state. One empty
+/// slab is kept per cache to absorb allocation bursts.
+///
+/// In front of the slabs, every CPU holds a loaded and a previous magazine
+/// of objects, so most allocations and frees only touch CPU-local state with
+/// interrupts disabled. Full and empty magazines are exchanged with a depot
+/// shared by all CPUs, and the slabs are only used when the depot has
+/// nothing to offer or is full (Bonwick's magazine layer).
+class slab_cache {
+   public:
+    /// \brief Default constructor, for a cache to be initialized later.
+    constexpr slab_cache() = default;
+
+    /// \brief Constructor.
+    /// \param name Name of the cache, used for logging.
+    /// \param size Size of an object in bytes.
+    /// \param align Alignment of an object (default is 8 bytes).
+    /// \param ctor Constructor of the objects (default is none).
+    /// \param flags Behaviour of the cache (default is \ref SlabDefault).
+    constexpr slab_cache(const char* name, size_t size, size_t align = 0,
+                         slab_ctor ctor = nullptr,
+                         slab_flags flags = SlabDefault) {
+        this->initialize(name, size, align, ctor, flags);
+    }
+
+    /// \brief Copy constructor (deleted).
+    slab_cache(const slab_cache&) = delete;
+
+    /// \brief Copy assignment operator (deleted).
+    slab_cache& operator=(const slab_cache&) = delete;
+
+    /// \brief Set the object layout of an unused cache.
+    /// \param name Name of the cache, used for logging.
+    /// \param size Size of an object in bytes.
+    /// \param align Alignment of an object, a power of two (default is 8
+    ///              bytes).
+    /// \param ctor Constructor of the objects (default is none).
+    /// \param flags Behaviour of the cache (default is \ref SlabDefault).
+    constexpr void initialize(const char* name, size_t size, size_t align = 0,
+                              slab_ctor ctor = nullptr,
+                              slab_flags flags = SlabDefault) {
+        align = align < 8 ? 8 : align;
+        size = (size + align - 1) & ~(align - 1);
+
+        this->name_ = name;
+        this->size_ = size;
+        this->ctor_ = ctor;
+        this->flags_ = flags;
+
+        // Take the smallest slab holding enough objects with little waste
+        for (size_t order = 0; order <= max_slab_order; ++order) {
+            size_t bytes = default_page_size << order;
+            size_t capacity = capacity_of(bytes, size);
+
+            this->order_ = order;
+            this->capacity_ = capacity;
+
+            if (capacity >= min_objects &&
+                bytes - capacity * size <= bytes / 8) {
+                break;
+            }
+        }
+    }
+
+    /// \brief Allocate an object.
+    /// \return Pointer to the object, or nullptr if out of memory.
+    void* allocate();
+
+    /// \brief Free an object of the cache.
+    /// \param object Pointer to the object, in its constructed state.
+    void free(void* object);
+
+    /// \brief Get the name of the cache.
+    /// \return The name.
+    const char* name() const { return this->name_; }
+
+    /// \brief Get the size of an object, including padding.
+    /// \return The size in bytes.
+    size_t object_size() const { return this->size_; }
+
+    /// \brief Get the number of objects taken from the slabs.
+    /// \return The number of objects, including those held by magazines,
+    ///         only a snapshot under concurrent use.
+    size_t active_objects() const { return this->active_; }
+
+    /// \brief Get the number of objects in all slabs of the cache.
+    /// \return The number of objects, only a snapshot under concurrent use.
+    size_t total_objects() const {
+        return this->slab_count_ * this->capacity_;
+    }
+
+    /// \brief Get the next cache on the list of caches with slabs.
+    /// \return The next cache, or nullptr.
+    slab_cache* next_cache() const { return this->next_cache_; }
+
+    /// \brief Print the counters of the cache and of every CPU using it.
+    /// \param elapsed Nanoseconds since the previous dump, for the rates.
+    void dump_telemetry(uint64_t elapsed);
+
+    /// \brief Bookkeeping of a slab, stored at the end of its block.
+    struct slab;
+
+    /// \brief A stack of up to \ref magazine_size objects.
+    struct magazine;
+
+   private:
+    /// \brief Smallest number of objects a slab should hold.
+    static constexpr size_t min_objects = 8;
+
+    /// \brief Bytes of a slab reserved for its header and alignment.
+    static constexpr size_t header_size = 64;
+
+    /// \brief Get the number of objects fitting into a slab.
+    static constexpr size_t capacity_of(size_t bytes, size_t size) {
+        // Every object also takes one entry of the free index array
+        size_t capacity = (bytes - header_size) / (size + sizeof(uint16_t));
+
+        return capacity > UINT16_MAX ? UINT16_MAX : capacity;
+    }
+
+    /// \struct cpu_cache
+    /// \brief The magazines and counters of one CPU.
+    struct __ALIGNED(64) cpu_cache {
+        magazine* loaded = nullptr;    ///< Magazine objects come from first.
+        magazine* previous = nullptr;  ///< Full or empty spare magazine.
+        size_t allocs = 0;             ///< Objects allocated on the CPU.
+        size_t frees = 0;              ///< Objects freed on the CPU.
+        size_t dumped_allocs = 0;      ///< `allocs` at the previous dump.
+        size_t dumped_frees = 0;       ///< `frees` at the previous dump.
+    };
+
+    /// \brief Allocate an object from the slabs.
+    void* allocate_slab_();
+
+    /// \brief Give an object back to its slab.
+    void free_slab_(void* object);
+
+    /// \brief Create a slab with every object constructed.
+    slab* grow_();
+
+    /// \brief Give the pages of a slab back to the allocator.
+    void release_(slab* victim);
+
+   private:
+    const char* name_ = nullptr;  ///< Name of the cache.
+    size_t size_ = 0;             ///< Size of an object in bytes.
+    size_t order_ = 0;            ///< Order of the block of a slab.
+    size_t capacity_ = 0;         ///< Number of objects in a slab.
+    slab_ctor ctor_ = nullptr;    ///< Constructor of the objects.
+    slab_flags flags_ = SlabDefault;  ///< Behaviour of the cache.
+
+    slab* partial_ = nullptr;  ///< Slabs with free and allocated objects.
+    slab* full_ = nullptr;     ///< Slabs without free objects.
+    slab* empty_ = nullptr;    ///< Slab kept without allocated objects.
+
+    size_t slab_count_ = 0;  ///< Number of slabs of the cache.
+    size_t active_ = 0;      ///< Number of objects taken from the slabs.
+    utils::irq_lock lock_;   ///< Lock protecting the slab lists.
+
+    magazine* full_magazines_ = nullptr;   ///< Full magazines of the depot.
+    magazine* empty_magazines_ = nullptr;  ///< Empty magazines of the depot.
+    size_t full_count_ = 0;                ///< Number of full magazines.
+    size_t empty_count_ = 0;               ///< Number of empty magazines.
+    utils::irq_lock depot_lock_;           ///< Lock protecting the depot.
+
+    cpu_cache cpus_[MAX_CPUS];  ///< Magazines of every CPU.
+
+    slab_cache* next_cache_ = nullptr;  ///< Next cache with slabs.
+    bool listed_ = false;  ///< Whether the cache is on the list of caches.
+};
+
+/// \brief Allocate memory from the kernel heap.
+/// \param size Size of the memory in bytes.
+/// \return Pointer to the memory, aligned to `size` rounded up to a power of
+///         two (at least 16 bytes), or nullptr if out of memory.
+void* kmalloc(size_t size);
+
+/// \brief Free memory obtained through \ref kmalloc.
+/// \param address Pointer to the memory, may be nullptr.
+void kfree(void* address);
+
+/// \brief Print the counters of every object cache to the serial port.
+///
+/// Lines start with `slab-telemetry` followed by `key=value` pairs: one per
+/// cache with its slab and depot usage, and one per cache and CPU with its
+/// allocations and frees, in total and per second since the previous dump.
+void slab_dump_telemetry();
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_SLAB_HPP_
@@ -0,0 +1,79 @@
+#ifndef KERNEL_INCLUDE_MEMORY_VMALLOC_HPP_
+#define KERNEL_INCLUDE_MEMORY_VMALLOC_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <memory/vmm.hpp>
+
+namespace memory {
+/// \var constexpr vaddr_t vmalloc_start
+/// \brief First address of the region \ref vmalloc maps buffers into.
+///
+/// The region lies between the higher half direct map, which covers at most
+/// 64 TiB of physical memory, and the kernel image.
+constexpr vaddr_t vmalloc_start = 0xffffc90000000000;
+
+/// \var constexpr size_t vmalloc_size
+/// \brief Size of the region \ref vmalloc maps buffers into.
+constexpr size_t vmalloc_size = 1ul << 40;
+
+/// \var constexpr size_t vmalloc_lazy_max
+/// \brief Bytes of freed address space collected before the TLB is flushed.
+constexpr size_t vmalloc_lazy_max = 32ul << 20;
+
+/// \enum vmalloc_flags
+/// \brief Flags controlling how \ref vmalloc builds a buffer.
+enum vmalloc_flags : uint32_t {
+    VmallocDefault = 0,      ///< No guard pages, contents undefined.
+    VmallocGuard = 1 << 0,   ///< Leave an unmapped page on both sides.
+    VmallocZeroed = 1 << 1,  ///< Fill the buffer with zeroes.
+    VmallocLazy = 1 << 2,    ///< Back pages on first touch, zeroed.
+    VmallocIo = 1 << 3,      ///< Maps memory owned by a device, set by
+                             ///< \ref ioremap.
+};
+
+/// \brief Combine two sets of vmalloc flags.
+constexpr inline vmalloc_flags operator|(vmalloc_flags lhs,
+                                         vmalloc_flags rhs) {
+    return static_cast<vmalloc_flags>(static_cast<uint32_t>(lhs) |
+                                      static_cast<uint32_t>(rhs));
+}
+
+/// \brief Allocate a virtually contiguous buffer.
+/// \param size Size of the buffer in bytes.
+/// \param flags Guard pages and contents (default is \ref VmallocDefault).
+/// \return Page aligned pointer to the buffer, or nullptr if out of memory
+///         or address space.
+void* vmalloc(size_t size, vmalloc_flags flags = VmallocDefault);
+
+/// \brief Back the page of a lazy buffer an access faulted on.
+/// \param address The faulting address.
+/// \return True if the page is mapped now, false if the address is not
+///         within a lazy buffer or out of memory.
+bool vmalloc_fault(vaddr_t address);
+
+/// \brief Free a buffer obtained through \ref vmalloc.
+/// \param address Pointer to the buffer, may be nullptr.
+void vfree(void* address);
+
+/// \brief Map device memory, such as registers or a framebuffer.
+/// \param phys Physical address of the memory.
+/// \param size Size of the memory in bytes.
+/// \param cache Cache type of the mapping, such as \ref VmUncached for
+///              registers or \ref VmWriteCombining for framebuffers.
+/// \return Pointer to the memory, or nullptr if out of address space.
+void* ioremap(paddr_t phys, size_t size, vm_flags cache);
+
+/// \brief Remove a mapping made by \ref ioremap.
+/// \param address Pointer returned by \ref ioremap, may be nullptr.
+void iounmap(void* address);
+
+/// \brief Flush the TLB and release everything freed by \ref vfree since.
+void vmalloc_purge();
+
+/// \brief Set up the vmalloc region.
+void vmalloc_initialize();
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_VMALLOC_HPP_
@@ -0,0 +1,205 @@
+#ifndef KERNEL_INCLUDE_MEMORY_VMM_HPP_
+#define KERNEL_INCLUDE_MEMORY_VMM_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <boot/bootinfo.h>
+#include <memory/page.hpp>
+#include <utils/mutex.hpp>
+
+namespace memory {
+/// \enum vm_flags
+/// \brief Access rights and attributes of a virtual memory mapping.
+///
+/// At most one of the cache types may be given, mappings are write-back
+/// otherwise.
+enum vm_flags : uint32_t {
+    VmRead = 0,                 ///< Readable, which every mapping is.
+    VmWrite = 1 << 0,           ///< Writable.
+    VmExecute = 1 << 1,         ///< Executable.
+    VmUser = 1 << 2,            ///< Accessible from user mode.
+    VmWriteBack = 0,            ///< Fully cached, the default.
+    VmUncached = 1 << 3,        ///< Not cached, e.g. for device registers.
+    VmWriteCombining = 2 << 3,  ///< Not cached, writes are combined in
+                                ///< buffers, e.g. for framebuffers.
+    VmWriteThrough = 3 << 3,    ///< Reads are cached, writes go to memory.
+    VmCacheMask = 3 << 3,       ///< Bits holding the cache type.
+};
+
+/// \brief Combine two sets of mapping flags.
+constexpr inline vm_flags operator|(vm_flags lhs, vm_flags rhs) {
+    return static_cast<vm_flags>(static_cast<uint32_t>(lhs) |
+                                 static_cast<uint32_t>(rhs));
+}
+
+/// \class address_space
+/// \brief A four-level page table hierarchy.
+///
+/// Mappings are made with the largest page size (4 KiB, 2 MiB or 1 GiB) both
+/// addresses are aligned to and the remaining length covers. Huge pages are
+/// split on demand when only part of them is unmapped or reprotected. Page
+/// tables are allocated from the physical memory manager and accessed
+/// through the higher half direct map.
+class address_space {
+   public:
+    /// \brief Value returned by \ref translate for unmapped addresses.
+    static constexpr paddr_t npos = ~static_cast<paddr_t>(0);
+
+    /// \brief Default constructor.
+    constexpr address_space() = default;
+
+    /// \brief Copy constructor (deleted).
+    address_space(const address_space&) = delete;
+
+    /// \brief Copy assignment operator (deleted).
+    address_space& operator=(const address_space&) = delete;
+
+    /// \brief Allocate the top-level table of the address space.
+    /// \return True on success, false if out of memory.
+    bool initialize();
+
+    /// \brief Free the tables of the address space.
+    ///
+    /// The tables of the kernel half, shared with the kernel's space, stay.
+    /// The space must not be active on any CPU.
+    void destroy();
+
+    /// \brief Map a range of physical memory, replacing existing mappings.
+    /// \param virt Virtual address of the range, page aligned.
+    /// \param phys Physical address of the range, page aligned.
+    /// \param size Size of the range in bytes, a multiple of the page size.
+    /// \param flags Access rights of the mapping.
+    /// \return True on success, false if the arguments are misaligned or a
+    ///         page table could not be allocated.
+    bool map(vaddr_t virt, paddr_t phys, size_t size, vm_flags flags);
+
+    /// \brief Remove the mappings of a range.
+    /// \param virt Virtual address of the range, page aligned.
+    /// \param size Size of the range in bytes, a multiple of the page size.
+    /// \param flush Whether to drop the translations from the TLB (default
+    ///              is true). Otherwise the caller must flush the TLB before
+    ///              the range or the memory behind it is reused.
+    /// \return True on success, false if the arguments are misaligned or a
+    ///         huge page could not be split.
+    bool unmap(vaddr_t virt, size_t size, bool flush = true);
+
+    /// \brief Change the access rights of the mapped pages of a range.
+    /// \param virt Virtual address of the range, page aligned.
+    /// \param size Size of the range in bytes, a multiple of the page size.
+    /// \param flags New access rights.
+    /// \return True on success, false if the arguments are misaligned, a
+    ///         huge page could not be split or the kernel's space is changed
+    ///         from an application processor.
+    bool protect(vaddr_t virt, size_t size, vm_flags flags);
+
+    /// \brief Get the physical address a virtual address is mapped to.
+    /// \param virt The virtual address.
+    /// \return The physical address, or \ref npos if it is not mapped.
+    paddr_t translate(vaddr_t virt);
+
+    /// \brief Get the physical address a virtual address is mapped to,
+    ///        without taking the lock.
+    ///
+    /// Meant for the page fault handler, which may run while the current
+    /// CPU holds the lock. The result may be outdated by concurrent changes.
+    ///
+    /// \param virt The virtual address.
+    /// \return The physical address, or \ref npos if it is not mapped.
+    paddr_t translate_unlocked(vaddr_t virt);
+
+    /// \brief Load the address space into CR3.
+    void activate();
+
+    /// \brief Get the physical address of the top-level table.
+    /// \return The physical address, 0 if the space is not initialized.
+    paddr_t root() const { return this->root_; }
+
+   private:
+    /// \brief Get the entry for an address at a level, creating tables and
+    ///        splitting huge pages above it as needed.
+    uint64_t* walk_(vaddr_t virt, size_t level, uint64_t bits);
+
+    /// \brief Get the leaf or first non-present entry for an address.
+    uint64_t* lookup_(vaddr_t virt, size_t* level);
+
+    /// \brief Replace a huge page by a table of smaller pages.
+    bool split_(uint64_t* entry, size_t level, vaddr_t virt);
+
+    /// \brief Free a page table and the tables below it.
+    void free_table_(paddr_t table, size_t level, page** deferred = nullptr);
+
+    /// \brief Drop a translation from the TLB.
+    void flush_(vaddr_t virt);
+
+    /// \brief Check if the space is loaded into CR3.
+    bool active_() const;
+
+   private:
+    paddr_t root_ = 0;      ///< Physical address of the PML4.
+    utils::irq_lock lock_;  ///< Lock serializing changes to the tables.
+
+    uint16_t pcid_ = 0;  ///< Process-context identifier of the space.
+    uint64_t pcid_generation_ = 0;  ///< Round `pcid_` was handed out in.
+    bool stale_ = false;  ///< Whether translations under `pcid_` are stale.
+};
+
+/// \brief Get the address space of the kernel.
+/// \return The kernel's address space.
+address_space& kernel_space();
+
+/// \brief Get the framebuffer in the higher half direct map.
+/// \param size Receives the size of the mapping in bytes.
+/// \return Page aligned pointer to the framebuffer, or nullptr if the
+///         memory map has none.
+void* framebuffer_mapping(size_t* size);
+
+/// \brief Load the kernel's layout of the page attribute table.
+///
+/// Every CPU must run this before using the kernel's page tables.
+void pat_initialize();
+
+/// \brief Drop every translation from the TLB, global ones included.
+void tlb_flush_all();
+
+/// \brief Turn the use of process-context identifiers on or off.
+/// \param enable Whether to activate address spaces with their PCID.
+/// \return False if PCIDs are not supported, true otherwise.
+bool set_pcid_enabled(bool enable);
+
+/// \brief Try to resolve a page fault.
+///
+/// Pages of lazy vmalloc buffers are backed on the first touch, anything
+/// else the kernel faults on is left to the caller.
+///
+/// \param address The faulting address, from CR2.
+/// \param error The error code of the fault.
+/// \return True if the access can be retried, false otherwise.
+bool handle_page_fault(vaddr_t address, uint64_t error);
+
+/// \brief Print the page fault counters to the serial port.
+///
+/// The line starts with `vmm-telemetry` followed by `key=value` pairs with
+/// the number of faults by outcome and the time spent resolving them.
+void virt_dump_telemetry();
+
+/// \brief Build the kernel's page tables and switch to them.
+///
+/// The higher half direct map and the kernel image are mapped with the
+/// largest pages possible, the image with the access rights of its segments.
+/// Kernel mappings are global, and PCIDs are used if the CPU supports them.
+/// The framebuffer is mapped write-combining.
+///
+/// \param bootinfo Pointer to boot information.
+void virt_initialize(bootinfo_t* bootinfo);
+
+/// \brief Switch an application processor to the kernel's page tables.
+///
+/// Turns on the same paging features as \ref virt_initialize did on the
+/// bootstrap processor, which must have run first.
+///
+/// \return False if the kernel stayed on the bootloader's page tables.
+bool virt_initialize_cpu();
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_VMM_HPP_
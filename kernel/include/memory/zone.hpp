@@ -0,0 +1,207 @@
+#ifndef KERNEL_INCLUDE_MEMORY_ZONE_HPP_
+#define KERNEL_INCLUDE_MEMORY_ZONE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <memory/buddy.hpp>
+#include <utils/bitmap.hpp>
+#include <utils/bitmap_index.hpp>
+#include <utils/mutex.hpp>
+
+namespace memory {
+/// \enum zone_type
+/// \brief Physical memory zones, ordered by address.
+enum zone_type : size_t {
+    ZoneDMA = 0,     ///< Memory below 16 MiB, reachable by ISA DMA.
+    ZoneDMA32 = 1,   ///< Memory below 4 GiB, reachable by 32-bit devices.
+    ZoneNormal = 2,  ///< All remaining memory.
+};
+
+/// \var constexpr size_t zone_count
+/// \brief Number of physical memory zones.
+constexpr size_t zone_count = 3;
+
+/// \enum zone_mask
+/// \brief Set of zones an allocation may be served from.
+enum zone_mask : uint32_t {
+    ZoneMaskDMA = 1 << ZoneDMA,        ///< Allow the DMA zone.
+    ZoneMaskDMA32 = 1 << ZoneDMA32,    ///< Allow the DMA32 zone.
+    ZoneMaskNormal = 1 << ZoneNormal,  ///< Allow the Normal zone.
+
+    /// Allow every zone.
+    ZoneMaskAny = ZoneMaskDMA | ZoneMaskDMA32 | ZoneMaskNormal,
+};
+
+/// \brief Get the address at which a zone ends.
+/// \param zone The zone.
+/// \return Physical address one past the end of the zone.
+constexpr inline paddr_t zone_limit(zone_type zone) {
+    switch (zone) {
+        case ZoneDMA:
+            return 16ul << 20;
+        case ZoneDMA32:
+            return 4ul << 30;
+        default:
+            return ~static_cast<paddr_t>(0);
+    }
+}
+
+/// \class phys_zone
+/// \brief A range of physical page frames with its own allocator and lock.
+///
+/// Every zone tracks its frames with a bitmap (optionally indexed by a
+/// \ref utils::bitmap_index) and hands them out through a buddy allocator.
+/// Zones never share bookkeeping, so allocations from different zones do not
+/// contend with each other.
+class phys_zone {
+   public:
+    /// \brief Value returned by the allocation functions on failure.
+    static constexpr size_t npos = buddy_allocator::npos;
+
+    /// \brief Default constructor.
+    constexpr phys_zone() = default;
+
+    /// \brief Copy constructor (deleted).
+    phys_zone(const phys_zone&) = delete;
+
+    /// \brief Copy assignment operator (deleted).
+    phys_zone& operator=(const phys_zone&) = delete;
+
+    /// \brief Get the size of the metadata needed by a zone.
+    /// \param base_pfn First page frame number of the zone.
+    /// \param end_pfn Page frame number one past the end of the zone.
+    /// \param page_size Size of a page frame in bytes.
+    /// \return Size of the metadata in bytes.
+    static size_t metadata_size(size_t base_pfn, size_t end_pfn,
+                                size_t page_size);
+
+    /// \brief Initialize the zone with every frame marked as used.
+    /// \param name Name of the zone, used for logging.
+    /// \param base_pfn First page frame number of the zone.
+    /// \param end_pfn Page frame number one past the end of the zone.
+    /// \param page_size Size of a page frame in bytes.
+    /// \param metadata Buffer of at least \ref metadata_size bytes.
+    void initialize(const char* name, size_t base_pfn, size_t end_pfn,
+                    size_t page_size, void* metadata);
+
+    /// \brief Hand a range of usable frames over to the zone.
+    /// \param pfn First page frame number of the range.
+    /// \param count Number of frames in the range.
+    void add_range(size_t pfn, size_t count);
+
+    /// \brief Allocate contiguous frames.
+    /// \param count Number of frames.
+    /// \return Page frame number of the first frame, or \ref npos.
+    size_t allocate(size_t count);
+
+    /// \brief Allocate a block of `2^order` frames aligned to `2^align` frames.
+    /// \param order Order of the block.
+    /// \param align Alignment of the block as an order.
+    /// \return Page frame number of the block, or \ref npos.
+    size_t allocate_aligned(size_t order, size_t align);
+
+    /// \brief Allocate single frames under one lock acquisition.
+    /// \param pages Array receiving the page frame numbers.
+    /// \param count Maximum number of frames to allocate.
+    /// \return Number of frames allocated.
+    size_t allocate_batch(size_t* pages, size_t count);
+
+    /// \brief Free contiguous frames.
+    /// \param pfn Page frame number of the first frame.
+    /// \param count Number of frames.
+    /// \return True if the frames were freed, false if one of them was not
+    ///         allocated.
+    bool free(size_t pfn, size_t count);
+
+    /// \brief Free those of the given single frames which belong to the zone.
+    /// \param pages Array of page frame numbers.
+    /// \param count Number of entries in the array.
+    void free_batch(const size_t* pages, size_t count);
+
+    /// \brief Check if a frame of the zone is allocated.
+    /// \param pfn Page frame number.
+    /// \return True if the frame is allocated, false otherwise.
+    bool is_allocated(size_t pfn) const;
+
+    /// \brief Count free blocks of an order, including those inside larger
+    ///        free blocks.
+    /// \param order Order of the blocks.
+    /// \return The number of free blocks.
+    size_t free_blocks(size_t order);
+
+    /// \brief Count the free blocks of exactly one order.
+    /// \param order Order of the blocks.
+    /// \return The number of blocks on the buddy free list of the order.
+    size_t free_list_blocks(size_t order);
+
+    /// \brief Find the longest run of free frames.
+    /// \return The number of frames in the run.
+    size_t largest_free_run();
+
+    /// \brief Check if the zone is initialized.
+    /// \return True if the zone is initialized, false otherwise.
+    bool initialized() const { return this->name_ != nullptr; }
+
+    /// \brief Check if a frame belongs to the zone.
+    /// \param pfn Page frame number.
+    /// \return True if the frame belongs to the zone, false otherwise.
+    bool contains(size_t pfn) const {
+        return pfn >= this->base_pfn_ && pfn < this->end_pfn_;
+    }
+
+    /// \brief Get the name of the zone.
+    /// \return The name of the zone.
+    const char* name() const { return this->name_; }
+
+    /// \brief Get the number of usable frames in the zone.
+    /// \return The number of usable frames.
+    size_t total_frames() const { return this->total_frames_; }
+
+    /// \brief Get the number of free frames in the zone.
+    /// \return The number of free frames.
+    size_t free_frames() const { return this->buddy_.free_frames(); }
+
+    /// \brief Check if the zone's bitmap has a summary index.
+    /// \return True if the bitmap is indexed, false otherwise.
+    bool indexed() const { return this->index_.initialized(); }
+
+    /// \brief Get the size of the zone's bitmap.
+    /// \return Size of the bitmap in bytes.
+    size_t bitmap_bytes() const;
+
+    /// \brief Get the size of the summary index over the zone's bitmap.
+    /// \return Size of the index in bytes, 0 if the bitmap is not indexed.
+    size_t index_bytes() const;
+
+   private:
+    /// \brief Check if a zone gets a summary index over its bitmap.
+    static bool wants_index(size_t base_pfn, size_t end_pfn, size_t page_size);
+
+    /// \brief Allocate frames with the lock held.
+    size_t allocate_(size_t count);
+
+    /// \brief Take a run of frames found by a bitmap search.
+    size_t allocate_run_(size_t start, size_t count, size_t align);
+
+    /// \brief Mark frames as used in the bitmap.
+    void mark_used_(size_t pfn, size_t count);
+
+   private:
+    const char* name_ = nullptr;  ///< Name of the zone.
+    size_t base_pfn_ = 0;         ///< First frame of the zone.
+    size_t end_pfn_ = 0;          ///< One past the last frame of the zone.
+    size_t index_base_ = 0;       ///< Frame tracked by the first bitmap bit.
+    size_t total_frames_ = 0;     ///< Number of usable frames.
+    size_t last_index_ = 0;       ///< Where the last bitmap search ended.
+
+    // clang-format off
+    utils::bitmap<uint64_t> bitmap_;  ///< Allocated frames, relative to `index_base_`.
+    utils::bitmap_index index_;  ///< Optional summary index over `bitmap_`.
+    buddy_allocator buddy_;  ///< Allocator handing out the frames.
+    utils::queued_spinlock lock_;  ///< Lock serializing access to the zone.
+    // clang-format on
+};
+}  // namespace memory
+
+#endif  // KERNEL_INCLUDE_MEMORY_ZONE_HPP_
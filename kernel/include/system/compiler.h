@@ -67,6 +67,10 @@
 // Align the variable or type to at least `x` bytes. `x` must be a power of two.
 #define __ALIGNED(x) __attribute__((aligned(x)))
 
+// Place the variable in the per-CPU template, every CPU gets a copy of it.
+// See `utils::per_cpu` for how the copies are accessed.
+#define __PER_CPU __attribute__((section(".percpu")))
+
 // Declare the given function will never return. (such as `exit`, `abort`, etc).
 #define __NO_RETURN __attribute__((__noreturn__))
 
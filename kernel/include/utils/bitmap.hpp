@@ -4,20 +4,27 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <utils/common.h>
 
 namespace utils {
 /// \tparam T The type of elements stored in the bitmap.
+///
+/// The search and range operations work on whole elements at a time, so a
+/// `uint64_t` bitmap inspects 64 bits per step.
 template <typename T>
 class bitmap {
    public:
+    /// \brief Value returned by the search operations when nothing is found.
+    static constexpr size_t npos = SIZE_MAX;
+
     /// \brief Default constructor.
     constexpr bitmap() = default;
 
     /// \brief Parameterized constructor.
     ///
     /// \param buffer Pointer to the buffer storing the bitmap data.
-    /// \param size Size of the buffer in terms of elements of type T.
+    /// \param size Number of bits tracked by the bitmap.
     constexpr bitmap(T* buffer, size_t size)
         : buffer_(buffer), size_(size), initialized_(true) {}
 
@@ -27,7 +34,7 @@ class bitmap {
     /// \brief Initialize the bitmap with a buffer and size.
     ///
     /// \param buffer Pointer to the buffer storing the bitmap data.
-    /// \param size Size of the buffer in terms of elements of type T.
+    /// \param size Number of bits tracked by the bitmap.
     void initialize(T* buffer, size_t size) {
         assert(!this->initialized_);
 
@@ -77,9 +84,9 @@ class bitmap {
     ///
     /// \param index Index of the bit to be retrieved.
     /// \return The value of the specified bit.
-    constexpr bool get(size_t index) {
+    constexpr bool get(size_t index) const {
         assert(this->initialized_);
-        return this->buffer_[index / bit_size()] & (1 << (index % bit_size()));
+        return this->buffer_[index / bit_size()] & bit_mask(index);
     }
 
     /// \brief Set the value of a specific bit in the bitmap.
@@ -93,17 +100,85 @@ class bitmap {
         bool ret = this->get(index);
 
         if (value) {
-            this->buffer_[index / bit_size()] |= (1 << (index % bit_size()));
+            this->buffer_[index / bit_size()] |= bit_mask(index);
         } else {
-            this->buffer_[index / bit_size()] &= ~(1 << (index % bit_size()));
+            this->buffer_[index / bit_size()] &=
+                static_cast<T>(~bit_mask(index));
         }
 
         return ret;
     }
 
+    /// \brief Find the first cleared bit at or after a given index.
+    ///
+    /// \param start Index to start searching from (default is 0).
+    /// \return Index of the first cleared bit, or \ref npos.
+    constexpr size_t find_first_zero(size_t start = 0) const {
+        return this->find_next(start, true);
+    }
+
+    /// \brief Find the first set bit at or after a given index.
+    ///
+    /// \param start Index to start searching from.
+    /// \return Index of the first set bit, or \ref npos.
+    constexpr size_t find_next_set(size_t start) const {
+        return this->find_next(start, false);
+    }
+
+    /// \brief Find a run of cleared bits.
+    ///
+    /// \param length Number of consecutive cleared bits to find.
+    /// \param align Alignment of the first bit of the run (default is 1).
+    /// \param start Index to start searching from (default is 0).
+    /// \return Index of the first bit of the run, or \ref npos.
+    constexpr size_t find_zero_run(size_t length, size_t align = 1,
+                                   size_t start = 0) const {
+        assert(this->initialized_ && length > 0 && align > 0);
+
+        while (true) {
+            size_t first = this->find_first_zero(start);
+
+            if (first == npos) {
+                return npos;
+            }
+
+            // Round the candidate up to the requested alignment
+            first = ((first + align - 1) / align) * align;
+
+            if (first >= this->size_ || length > this->size_ - first) {
+                return npos;
+            }
+
+            size_t next = this->find_next_set(first);
+
+            if (next == npos || next - first >= length) {
+                return first;
+            }
+
+            // Skip past the set bit that cut the run short
+            start = next + 1;
+        }
+    }
+
+    /// \brief Set a range of bits.
+    ///
+    /// \param start Index of the first bit.
+    /// \param count Number of bits to set.
+    void set_range(size_t start, size_t count) {
+        this->fill_range(start, count, true);
+    }
+
+    /// \brief Clear a range of bits.
+    ///
+    /// \param start Index of the first bit.
+    /// \param count Number of bits to clear.
+    void clear_range(size_t start, size_t count) {
+        this->fill_range(start, count, false);
+    }
+
     /// \brief Get the length of the bitmap.
     ///
-    /// \return The length of the bitmap in terms of elements of type T.
+    /// \return The number of bits tracked by the bitmap.
     constexpr size_t length() const { return this->initialized_ ? size_ : 0; }
 
     /// \brief Get a pointer to the underlying buffer of the bitmap.
@@ -120,7 +195,110 @@ class bitmap {
     /// \brief Get the size of a `T` in bits.
     ///
     /// \return The size of a `T` in bits.
-    constexpr size_t bit_size() const { return sizeof(T) * 8; }
+    static constexpr size_t bit_size() { return sizeof(T) * 8; }
+
+    /// \brief Get a `T` with every bit set.
+    ///
+    /// \return A `T` with every bit set.
+    static constexpr T all_ones() { return static_cast<T>(~static_cast<T>(0)); }
+
+    /// \brief Get the mask selecting a bit within its element.
+    ///
+    /// \param index Index of the bit.
+    /// \return The mask of the bit.
+    static constexpr T bit_mask(size_t index) {
+        return static_cast<T>(static_cast<T>(1) << (index % bit_size()));
+    }
+
+    /// \brief Count the trailing cleared bits of a non-zero element.
+    ///
+    /// \param value The element.
+    /// \return Index of the lowest set bit.
+    static constexpr size_t trailing_zeros(T value) {
+        return __builtin_ctzll(static_cast<unsigned long long>(value));
+    }
+
+    /// \brief Find the first bit with a given value at or after an index.
+    ///
+    /// \param start Index to start searching from.
+    /// \param zero True to search for a cleared bit, false for a set one.
+    /// \return Index of the bit, or \ref npos.
+    constexpr size_t find_next(size_t start, bool zero) const {
+        assert(this->initialized_);
+
+        if (start >= this->size_) {
+            return npos;
+        }
+
+        size_t word = start / bit_size();
+        T flip = zero ? all_ones() : static_cast<T>(0);
+
+        // Ignore the bits below the starting index
+        T value = static_cast<T>((this->buffer_[word] ^ flip) &
+                                 (all_ones() << (start % bit_size())));
+
+        while (value == 0) {
+            if (++word * bit_size() >= this->size_) {
+                return npos;
+            }
+
+            value = static_cast<T>(this->buffer_[word] ^ flip);
+        }
+
+        size_t index = word * bit_size() + trailing_zeros(value);
+        return index < this->size_ ? index : npos;
+    }
+
+    /// \brief Set or clear a range of bits.
+    ///
+    /// The partial elements at both ends are masked, everything in between is
+    /// written as whole elements.
+    ///
+    /// \param start Index of the first bit.
+    /// \param count Number of bits.
+    /// \param value The value to store.
+    void fill_range(size_t start, size_t count, bool value) {
+        assert(this->initialized_);
+
+        if (count == 0) {
+            return;
+        }
+
+        size_t end = start + count;
+        size_t first = start / bit_size();
+        size_t last = (end - 1) / bit_size();
+
+        T head = static_cast<T>(all_ones() << (start % bit_size()));
+        T tail = static_cast<T>(all_ones() >>
+                                (bit_size() - 1 - ((end - 1) % bit_size())));
+
+        if (first == last) {
+            this->fill_word(first, static_cast<T>(head & tail), value);
+            return;
+        }
+
+        this->fill_word(first, head, value);
+
+        if (last - first > 1) {
+            memset(&this->buffer_[first + 1], value ? 0xFF : 0,
+                   (last - first - 1) * sizeof(T));
+        }
+
+        this->fill_word(last, tail, value);
+    }
+
+    /// \brief Set or clear the masked bits of an element.
+    ///
+    /// \param word Index of the element.
+    /// \param mask Bits to modify.
+    /// \param value The value to store.
+    void fill_word(size_t word, T mask, bool value) {
+        if (value) {
+            this->buffer_[word] |= mask;
+        } else {
+            this->buffer_[word] &= static_cast<T>(~mask);
+        }
+    }
 
    private:
     // clang-format off
@@ -128,7 +306,7 @@ class bitmap {
     // clang-format on
 
     T* buffer_ = nullptr;  ///< Pointer to the buffer storing the bitmap data.
-    size_t size_ = 0;  ///< Size of the buffer in terms of elements of type T.
+    size_t size_ = 0;      ///< Number of bits tracked by the bitmap.
 };
 }  // namespace utils
 
@@ -0,0 +1,215 @@
+#ifndef KERNEL_INCLUDE_UTILS_BITMAP_INDEX_HPP_
+#define KERNEL_INCLUDE_UTILS_BITMAP_INDEX_HPP_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <utils/bitmap.hpp>
+#include <utils/common.h>
+
+namespace utils {
+/// \brief Two-level summary index over a `bitmap<uint64_t>`.
+///
+/// The first level holds one bit per 64-bit word of the bitmap, set when that
+/// word contains at least one cleared bit. The second level holds one bit per
+/// word of the first level, set when that word is non-zero. Searching for a
+/// cleared bit therefore touches one word per level instead of walking the
+/// whole bitmap.
+///
+/// The index does not observe the bitmap; every write to the bitmap must be
+/// followed by \ref update for the modified range.
+class bitmap_index {
+   public:
+    /// \brief Value returned by the search operations when nothing is found.
+    static constexpr size_t npos = bitmap<uint64_t>::npos;
+
+    /// \brief Default constructor.
+    constexpr bitmap_index() = default;
+
+    /// \brief Get the size of the index for a bitmap.
+    ///
+    /// \param bits Number of bits tracked by the bitmap.
+    /// \return Size of the index in bytes.
+    static constexpr size_t index_size(size_t bits) {
+        size_t words = words_for(bits);
+        return (words_for(words) + words_for(words_for(words))) *
+               sizeof(uint64_t);
+    }
+
+    /// \brief Initialize the index and build it from the bitmap.
+    ///
+    /// \param bitmap The indexed bitmap.
+    /// \param buffer Buffer of at least \ref index_size bytes.
+    void initialize(const bitmap<uint64_t>* bitmap, uint64_t* buffer) {
+        assert(!this->initialized());
+
+        size_t words = words_for(bitmap->length());
+
+        this->bitmap_ = bitmap;
+        this->words_.initialize(buffer, words);
+        this->summaries_.initialize(buffer + words_for(words),
+                                    words_for(words));
+
+        this->rebuild();
+    }
+
+    /// \brief Check if the index is initialized.
+    ///
+    /// \return True if the index is initialized, false otherwise.
+    constexpr bool initialized() const { return this->bitmap_ != nullptr; }
+
+    /// \brief Rebuild both levels from the bitmap.
+    void rebuild() {
+        if (!this->initialized()) {
+            return;
+        }
+
+        memset(this->words_.data(), 0, index_size(this->bitmap_->length()));
+        this->update(0, this->bitmap_->length());
+    }
+
+    /// \brief Refresh the index after a range of the bitmap changed.
+    ///
+    /// \param start Index of the first modified bit.
+    /// \param count Number of modified bits.
+    void update(size_t start, size_t count) {
+        if (!this->initialized() || count == 0) {
+            return;
+        }
+
+        size_t first = start / 64;
+        size_t last = (start + count - 1) / 64;
+        const uint64_t* data = this->bitmap_->data();
+
+        for (size_t word = first; word <= last; ++word) {
+            this->words_.set(word, data[word] != ~static_cast<uint64_t>(0));
+        }
+
+        const uint64_t* words = this->words_.data();
+
+        for (size_t word = first / 64; word <= last / 64; ++word) {
+            this->summaries_.set(word, words[word] != 0);
+        }
+    }
+
+    /// \brief Find the first cleared bit at or after a given index.
+    ///
+    /// \param start Index to start searching from (default is 0).
+    /// \return Index of the first cleared bit, or \ref npos.
+    size_t find_first_zero(size_t start = 0) const {
+        if (!this->initialized()) {
+            return npos;
+        }
+
+        size_t bits = this->bitmap_->length();
+
+        if (start >= bits) {
+            return npos;
+        }
+
+        const uint64_t* data = this->bitmap_->data();
+        size_t word = start / 64;
+
+        // The starting word is only partially searched
+        uint64_t value =
+            ~data[word] & (~static_cast<uint64_t>(0) << (start % 64));
+
+        if (value == 0) {
+            word = this->find_word(word + 1);
+
+            if (word == npos) {
+                return npos;
+            }
+
+            value = ~data[word];
+        }
+
+        size_t index = word * 64 + __builtin_ctzll(value);
+        return index < bits ? index : npos;
+    }
+
+    /// \brief Find a run of cleared bits.
+    ///
+    /// \param length Number of consecutive cleared bits to find.
+    /// \param align Alignment of the first bit of the run (default is 1).
+    /// \param start Index to start searching from (default is 0).
+    /// \return Index of the first bit of the run, or \ref npos.
+    size_t find_zero_run(size_t length, size_t align = 1,
+                         size_t start = 0) const {
+        if (!this->initialized()) {
+            return npos;
+        }
+
+        size_t bits = this->bitmap_->length();
+
+        while (true) {
+            size_t first = this->find_first_zero(start);
+
+            if (first == npos) {
+                return npos;
+            }
+
+            // Round the candidate up to the requested alignment
+            first = ((first + align - 1) / align) * align;
+
+            if (first >= bits || length > bits - first) {
+                return npos;
+            }
+
+            size_t next = this->bitmap_->find_next_set(first);
+
+            if (next == npos || next - first >= length) {
+                return first;
+            }
+
+            // Skip past the set bit that cut the run short
+            start = next + 1;
+        }
+    }
+
+   private:
+    /// \brief Get the number of 64-bit words needed for a number of bits.
+    ///
+    /// \param bits Number of bits.
+    /// \return Number of words.
+    static constexpr size_t words_for(size_t bits) { return (bits + 63) / 64; }
+
+    /// \brief Find the first bitmap word containing a cleared bit.
+    ///
+    /// \param start Index of the word to start searching from.
+    /// \return Index of the word, or \ref npos.
+    size_t find_word(size_t start) const {
+        if (start >= this->words_.length()) {
+            return npos;
+        }
+
+        const uint64_t* words = this->words_.data();
+        size_t summary = start / 64;
+
+        uint64_t value =
+            words[summary] & (~static_cast<uint64_t>(0) << (start % 64));
+
+        if (value == 0) {
+            summary = this->summaries_.find_next_set(summary + 1);
+
+            if (summary == npos) {
+                return npos;
+            }
+
+            value = words[summary];
+        }
+
+        return summary * 64 + __builtin_ctzll(value);
+    }
+
+   private:
+    // clang-format off
+    const bitmap<uint64_t>* bitmap_ = nullptr;  ///< The indexed bitmap.
+    bitmap<uint64_t> words_;  ///< One bit per bitmap word with a cleared bit.
+    bitmap<uint64_t> summaries_;  ///< One bit per non-zero word of `words_`.
+    // clang-format on
+};
+}  // namespace utils
+
+#endif  // KERNEL_INCLUDE_UTILS_BITMAP_INDEX_HPP_
@@ -0,0 +1,29 @@
+#ifndef KERNEL_INCLUDE_UTILS_CMDLINE_HPP_
+#define KERNEL_INCLUDE_UTILS_CMDLINE_HPP_
+
+#include <stddef.h>
+
+namespace utils {
+/// \brief Find an option on the kernel command line.
+///
+/// Options are separated by spaces and have the form `name` or `name=value`.
+///
+/// \param cmdline The command line, may be nullptr.
+/// \param name The name of the option.
+/// \param length Optionally receives the length of the value.
+/// \return Pointer to the value (empty for options without one), or nullptr
+///         if the option is missing.
+const char* cmdline_find(const char* cmdline, const char* name,
+                         size_t* length = nullptr);
+
+/// \brief Check if an option is present on the kernel command line.
+///
+/// \param cmdline The command line, may be nullptr.
+/// \param name The name of the option.
+/// \return True if the option is present, false otherwise.
+inline bool cmdline_has(const char* cmdline, const char* name) {
+    return cmdline_find(cmdline, name) != nullptr;
+}
+}  // namespace utils
+
+#endif  // KERNEL_INCLUDE_UTILS_CMDLINE_HPP_
@@ -36,13 +36,56 @@ struct ticket_spinlock {
     // clang-format on
 };
 
+/// \struct queued_spinlock
+/// \brief A queue-based spinlock, scaling to many contending CPUs.
+///
+/// Waiters line up in a queue of nodes on their own stacks, and each spins
+/// on its own node until its predecessor hands the lock over, so a handoff
+/// only touches the cache lines of two CPUs (Mellor-Crummey and Scott). The
+/// lock itself serves as the node of the holder, which takes its node out of
+/// the queue once it holds the lock (the K42 variant), so the lock needs no
+/// node passed in and works behind \ref scoped_lock. Like the ticket lock,
+/// waiters are served in order.
+struct queued_spinlock {
+    /// \struct node
+    /// \brief Entry of the queue of waiters.
+    struct node {
+        std::atomic<node*> tail = nullptr;  ///< Last waiter if this is the
+                                            ///< lock, whether to keep waiting
+                                            ///< otherwise.
+        std::atomic<node*> next = nullptr;  ///< Next waiter in the queue.
+    };
+
+    /// \brief Default constructor, for an unlocked lock.
+    constexpr queued_spinlock() = default;
+
+    /// \brief Copy constructor (deleted).
+    queued_spinlock(const queued_spinlock&) = delete;
+
+    /// \brief Copy assignment operator (deleted).
+    queued_spinlock& operator=(const queued_spinlock&) = delete;
+
+    /// \brief Acquires the lock.
+    void lock();
+
+    /// \brief Checks if the lock is currently held.
+    bool is_locked();
+
+    /// \brief Releases the lock.
+    void unlock();
+
+   private:
+    node queue_;  ///< Node of the holder, heading the queue of waiters.
+};
+
 /// \struct irq_lock
 /// \brief A struct that provides a lock for interrupt status.
 struct irq_lock {
    public:
     /// \brief Default constructor.
     ///
-    /// Initializes the interrupt status to false and the internal ticket_spinlock.
+    /// Initializes the interrupt status to false and the internal
+    /// queued_spinlock.
     constexpr irq_lock() : irqs_(false), lock_() {}
 
     /// \brief Copy constructor (deleted).
@@ -64,7 +107,7 @@ struct irq_lock {
 
    private:
     bool irqs_;             ///< Current interrupt status.
-    ticket_spinlock lock_;  ///< Internal ticket_spinlock for managing the lock.
+    queued_spinlock lock_;  ///< Internal queued_spinlock for managing the lock.
 };
 
 /// \tparam MutexType The type of the mutex to be used with the scoped lock.
@@ -0,0 +1,152 @@
+#ifndef KERNEL_INCLUDE_UTILS_PER_CPU_HPP_
+#define KERNEL_INCLUDE_UTILS_PER_CPU_HPP_
+
+#include <arch/arch.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <system/compiler.h>
+
+#include <type_traits>
+
+extern "C" {
+/// Start of the per-CPU template, from the linker script.
+extern char __percpu_start[];
+
+/// End of the per-CPU template, a multiple of 64 bytes after its start.
+extern char __percpu_end[];
+
+/// Copies of the per-CPU template, one per CPU, from the linker script.
+extern char __percpu_areas[];
+
+/// End of the copies of the per-CPU template, from the linker script.
+extern char __percpu_areas_end[];
+}
+
+namespace utils {
+/// \brief Distance of every CPU's per-CPU area from the template.
+extern uintptr_t per_cpu_offsets[MAX_CPUS];
+
+/// \brief Distance of the current CPU's per-CPU area from the template, a
+///        per-CPU variable.
+extern uintptr_t this_cpu_offset;
+
+/// \brief Get a CPU's copy of a per-CPU variable.
+/// \param variable The variable in the template.
+/// \param cpu Index of the CPU.
+/// \return Pointer to the CPU's copy.
+template <typename T>
+inline T* per_cpu_ptr(T* variable, size_t cpu) {
+    return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(variable) +
+                                per_cpu_offsets[cpu]);
+}
+
+/// \brief Get the current CPU's copy of a per-CPU variable.
+/// \param variable The variable in the template.
+/// \return Pointer to the current CPU's copy, only stable while the caller
+///         cannot be migrated.
+template <typename T>
+inline T* this_cpu_ptr(T* variable) {
+    uintptr_t offset;
+
+    asm volatile("mov %%gs:%1, %0" : "=r"(offset) : "m"(this_cpu_offset));
+
+    return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(variable) +
+                                offset);
+}
+
+/// \class per_cpu
+/// \brief A variable of which every CPU has its own copy.
+///
+/// Variables must be defined with \ref __PER_CPU, which places them in the
+/// per-CPU template. Every CPU gets a copy of the template, and its GS base
+/// is the distance of the copy from the template, so a variable's address
+/// relative to %gs is its current CPU's copy. Copies of different CPUs never
+/// share a cache line.
+///
+/// \tparam T Type of the variable.
+template <typename T>
+class per_cpu {
+   public:
+    /// \brief Default constructor, value-initializing the variable.
+    constexpr per_cpu() : value_() {}
+
+    /// \brief Constructor.
+    /// \param value Value every CPU's copy starts with.
+    constexpr explicit per_cpu(const T& value) : value_(value) {}
+
+    /// \brief Copy constructor (deleted).
+    per_cpu(const per_cpu&) = delete;
+
+    /// \brief Copy assignment operator (deleted).
+    per_cpu& operator=(const per_cpu&) = delete;
+
+    /// \brief Get the current CPU's copy.
+    /// \return Pointer to the copy, only stable while the caller cannot be
+    ///         migrated.
+    T* get() { return this_cpu_ptr(&this->value_); }
+
+    /// \brief Get the current CPU's copy.
+    T& operator*() { return *this->get(); }
+
+    /// \brief Access a member of the current CPU's copy.
+    T* operator->() { return this->get(); }
+
+    /// \brief Get a CPU's copy.
+    /// \param cpu Index of the CPU.
+    /// \return The copy, which the CPU may change concurrently.
+    T& on(size_t cpu) { return *per_cpu_ptr(&this->value_, cpu); }
+
+    /// \brief Get a CPU's copy.
+    /// \param cpu Index of the CPU.
+    /// \return The copy, which the CPU may change concurrently.
+    const T& on(size_t cpu) const {
+        return *per_cpu_ptr(&this->value_, cpu);
+    }
+
+    /// \brief Read the current CPU's copy in one instruction.
+    /// \return The value.
+    T load() const
+        requires(std::is_scalar_v<T> && sizeof(T) <= 8)
+    {
+        T value;
+
+        asm volatile("mov %%gs:%1, %0" : "=r"(value) : "m"(this->value_));
+
+        return value;
+    }
+
+    /// \brief Write the current CPU's copy in one instruction.
+    /// \param value The new value.
+    void store(T value)
+        requires(std::is_scalar_v<T> && sizeof(T) <= 8)
+    {
+        asm volatile("mov %1, %%gs:%0" : "=m"(this->value_) : "r"(value));
+    }
+
+    /// \brief Add to the current CPU's copy in one instruction.
+    ///
+    /// The instruction cannot be interrupted halfway, so the update needs
+    /// neither a lock prefix nor interrupts disabled.
+    ///
+    /// \param delta The value to add.
+    void add(T delta)
+        requires(std::is_integral_v<T> && sizeof(T) <= 8)
+    {
+        asm volatile("add %1, %%gs:%0" : "+m"(this->value_) : "r"(delta));
+    }
+
+   private:
+    T value_;  ///< The variable in the template.
+};
+
+/// \brief Set up the per-CPU area of the current CPU.
+///
+/// Copies the template and points the GS base at the copy. Must run after
+/// the GDT is loaded, which resets the GS base, and before the CPU accesses
+/// any per-CPU variable.
+///
+/// \param cpu Index of the current CPU.
+void per_cpu_initialize(size_t cpu);
+}  // namespace utils
+
+#endif  // KERNEL_INCLUDE_UTILS_PER_CPU_HPP_
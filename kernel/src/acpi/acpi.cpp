@@ -0,0 +1,110 @@
+#include <string.h>
+#include <system/log.h>
+
+#include <acpi/acpi.hpp>
+
+#include <utils/misc.hpp>
+
+namespace acpi {
+namespace {
+const rsdp* root_pointer = nullptr;  ///< The validated RSDP, if any.
+
+/// \brief Check if the bytes of a structure sum up to zero.
+///
+/// \param data Pointer to the structure.
+/// \param length Length of the structure in bytes.
+/// \return True if the checksum is valid, false otherwise.
+bool checksum_valid(const void* data, size_t length) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+        sum += bytes[i];
+    }
+
+    return sum == 0;
+}
+
+/// \brief Map a table through the higher half direct map and validate it.
+///
+/// \param address Physical address of the table.
+/// \return Pointer to the table, or nullptr if its checksum is invalid.
+const sdt_header* map_table(uint64_t address) {
+    const sdt_header* table =
+        reinterpret_cast<const sdt_header*>(utils::to_higher_half(address));
+
+    if (!checksum_valid(table, table->length)) {
+        return nullptr;
+    }
+
+    return table;
+}
+}  // namespace
+
+/// \brief Initialize ACPI table lookup.
+///
+/// This function validates the RSDP handed over by the bootloader. Tables are
+/// only looked up on demand, once the higher half direct map is known.
+///
+/// \param bootinfo Pointer to the boot information.
+void initialize(bootinfo_t* bootinfo) {
+    const rsdp* pointer = reinterpret_cast<const rsdp*>(bootinfo->rsdp_address);
+
+    if (pointer == nullptr) {
+        log_message(LOG_LEVEL_WARNING, "No ACPI RSDP provided.");
+        return;
+    }
+
+    // Only the ACPI 1.0 part of the structure is covered by the checksum
+    if (memcmp(pointer->signature, "RSD PTR ", 8) != 0 ||
+        !checksum_valid(pointer, offsetof(rsdp, length))) {
+        log_message(LOG_LEVEL_WARNING, "Invalid ACPI RSDP @ %p.", pointer);
+        return;
+    }
+
+    root_pointer = pointer;
+
+    log_message(LOG_LEVEL_DEBUG, "ACPI RSDP @ %p (revision %u).", pointer,
+                pointer->revision);
+}
+
+/// \brief Find a System Description Table by its signature.
+///
+/// The XSDT is used when available, the RSDT otherwise.
+///
+/// \param signature The four character signature of the table.
+/// \return Pointer to the table, or nullptr if it is missing or invalid.
+const sdt_header* find_table(const char* signature) {
+    if (root_pointer == nullptr) {
+        return nullptr;
+    }
+
+    bool extended = root_pointer->revision >= 2 && root_pointer->xsdt_address;
+    const sdt_header* root =
+        map_table(extended ? root_pointer->xsdt_address
+                           : root_pointer->rsdt_address);
+
+    if (root == nullptr) {
+        return nullptr;
+    }
+
+    size_t entry_size = extended ? sizeof(uint64_t) : sizeof(uint32_t);
+    size_t entries = (root->length - sizeof(sdt_header)) / entry_size;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(root + 1);
+
+    for (size_t i = 0; i < entries; ++i) {
+        uint64_t address = 0;
+
+        // The entries are not necessarily aligned
+        memcpy(&address, data + i * entry_size, entry_size);
+
+        const sdt_header* table = map_table(address);
+
+        if (table != nullptr && memcmp(table->signature, signature, 4) == 0) {
+            return table;
+        }
+    }
+
+    return nullptr;
+}
+}  // namespace acpi
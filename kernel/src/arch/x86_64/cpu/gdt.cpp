@@ -1,3 +1,4 @@
+#include <arch/arch.h>
 #include <system/log.h>
 #include <x86.h>
 #include <cpu/gdt.hpp>
@@ -7,8 +8,19 @@ namespace arch {
 ///
 /// The `per_cpu_tss` array is used to store per-CPU Task State Segments for x86_64 architecture.
 /// Each element of the array corresponds to a specific CPU and holds the TSS for that CPU.
-/// The size of the array is currently set to 1, implying a single CPU. Adjust the size as needed.
-x86_tss per_cpu_tss[1] = {};
+x86_tss per_cpu_tss[MAX_CPUS] = {};
+
+/// \brief Array of per-CPU Global Descriptor Tables (GDT).
+///
+/// Every CPU needs its own GDT, since loading a TSS marks its descriptor busy.
+x86_gdt per_cpu_gdt[MAX_CPUS] = {};
+
+/// \brief Stacks the CPUs switch to on a double fault.
+///
+/// A kernel stack overflowing into its guard page leaves no room for the
+/// page fault's frame, which raises a double fault. Without a stack of its
+/// own, that one would fault as well and reset the machine.
+alignas(16) uint8_t double_fault_stacks[MAX_CPUS][double_fault_stack_size];
 
 /// \brief Create a Global Descriptor Table (GDT) entry.
 ///
@@ -136,9 +148,11 @@ constexpr x86_tss initialize_tss_per_cpu() {
 void x86_gdt_initialize(size_t cpu_id) {
     // Initialize the per-CPU TSS
     per_cpu_tss[cpu_id] = initialize_tss_per_cpu();
+    per_cpu_tss[cpu_id].ist[DOUBLE_FAULT_IST - 1] = reinterpret_cast<uintptr_t>(
+        double_fault_stacks[cpu_id] + double_fault_stack_size);
 
     // Create GDT entries
-    static x86_gdt gdt;
+    x86_gdt& gdt = per_cpu_gdt[cpu_id];
     gdt.null = make_gdt_entry(0, 0, 0, 0);
     gdt.code_selector = make_gdt_entry(0x0, 0xFFFFFFFF, 0b10, 0x9A);
     gdt.data_selector = make_gdt_entry(0x0, 0xFFFFFFFF, 0x0, 0x92);
@@ -146,8 +160,8 @@ void x86_gdt_initialize(size_t cpu_id) {
     gdt.user_data_selector = make_gdt_entry(0x0, 0xFFFFFFFF, 0x0, 0xF2);
     gdt.tss_selector = make_tss_entry(&per_cpu_tss[cpu_id]);
 
-    // Create GDT register descriptor
-    static x86_gdt_register gdtr = {
+    // Create GDT register descriptor, the CPU copies it when loading the GDT
+    x86_gdt_register gdtr = {
         sizeof(x86_gdt) - 1,
         reinterpret_cast<uintptr_t>(&gdt),
     };
@@ -156,6 +170,16 @@ void x86_gdt_initialize(size_t cpu_id) {
     load_gdt(&gdtr);
     x86_ltr(TSS_SELECTOR);
 
-    log_message(LOG_LEVEL_INFO, "Successfully loaded GDT & TSS.");
+    if (cpu_id == 0) {
+        log_message(LOG_LEVEL_INFO, "Successfully loaded GDT & TSS.");
+    }
+}
+
+/// \brief Set the stack the CPU switches to when entering the kernel.
+///
+/// \param cpu_id The CPU identifier whose TSS is updated.
+/// \param stack Top of the kernel stack.
+void x86_set_kernel_stack(size_t cpu_id, uintptr_t stack) {
+    per_cpu_tss[cpu_id].rsp[0] = stack;
 }
 }  // namespace arch
\ No newline at end of file
@@ -15,6 +15,15 @@ extern void load_idt(void* descriptor);
 }
 
 namespace arch {
+/// \brief The Interrupt Descriptor Table, shared by every CPU.
+x86_idt idt;
+
+/// \brief The IDT register descriptor pointing to \ref idt.
+x86_idt_register idtr = {
+    sizeof(x86_idt) - 1,
+    reinterpret_cast<uintptr_t>(&idt),
+};
+
 ///
 /// \brief Create an x86 Interrupt Descriptor Table (IDT) entry.
 ///
@@ -63,30 +72,31 @@ constexpr x86_idt_entry make_idt_entry(uint64_t offset, uint16_t selector,
 /// This function initializes the x86 IDT by setting up the required entries
 /// for interrupt handling and mapping PIC handlers.
 void x86_idt_initialize() {
-    // Create a static instance of the x86 IDT structure
-    static x86_idt idt;
-
     // Populate the IDT entries using the make_idt_entry function
     for (size_t i = 0; i < IDT_MAX_ENTRIES; ++i) {
         idt.entries[i] =
             make_idt_entry(int_table[i], CODE_SELECTOR, 0, IDT_TYPE_GATE);
     }
 
-    // Create a static instance of the x86 IDT register structure (IDTR)
-    static x86_idt_register idtr = {
-        sizeof(x86_idt) - 1,
-        reinterpret_cast<uintptr_t>(&idt),
-    };
+    // Double faults may come from an overflowing stack, so they get their own
+    idt.entries[X86_INT_DOUBLE_FAULT].ist_index = DOUBLE_FAULT_IST;
 
     // Load the IDT using the load_idt function
-    load_idt(&idtr);
+    x86_idt_load();
 
     // Log a message indicating successful IDT loading
     log_message(LOG_LEVEL_INFO, "Successfully loaded IDT.");
 
-    // map PIC controllers on PIC1_BASE and PIC2_BASE
-    // triggers IRQ
-    // TODO: Uncomment after implementing IRQ handling
-    // pic_map(PIC1_BASE, PIC2_BASE);
+    // Map the PIC controllers on PIC1_BASE and PIC2_BASE, away from the
+    // exceptions. Every line stays masked until a driver unmasks it.
+    pic_map(PIC1_BASE, PIC2_BASE);
+    pic_disable();
+}
+
+/// \brief Load the x86 Interrupt Descriptor Table (IDT) on the current CPU.
+///
+/// The table is filled by \ref x86_idt_initialize, which has to run first.
+void x86_idt_load() {
+    load_idt(&idtr);
 }
 }  // namespace arch
\ No newline at end of file
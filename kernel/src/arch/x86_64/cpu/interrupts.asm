@@ -95,22 +95,22 @@ interrupt_common:
 
     ; Check to see if we came from user space by testing the CPL in the
     ; %cs selector that was saved on the stack automatically. Check for != 0.
-    ; test byte [rsp + X86_IFRAME_OFFSET_CS], 3
-    ; jz .call_handler
+    test byte [rsp + X86_IFRAME_OFFSET_CS], 3
+    jz .call_handler
     ; Perform the last zero from the previous block now that we know this is a
     ; user fault and we don't need the stack frame.
-    ; xor ebp, ebp
-    ; Swap %gs.base to kernel space
-    ; swapgs
-; .call_handler:
+    xor ebp, ebp
+    ; Swap %gs.base to kernel space, it points to the per-CPU data
+    swapgs
+.call_handler:
     call x86_interrupt_handler
 
     ; Check if we're returning to user space as per before
-    ; test byte [rsp + X86_IFRAME_OFFSET_CS], 3
-    ; jz .call_handler2
+    test byte [rsp + X86_IFRAME_OFFSET_CS], 3
+    jz .call_handler2
     ; Swap %gs.base back to user space
     swapgs
-; .call_handler2:
+.call_handler2:
 
 ; .Lcommon_return:
     pop r15
@@ -5,6 +5,8 @@
 #include <cpu/gdt.hpp>
 #include <cpu/idt.hpp>
 #include <cpu/interrupts.hpp>
+#include <cpu/pic.hpp>
+#include <memory/vmm.hpp>
 
 namespace {
 /// \brief Print information from an Interrupt Frame.
@@ -70,12 +72,18 @@ static void dump_fault_frame(iframe_t* frame) {
 
 /// \brief Handle an exception based on its type.
 ///
-/// This function currently dumps information from the Fault Interrupt Frame
-/// and logs an emergency message indicating the triggered exception.
+/// Page faults the virtual memory manager can resolve return to the faulting
+/// instruction. For any other exception, this function dumps information
+/// from the Fault Interrupt Frame and logs an emergency message indicating
+/// the triggered exception.
 ///
 /// \param frame The Fault Interrupt Frame associated with the exception.
 static void handle_exception_type(iframe_t* frame) {
     // TODO: Separate handlers to handle various exceptions
+    if (frame->vector == X86_INT_PAGE_FAULT &&
+        memory::handle_page_fault(x86_get_cr2(), frame->err_code)) {
+        return;
+    }
 
     // Dump information from the Fault Interrupt Frame
     dump_fault_frame(frame);
@@ -104,6 +112,10 @@ extern "C" void x86_interrupt_handler(uint64_t rsp) {
         regs->vector <= X86_INT_MAX_INTEL_DEFINED) {
         // Exception handler
         handle_exception_type(regs);
+    } else if (regs->vector >= PIC1_BASE && regs->vector < PIC2_BASE + 8) {
+        // Drivers only unmask IRQs to wake up halted processors, which then
+        // poll their devices, so acknowledging them is all there is to do
+        arch::pic_eoi(regs->vector - PIC1_BASE);
     } else if (regs->vector >= X86_INT_PLATFORM_BASE &&
                regs->vector <= X86_INT_MAX) {
         // IRQ (Interrupt Request) handler
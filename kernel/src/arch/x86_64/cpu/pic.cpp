@@ -27,6 +27,10 @@
 /// This constant represents the value for ICW4.
 #define ICW4 0x01
 
+/// \def PIC_EOI
+/// \brief End-of-interrupt command of the Programmable Interrupt Controllers.
+#define PIC_EOI 0x20
+
 namespace arch {
 /// \brief Initialize the Programmable Interrupt Controllers (PIC) and remap IRQs.
 ///
@@ -73,4 +77,33 @@ void pic_disable() {
     outp(PIC2 + 1, 0xff);
     outp(PIC1 + 1, 0xff);
 }
-}  // namespace arch
\ No newline at end of file
+
+/// \brief Mask or unmask one IRQ line.
+///
+/// Lines of the second controller also need the cascade line of the first
+/// one unmasked, which is left to the caller.
+///
+/// \param irq The IRQ line, 0 to 15.
+/// \param masked Whether the line is masked.
+void pic_set_mask(uint8_t irq, bool masked) {
+    uint16_t port = irq < 8 ? PIC1 + 1 : PIC2 + 1;
+    uint8_t bit = 1 << (irq & 7);
+    uint8_t mask = inp(port);
+
+    outp(port, masked ? (mask | bit) : (mask & ~bit));
+}
+
+/// \brief Acknowledge an IRQ, letting the controllers deliver the next one.
+///
+/// IRQs of the second controller are acknowledged on both controllers, as
+/// they arrive at the first one through the cascade line.
+///
+/// \param irq The IRQ line, 0 to 15.
+void pic_eoi(uint8_t irq) {
+    if (irq >= 8) {
+        outp(PIC2, PIC_EOI);
+    }
+
+    outp(PIC1, PIC_EOI);
+}
+}  // namespace arch
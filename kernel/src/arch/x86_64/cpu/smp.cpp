@@ -0,0 +1,348 @@
+#include <arch/arch.h>
+#include <system/log.h>
+
+#include <atomic>
+
+#include <cpu/cpuid.hpp>
+#include <cpu/gdt.hpp>
+#include <cpu/idt.hpp>
+#include <cpu/smp.hpp>
+#include <cpu/tsc.hpp>
+#include <memory/vmalloc.hpp>
+#include <memory/vmm.hpp>
+#include <utils/per_cpu.hpp>
+
+namespace arch {
+// clang-format off
+
+namespace {
+/// Work handed to an application processor.
+struct __ALIGNED(64) cpu_mailbox {
+    std::atomic<smp_function> function = nullptr;  ///< Function to run, nullptr once done.
+    void* argument = nullptr;  ///< Argument passed to `function`.
+    std::atomic<uint64_t> tlb_generation = 0;  ///< Last TLB flush the processor did, see `tlb_generation`.
+};
+
+cpu_mailbox mailboxes[MAX_CPUS];  ///< Work of every processor.
+uint32_t apic_ids[MAX_CPUS];  ///< Local APIC ID of every processor.
+uintptr_t kernel_stacks[MAX_CPUS];  ///< Top of every processor's kernel stack, 0 if it has none.
+bool entered_kernel[MAX_CPUS];  ///< Whether a processor moved onto the kernel's page tables.
+size_t cpu_count = 1;  ///< Number of processors started, the BSP included.
+
+std::atomic<size_t> online_cpus = 1;  ///< Processors which reached the idle loop.
+std::atomic<bool> stacks_ready = false;  ///< Whether `kernel_stacks` is filled in.
+std::atomic<size_t> moved_cpus = 0;  ///< Application processors done with the bootloader memory.
+std::atomic<size_t> stranded_cpus = 0;  ///< Application processors left on the bootloader's stack.
+std::atomic<uint64_t> tlb_generation = 0;  ///< Number of TLB flushes requested of every processor.
+}  // namespace
+
+// clang-format on
+
+__NO_RETURN void ap_idle();
+
+/// \brief Flush the TLB of the current processor if a flush was requested
+///        since its last one.
+///
+/// \param mailbox The processor's mailbox.
+void ap_flush_tlb(cpu_mailbox& mailbox) {
+    uint64_t generation = tlb_generation.load(std::memory_order_acquire);
+
+    if (mailbox.tlb_generation.load(std::memory_order_relaxed) != generation) {
+        memory::tlb_flush_all();
+        mailbox.tlb_generation.store(generation, std::memory_order_release);
+    }
+}
+
+/// \brief Continue the idle loop on the processor's kernel stack.
+///
+/// Nothing of the bootloader's stack is used past this point, which is what
+/// \ref smp_wait_for_aps waits for.
+__NO_RETURN void ap_resume() {
+    moved_cpus.fetch_add(1, std::memory_order_release);
+
+    ap_idle();
+}
+
+/// \brief Move the current processor onto the kernel's page tables and its
+///        kernel stack.
+///
+/// Without a stack, or if the bootstrap processor stayed on the bootloader's
+/// page tables, the processor stays on the bootloader's stack and returns.
+///
+/// \param cpu Index of the current processor.
+void ap_enter_kernel(size_t cpu) {
+    uintptr_t stack = kernel_stacks[cpu];
+
+    entered_kernel[cpu] = true;
+
+    // The stacks are only mapped in the kernel's page tables
+    if (!memory::virt_initialize_cpu() || stack == 0) {
+        stranded_cpus.fetch_add(1, std::memory_order_relaxed);
+        moved_cpus.fetch_add(1, std::memory_order_release);
+        return;
+    }
+
+    x86_set_kernel_stack(cpu, stack);
+
+    asm volatile(
+        "mov %0, %%rsp\n"
+        "xor %%ebp, %%ebp\n"
+        "call *%1"
+        :
+        : "r"(stack), "r"(ap_resume)
+        : "memory");
+
+    __builtin_unreachable();
+}
+
+/// \brief Idle loop of the application processors.
+///
+/// The processor polls its mailbox with interrupts disabled, as there are no
+/// inter-processor interrupts to wake it up yet, and moves over to the
+/// kernel's page tables and its own stack once they are available. Requested
+/// TLB flushes are done before any work is taken.
+__NO_RETURN void ap_idle() {
+    size_t cpu = arch_current_cpu();
+    cpu_mailbox& mailbox = mailboxes[cpu];
+
+    while (true) {
+        ap_flush_tlb(mailbox);
+
+        smp_function function =
+            mailbox.function.load(std::memory_order_acquire);
+
+        if (function != nullptr) {
+            function(mailbox.argument);
+            mailbox.function.store(nullptr, std::memory_order_release);
+        } else if (!entered_kernel[cpu] &&
+                   stacks_ready.load(std::memory_order_acquire)) {
+            ap_enter_kernel(cpu);
+        } else {
+            pause();
+        }
+    }
+}
+
+/// \brief Entry point of the application processors.
+///
+/// \param info The processor's entry of the bootloader's SMP response, whose
+///             `extra_argument` holds the processor's index.
+__NO_RETURN void ap_entry(limine_smp_info* info) {
+    size_t cpu = info->extra_argument;
+
+    x86_gdt_initialize(cpu);
+
+    // Everything else may ask for the processor's index
+    utils::per_cpu_initialize(cpu);
+    *utils::per_cpu_ptr(&x86_cpu_index, cpu) = cpu;
+
+    x86_idt_load();
+
+    online_cpus.fetch_add(1, std::memory_order_release);
+
+    ap_idle();
+}
+
+/// \brief Start the application processors.
+///
+/// Processors are numbered in the order of the bootloader's response, the
+/// bootstrap processor being 0, and the number is kept in the per-CPU data
+/// where \ref arch_current_cpu reads it. Processors beyond \ref MAX_CPUS are
+/// left in the bootloader.
+///
+/// \param bootinfo Pointer to the boot information.
+void smp_initialize(bootinfo_t* bootinfo) {
+    uint64_t start_ticks = x86_rdtsc();
+
+    apic_ids[0] = bootinfo->cpus != nullptr
+                      ? bootinfo->bsp_lapic_id
+                      : cpu_id::cpuid().read_processor_id().local_apic_id();
+
+    for (size_t i = 0; i < bootinfo->cpu_count; ++i) {
+        limine_smp_info* info = bootinfo->cpus[i];
+
+        if (info->lapic_id == bootinfo->bsp_lapic_id ||
+            cpu_count == MAX_CPUS) {
+            continue;
+        }
+
+        apic_ids[cpu_count] = info->lapic_id;
+        info->extra_argument = cpu_count++;
+
+        // The processor spins in the bootloader until this address is set
+        std::atomic_ref<limine_goto_address> entry(info->goto_address);
+        entry.store(ap_entry, std::memory_order_release);
+    }
+
+    while (online_cpus.load(std::memory_order_acquire) < cpu_count) {
+        pause();
+    }
+
+    log_message(LOG_LEVEL_INFO, "Started %lu of %lu processor(s) in %lu us.",
+                cpu_count, bootinfo->cpu_count == 0 ? 1 : bootinfo->cpu_count,
+                tsc_to_ns(x86_rdtsc() - start_ticks) / 1000);
+}
+
+/// \brief Move the application processors onto the kernel's page tables and
+///        stacks of their own.
+///
+/// Every stack comes from \ref memory::vmalloc with guard pages, so an
+/// overflow faults instead of corrupting memory. The page fault cannot be
+/// pushed onto the full stack and turns into a double fault, which is
+/// reported from a stack of its own.
+void smp_enter_kernel() {
+    size_t missing_stacks = 0;
+
+    for (size_t i = 1; i < cpu_count; ++i) {
+        void* stack = memory::vmalloc(ap_stack_size, memory::VmallocGuard);
+
+        if (stack == nullptr) {
+            missing_stacks++;
+            continue;
+        }
+
+        kernel_stacks[i] = reinterpret_cast<uintptr_t>(stack) + ap_stack_size;
+    }
+
+    if (missing_stacks != 0) {
+        log_message(LOG_LEVEL_WARNING,
+                    "No memory for the stacks of %lu processor(s).",
+                    missing_stacks);
+    }
+
+    stacks_ready.store(true, std::memory_order_release);
+}
+
+/// \brief Move the bootstrap processor onto a kernel stack of its own.
+///
+/// The stack comes from \ref memory::vmalloc with guard pages, like the
+/// stacks of the application processors, and is only mapped in the kernel's
+/// page tables.
+///
+/// \param function Function continuing on the new stack, which must not
+///                 return.
+/// \param argument Argument passed to the function.
+/// \return False, without calling the function, if the kernel stayed on the
+///         bootloader's page tables or there is no memory for the stack.
+bool smp_move_bsp_stack(smp_function function, void* argument) {
+    if ((x86_get_cr3() & ~0xfffull) != memory::kernel_space().root()) {
+        return false;
+    }
+
+    void* stack = memory::vmalloc(bsp_stack_size, memory::VmallocGuard);
+
+    if (stack == nullptr) {
+        log_message(LOG_LEVEL_WARNING,
+                    "No memory for the stack of the bootstrap processor.");
+        return false;
+    }
+
+    uintptr_t top = reinterpret_cast<uintptr_t>(stack) + bsp_stack_size;
+
+    x86_set_kernel_stack(0, top);
+
+    asm volatile(
+        "mov %0, %%rsp\n"
+        "xor %%ebp, %%ebp\n"
+        "call *%1"
+        :
+        : "r"(top), "r"(function), "D"(argument)
+        : "memory");
+
+    __builtin_unreachable();
+}
+
+/// \brief Wait for the application processors to leave the bootloader
+///        memory.
+///
+/// \return True if every processor runs on its own stack, false if some had
+///         none or \ref smp_enter_kernel was never called.
+bool smp_wait_for_aps() {
+    if (cpu_count > 1 && !stacks_ready.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    while (moved_cpus.load(std::memory_order_acquire) < cpu_count - 1) {
+        pause();
+    }
+
+    return stranded_cpus.load(std::memory_order_relaxed) == 0;
+}
+
+/// \brief Get the number of running processors.
+///
+/// \return The number of processors, the bootstrap processor included.
+size_t smp_cpu_count() {
+    return cpu_count;
+}
+
+/// \brief Get the local APIC ID of a processor.
+///
+/// \param cpu Index of the processor.
+/// \return The local APIC ID.
+uint32_t smp_apic_id(size_t cpu) {
+    return apic_ids[cpu];
+}
+
+/// \brief Run a function on an application processor.
+///
+/// Waits until the processor finished the previous function handed to it,
+/// but not for the new one. Only one processor may hand out work to a given
+/// processor at a time.
+///
+/// \param cpu Index of the processor, not the current one.
+/// \param function The function.
+/// \param argument Argument passed to the function.
+/// \return False if there is no such processor.
+bool smp_call(size_t cpu, smp_function function, void* argument) {
+    if (cpu == 0 || cpu >= cpu_count || cpu == arch_current_cpu()) {
+        return false;
+    }
+
+    smp_wait(cpu);
+
+    mailboxes[cpu].argument = argument;
+    mailboxes[cpu].function.store(function, std::memory_order_release);
+
+    return true;
+}
+
+/// \brief Wait until an application processor finished its function.
+///
+/// \param cpu Index of the processor.
+void smp_wait(size_t cpu) {
+    while (mailboxes[cpu].function.load(std::memory_order_acquire) !=
+           nullptr) {
+        pause();
+    }
+}
+
+/// \brief Flush the TLB of every processor.
+///
+/// Without inter-processor interrupts, the application processors only
+/// flush in their idle loop, so this waits until every one of them finished
+/// its current function. Only the bootstrap processor may wait like that,
+/// as an application processor waiting on another could wait forever.
+///
+/// \return True once every processor flushed its TLB, false if called on
+///         an application processor, which only flushed its own.
+bool smp_flush_tlbs() {
+    memory::tlb_flush_all();
+
+    if (arch_current_cpu() != 0) {
+        return false;
+    }
+
+    uint64_t generation =
+        tlb_generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+    for (size_t cpu = 1; cpu < cpu_count; ++cpu) {
+        while (mailboxes[cpu].tlb_generation.load(std::memory_order_acquire) <
+               generation) {
+            pause();
+        }
+    }
+
+    return true;
+}
+}  // namespace arch
@@ -0,0 +1,86 @@
+#include <system/log.h>
+#include <x86.h>
+#include <cpu/tsc.hpp>
+
+/// \def PIT_CHANNEL2
+/// \brief Data port of channel 2 of the Programmable Interval Timer (PIT).
+#define PIT_CHANNEL2 0x42
+
+/// \def PIT_COMMAND
+/// \brief Mode/command port of the Programmable Interval Timer (PIT).
+#define PIT_COMMAND 0x43
+
+/// \def PIT_GATE
+/// \brief Port controlling the gate of PIT channel 2 and the PC speaker.
+#define PIT_GATE 0x61
+
+/// \def PIT_FREQUENCY
+/// \brief Input frequency of the Programmable Interval Timer (PIT) in Hz.
+#define PIT_FREQUENCY 1193182
+
+/// \def TSC_CALIBRATION_MS
+/// \brief Duration of the TSC calibration in milliseconds.
+#define TSC_CALIBRATION_MS 10
+
+namespace arch {
+namespace {
+uint64_t tsc_hz = 0;  ///< Measured frequency of the TSC in Hz.
+}  // namespace
+
+/// \brief Measure the frequency of the Time Stamp Counter.
+///
+/// Channel 2 of the PIT is programmed to count down for
+/// \ref TSC_CALIBRATION_MS milliseconds in mode 0, whose output goes high
+/// once the count reaches zero. The TSC ticks elapsed in the meantime give
+/// its frequency.
+void tsc_calibrate() {
+    uint16_t count = PIT_FREQUENCY * TSC_CALIBRATION_MS / 1000;
+
+    // Open the gate of channel 2, but keep the speaker off
+    uint8_t gate = (inp(PIT_GATE) & ~0x02) | 0x01;
+    outp(PIT_GATE, gate);
+
+    // Channel 2, low byte then high byte, mode 0, binary
+    outp(PIT_COMMAND, 0xB0);
+    outp(PIT_CHANNEL2, count & 0xFF);
+    outp(PIT_CHANNEL2, count >> 8);
+
+    uint64_t start = x86_rdtsc();
+    uint64_t spins = 0;
+
+    while ((inp(PIT_GATE) & 0x20) == 0) {
+        // Give up if there is no PIT to wait for
+        if (++spins == 100000000) {
+            log_message(LOG_LEVEL_WARNING, "TSC calibration timed out.");
+            return;
+        }
+
+        pause();
+    }
+
+    tsc_hz = (x86_rdtsc() - start) * (1000 / TSC_CALIBRATION_MS);
+
+    log_message(LOG_LEVEL_DEBUG, "TSC frequency: %lu MHz", tsc_hz / 1000000);
+}
+
+/// \brief Get the frequency of the Time Stamp Counter.
+///
+/// \return The frequency in Hz, or 0 if the TSC is not calibrated.
+uint64_t tsc_frequency() {
+    return tsc_hz;
+}
+
+/// \brief Convert a number of TSC ticks to nanoseconds.
+///
+/// \param ticks The number of ticks.
+/// \return The number of nanoseconds, or 0 if the TSC is not calibrated.
+uint64_t tsc_to_ns(uint64_t ticks) {
+    if (tsc_hz == 0) {
+        return 0;
+    }
+
+    // Split the conversion to avoid overflowing for long intervals
+    return (ticks / tsc_hz) * 1000000000 +
+           ((ticks % tsc_hz) * 1000000000) / tsc_hz;
+}
+}  // namespace arch
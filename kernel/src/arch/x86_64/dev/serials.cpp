@@ -88,6 +88,24 @@ uint8_t serial_device::getc() {
     return read_reg(serials::Data);
 }
 
+/// \brief Check if a received character is waiting to be read.
+///
+/// Unlike `getc()`, this function never waits, which lets loops poll the
+/// serial port for input between other work.
+///
+/// \return True if the Data Ready bit in the Line Status register is set.
+bool serial_device::received() {
+    return read_reg(serials::LineStatus) & serials::DataReady;
+}
+
+/// \brief Raise the port's IRQ whenever a character is received.
+///
+/// The IRQ stays raised until the character is read, so waiting for it only
+/// needs the interrupt controller to acknowledge it.
+void serial_device::enable_receive_irq() {
+    write_reg(serials::Interrupt, serials::WhenDataAvailable);
+}
+
 /// \brief Write a null-terminated string to the serial port.
 ///
 /// This member function of the `serial_device` class is responsible for writing a null-terminated
@@ -2,7 +2,14 @@
 #include <x86.h>
 #include <cpu/gdt.hpp>
 #include <cpu/idt.hpp>
+#include <cpu/tsc.hpp>
 #include <dev/serials.hpp>
+#include <utils/per_cpu.hpp>
+
+/// \brief Index of the processor, a per-CPU variable.
+///
+/// The template holds 0, the bootstrap processor's index.
+__PER_CPU uint32_t x86_cpu_index = 0;
 
 /**
  * @brief This function is responsible for initializing various components of the x86_64 architecture
@@ -10,9 +17,11 @@
  * 1. Attempts to initialize the serial communication on COM1 using `dev::gserial`.
  *    - If initialization fails, a warning log message is printed indicating a faulty serial chip.
  * 2. Disables interrupts (CLI - Clear Interrupt flag) to prevent interrupts during certain critical sections.
- * 3. Initializes the Global Descriptor Table (GDT) for processor memory segmentation using `arch::x86_gdt_initialize()`.
+ * 3. Initializes the Global Descriptor Table (GDT) for processor memory segmentation using `arch::x86_gdt_initialize()`,
+ *    and the per-CPU data area the GS base points to using `utils::per_cpu_initialize()`.
  * 4. Initializes the Interrupt Descriptor Table (IDT) for managing interrupts using `arch::x86_idt_initialize()`.
  * 5. Enables interrupts (STI - Set Interrupt flag) to allow the processor to respond to external interrupts.
+ * 6. Calibrates the Time Stamp Counter (TSC) using `arch::tsc_calibrate()`, for timing measurements.
  * @note This function assumes that the required classes and functions are available in the
  *       "dev" and "arch" namespaces, and it relies on the x86 assembly instructions (CLI and STI)
  *       for managing interrupt flags.
@@ -30,9 +39,15 @@ void arch_initialize() {
     // Initialize the Global Descriptor Table (GDT) for memory segmentation
     arch::x86_gdt_initialize();
 
+    // Point the GS base at the per-CPU data, loading the GDT reset it
+    utils::per_cpu_initialize(0);
+
     // Initialize the Interrupt Descriptor Table (IDT) for interrupt handling
     arch::x86_idt_initialize();
 
     // Enable interrupts to allow the processor to respond to external interrupts
     x86_sti();
+
+    // Calibrate the Time Stamp Counter for timing measurements
+    arch::tsc_calibrate();
 }
\ No newline at end of file
@@ -14,6 +14,12 @@ LIMINE_BASE_REVISION(1)
 /// \param bootinfo Pointer to the boot information structure.
 extern void kmain(bootinfo_t* bootinfo);
 
+/// \brief Idle loop of the kernel.
+///
+/// This function runs background work whenever the processor has nothing
+/// else to do and never returns.
+extern __NO_RETURN void kidle(void);
+
 /// \brief Static volatile structure to store Limine bootloader information request.
 static volatile struct limine_bootloader_info_request __bootloader_info = {
     .id = LIMINE_BOOTLOADER_INFO_REQUEST,
@@ -43,6 +49,28 @@ static volatile struct limine_kernel_address_request __kernel_address_request =
         .response = NULL,
 };
 
+/// \brief Static volatile structure to store Limine kernel file request.
+static volatile struct limine_kernel_file_request __kernel_file_request = {
+    .id = LIMINE_KERNEL_FILE_REQUEST,
+    .revision = 0,
+    .response = NULL,
+};
+
+/// \brief Static volatile structure to store Limine RSDP request.
+static volatile struct limine_rsdp_request __rsdp_request = {
+    .id = LIMINE_RSDP_REQUEST,
+    .revision = 0,
+    .response = NULL,
+};
+
+/// \brief Static volatile structure to store Limine SMP request.
+static volatile struct limine_smp_request __smp_request = {
+    .id = LIMINE_SMP_REQUEST,
+    .revision = 0,
+    .response = NULL,
+    .flags = 0,
+};
+
 /// \brief Static function to build and initialize the boot information
 /// structure based on Limine responses.
 ///
@@ -74,6 +102,23 @@ static bootinfo_t build_bootinfo() {
     bootinfo.physical_base_address =
         (void*)__kernel_address_request.response->physical_base;
 
+    // The command line is passed along with the kernel file
+    if (__kernel_file_request.response != NULL) {
+        bootinfo.cmdline = __kernel_file_request.response->kernel_file->cmdline;
+    }
+
+    // Firmware without ACPI support leaves the RSDP request unanswered
+    bootinfo.rsdp_address = __rsdp_request.response != NULL
+                                ? __rsdp_request.response->address
+                                : NULL;
+
+    // The application processors wait in the bootloader until they are needed
+    if (__smp_request.response != NULL) {
+        bootinfo.cpus = __smp_request.response->cpus;
+        bootinfo.cpu_count = __smp_request.response->cpu_count;
+        bootinfo.bsp_lapic_id = __smp_request.response->bsp_lapic_id;
+    }
+
     // return the initialized boot information structure
     return bootinfo;
 }
@@ -81,8 +126,8 @@ static bootinfo_t build_bootinfo() {
 /// \brief Start function for the kernel.
 ///
 /// This function serves as the entry point for the kernel. It calls the
-/// \c build_bootinfo and \c kmain function and then halts the system
-/// with interrupts enabled.
+/// \c build_bootinfo and \c kmain function, which normally enters the idle
+/// loop from a stack of its own and never returns.
 ///
 /// \note The \c kmain function is expected to be implemented separately and
 ///       should contain the core logic of the operating system kernel.
@@ -90,9 +135,12 @@ void _start() {
     // Build the boot information structure
     bootinfo_t bootinfo = build_bootinfo();
 
+    // The bootloader memory is kept while the kernel runs on this stack
+    bootinfo.stack_top = (uintptr_t)__builtin_frame_address(0);
+
     // Call the main function function for kernel initialization
     kmain(&bootinfo);
 
-    // Halt the system with interrupts enabled
-    halt(true);
+    // Enter the idle loop should the kernel ever return here
+    kidle();
 }
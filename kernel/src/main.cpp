@@ -1,6 +1,15 @@
 #include <arch/arch.h>
 #include <system/log.h>
+#include <acpi/acpi.hpp>
+#include <cpu/pic.hpp>
+#include <cpu/smp.hpp>
+#include <dev/serials.hpp>
 #include <memory/pmm.hpp>
+#include <memory/pmm_bench.hpp>
+#include <memory/slab.hpp>
+#include <memory/vmalloc.hpp>
+#include <memory/vmm.hpp>
+#include <utils/cmdline.hpp>
 #include <utils/misc.hpp>
 
 /// \brief Initialize the Application Binary Interface (ABI).
@@ -12,12 +21,54 @@
 ///       phase of a kernel or similar low-level system software.
 extern "C" void abi_initialize();
 
+extern "C" __NO_RETURN void kidle();
+
+// clang-format off
+
+namespace {
+bootinfo_t kernel_bootinfo;  ///< Copy of the boot information, which lives on the bootloader's stack.
+}  // namespace
+
+// clang-format on
+
+/// \brief Second half of the kernel's initialization.
+///
+/// Runs on the bootstrap processor's kernel stack, if it got one, so the
+/// bootloader's stack can be reclaimed along with the rest of its memory.
+/// Benchmarks the physical memory allocator if asked to, logs an
+/// informational message and enters the idle loop.
+///
+/// \param argument Pointer to the copy of the boot information.
+__NO_RETURN void kmain_late(void* argument) {
+    bootinfo_t* bootinfo = static_cast<bootinfo_t*>(argument);
+
+    // Nothing needs the bootloader's structures anymore, give them back.
+    // This waits for the memory still being initialized in the background,
+    // so anything not depending on it should be initialized in `kmain`.
+    memory::phys_reclaim_bootloader_memory(bootinfo);
+
+    // Benchmark the physical memory allocator if asked to.
+    size_t length = 0;
+    const char* bench =
+        utils::cmdline_find(bootinfo->cmdline, "pmm_bench", &length);
+
+    if (bench != nullptr) {
+        memory::phys_run_benchmarks(bench, length);
+    }
+
+    // Log an informational message.
+    log_message(LOG_LEVEL_INFO, "Hello World!");
+
+    kidle();
+}
+
 /// \brief Kernel entry point.
 ///
 /// The `kmain` function serves as the entry point for the kernel. It initializes
 /// the Application Binary Interface (ABI), the utils library, architecture-specific
-/// components, and physical memory management. Finally, it logs an
-/// informational message.
+/// components, ACPI, the application processors, physical and virtual memory
+/// management. It then leaves the bootloader's stack and continues in
+/// \ref kmain_late, never returning.
 ///
 /// \param bootinfo Boot information containing details about the system.
 extern "C" void kmain(bootinfo_t* bootinfo) {
@@ -27,9 +78,77 @@ extern "C" void kmain(bootinfo_t* bootinfo) {
     // Initialize architecture-specific components.
     arch_initialize();
 
+    // Locate the ACPI tables, which describe the NUMA topology.
+    acpi::initialize(bootinfo);
+
+    // Start the application processors, which help initializing memory.
+    arch::smp_initialize(bootinfo);
+
     // Initialize physical memory management.
     memory::phys_initialize(bootinfo);
 
-    // Log an informational message.
-    log_message(LOG_LEVEL_INFO, "Hello World!");
-}
\ No newline at end of file
+    // Switch to the kernel's own page tables.
+    memory::virt_initialize(bootinfo);
+    memory::vmalloc_initialize();
+
+    // Give the application processors stacks of their own.
+    arch::smp_enter_kernel();
+
+    // Leave the bootloader's stack, taking the boot information along. A
+    // stack top of 0 tells the reclaim that the stack is no longer in use.
+    kernel_bootinfo = *bootinfo;
+    kernel_bootinfo.stack_top = 0;
+
+    arch::smp_move_bsp_stack(kmain_late, &kernel_bootinfo);
+
+    // Still on the bootloader's stack
+    kernel_bootinfo.stack_top = bootinfo->stack_top;
+    kmain_late(&kernel_bootinfo);
+}
+
+/// \brief Run a debug command received over the serial port.
+///
+/// The only command so far is `m`, which dumps the telemetry of the physical
+/// memory allocator, of the object caches and of the page fault handler.
+/// Other characters are ignored.
+///
+/// \param command The received character.
+void run_serial_command(uint8_t command) {
+    if (command == 'm') {
+        memory::phys_dump_telemetry();
+        memory::slab_dump_telemetry();
+        memory::virt_dump_telemetry();
+    }
+}
+
+/// \brief Idle loop of the kernel.
+///
+/// The `kidle` function runs background work, such as zeroing free pages
+/// ahead of time, and answers debug commands from the serial port. Once
+/// there is nothing left to do, the processor halts until the serial port's
+/// IRQ wakes it up, which is also when the zeroed pages are topped up.
+extern "C" __NO_RETURN void kidle() {
+    dev::gserial.enable_receive_irq();
+    arch::pic_set_mask(SERIAL_COM1_IRQ, false);
+
+    while (true) {
+        if (dev::gserial.received()) {
+            run_serial_command(dev::gserial.getc());
+            continue;
+        }
+
+        if (memory::phys_zero_idle_page()) {
+            continue;
+        }
+
+        // A character arriving after the check keeps its IRQ pending until
+        // the halt, as `sti` only takes effect after the next instruction
+        x86_cli();
+
+        if (dev::gserial.received()) {
+            x86_sti();
+        } else {
+            asm volatile("sti; hlt");
+        }
+    }
+}
@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include <memory/buddy.hpp>
+
+#include <utils/misc.hpp>
+
+namespace memory {
+/// \brief Get the size of the metadata needed to track a frame range.
+///
+/// The metadata consists of one bitmap per order, each holding one bit per
+/// block of that order.
+///
+/// \param base_pfn First page frame number of the range.
+/// \param end_pfn Page frame number one past the end of the range.
+/// \return Size of the metadata in bytes.
+size_t buddy_allocator::metadata_size(size_t base_pfn, size_t end_pfn) {
+    size_t index_base =
+        utils::align_down(base_pfn, static_cast<size_t>(1) << max_order);
+    size_t size = 0;
+
+    for (size_t order = 0; order <= max_order; ++order) {
+        size += utils::div_roundup(((end_pfn - index_base) >> order) + 1, 8);
+    }
+
+    return size;
+}
+
+/// \brief Initialize the allocator with every frame marked as used.
+///
+/// The bitmaps are carved out of the provided metadata buffer and cleared.
+/// Frames only become available once they are handed to \ref free_range.
+///
+/// \param base_pfn First page frame number of the range.
+/// \param end_pfn Page frame number one past the end of the range.
+/// \param page_size Size of a page frame in bytes.
+/// \param metadata Buffer of at least \ref metadata_size bytes.
+void buddy_allocator::initialize(size_t base_pfn, size_t end_pfn,
+                                 size_t page_size, void* metadata) {
+    this->base_pfn_ = base_pfn;
+    this->end_pfn_ = end_pfn;
+    this->index_base_ =
+        utils::align_down(base_pfn, static_cast<size_t>(1) << max_order);
+    this->page_size_ = page_size;
+
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(metadata);
+
+    for (size_t order = 0; order <= max_order; ++order) {
+        size_t bits = ((end_pfn - this->index_base_) >> order) + 1;
+        size_t bytes = utils::div_roundup(bits, 8);
+
+        // No frame heads a free block yet
+        memset(buffer, 0, bytes);
+        this->heads_[order].initialize(buffer, bits);
+
+        this->free_lists_[order] = nullptr;
+        this->free_blocks_[order] = 0;
+
+        buffer += bytes;
+    }
+
+    this->free_frames_ = 0;
+}
+
+/// \brief Get the free list node of a frame.
+///
+/// \param pfn Page frame number.
+/// \return Pointer to the node, through the higher half direct map.
+buddy_allocator::free_block* buddy_allocator::block_of(size_t pfn) const {
+    return reinterpret_cast<free_block*>(
+        utils::to_higher_half(pfn * this->page_size_));
+}
+
+/// \brief Get the page frame number of a free list node.
+///
+/// \param block Pointer to the node.
+/// \return Page frame number of the block.
+size_t buddy_allocator::pfn_of(free_block* block) const {
+    return utils::from_higher_half(reinterpret_cast<uintptr_t>(block)) /
+           this->page_size_;
+}
+
+/// \brief Check if a frame heads a free block of the given order.
+///
+/// \param pfn Page frame number.
+/// \param order Order of the block.
+/// \return True if the frame is managed and heads a free block of that order.
+bool buddy_allocator::is_free_head(size_t pfn, size_t order) {
+    if (pfn < this->base_pfn_ || pfn >= this->end_pfn_) {
+        return false;
+    }
+
+    return this->heads_[order].get((pfn - this->index_base_) >> order);
+}
+
+/// \brief Push a block onto the free list of its order.
+///
+/// \param pfn Page frame number of the block.
+/// \param order Order of the block.
+void buddy_allocator::push(size_t pfn, size_t order) {
+    free_block* block = this->block_of(pfn);
+
+    block->prev = nullptr;
+    block->next = this->free_lists_[order];
+
+    if (block->next != nullptr) {
+        block->next->prev = block;
+    }
+
+    this->free_lists_[order] = block;
+    this->free_blocks_[order]++;
+    this->heads_[order].set((pfn - this->index_base_) >> order, true);
+}
+
+/// \brief Unlink a block from the free list of its order.
+///
+/// \param pfn Page frame number of the block.
+/// \param order Order of the block.
+void buddy_allocator::remove(size_t pfn, size_t order) {
+    free_block* block = this->block_of(pfn);
+
+    if (block->prev != nullptr) {
+        block->prev->next = block->next;
+    } else {
+        this->free_lists_[order] = block->next;
+    }
+
+    if (block->next != nullptr) {
+        block->next->prev = block->prev;
+    }
+
+    this->free_blocks_[order]--;
+    this->heads_[order].set((pfn - this->index_base_) >> order, false);
+}
+
+/// \brief Allocate a naturally aligned block of `2^order` frames.
+///
+/// The smallest free block of at least the requested order is taken and split
+/// in halves until it has the requested order. The unused halves are put back
+/// on their free lists.
+///
+/// \param order Order of the block.
+/// \return Page frame number of the block, or \ref npos.
+size_t buddy_allocator::allocate(size_t order) {
+    if (order > max_order) {
+        return npos;
+    }
+
+    size_t current = order;
+
+    // Find the smallest order with a free block
+    while (current <= max_order && this->free_lists_[current] == nullptr) {
+        ++current;
+    }
+
+    if (current > max_order) {
+        return npos;
+    }
+
+    size_t pfn = this->pfn_of(this->free_lists_[current]);
+    this->remove(pfn, current);
+
+    // Split the block, keeping the lower half each time
+    while (current > order) {
+        --current;
+        this->push(pfn + (static_cast<size_t>(1) << current), current);
+    }
+
+    this->free_frames_ -= static_cast<size_t>(1) << order;
+
+    return pfn;
+}
+
+/// \brief Free a block previously returned by \ref allocate.
+///
+/// The block is merged with its buddy for as long as the buddy heads a free
+/// block of the same order.
+///
+/// \param pfn Page frame number of the block.
+/// \param order Order of the block.
+void buddy_allocator::free(size_t pfn, size_t order) {
+    this->free_frames_ += static_cast<size_t>(1) << order;
+
+    while (order < max_order) {
+        size_t buddy = pfn ^ (static_cast<size_t>(1) << order);
+
+        if (!this->is_free_head(buddy, order)) {
+            break;
+        }
+
+        // Merge with the buddy and continue one order up
+        this->remove(buddy, order);
+        pfn &= ~(static_cast<size_t>(1) << order);
+        ++order;
+    }
+
+    this->push(pfn, order);
+}
+
+/// \brief Free an arbitrary range of frames.
+///
+/// The range is split into the largest naturally aligned blocks that fit and
+/// each of them is freed individually.
+///
+/// \param pfn First page frame number of the range.
+/// \param count Number of frames in the range.
+void buddy_allocator::free_range(size_t pfn, size_t count) {
+    while (count > 0) {
+        size_t order = max_order;
+
+        // Shrink the block until it is aligned and fits into the range
+        while (!utils::is_aligned(pfn, static_cast<size_t>(1) << order) ||
+               (static_cast<size_t>(1) << order) > count) {
+            --order;
+        }
+
+        this->free(pfn, order);
+
+        pfn += static_cast<size_t>(1) << order;
+        count -= static_cast<size_t>(1) << order;
+    }
+}
+
+/// \brief Find the free block containing a frame.
+///
+/// \param pfn Page frame number of the frame.
+/// \param head Receives the first frame of the block.
+/// \return Order of the block, or more than \ref max_order if the frame is
+///         not free.
+size_t buddy_allocator::find_free_block(size_t pfn, size_t* head) {
+    size_t order = 0;
+
+    while (order <= max_order) {
+        *head = utils::align_down(pfn, static_cast<size_t>(1) << order);
+
+        if (this->is_free_head(*head, order)) {
+            break;
+        }
+
+        ++order;
+    }
+
+    return order;
+}
+
+/// \brief Remove an arbitrary range of free frames from the free lists.
+///
+/// Every free block overlapping the range is taken off its free list, and the
+/// parts of it lying outside of the range are freed again. The whole range is
+/// checked before anything is removed, so a failure changes nothing.
+///
+/// \param pfn First page frame number of the range.
+/// \param count Number of frames in the range.
+/// \return True if every frame of the range was free, false otherwise.
+bool buddy_allocator::reserve_range(size_t pfn, size_t count) {
+    size_t end = pfn + count;
+    size_t head = 0;
+
+    for (size_t current = pfn; current < end;) {
+        size_t order = this->find_free_block(current, &head);
+
+        if (order > max_order) {
+            return false;
+        }
+
+        current = head + (static_cast<size_t>(1) << order);
+    }
+
+    for (size_t current = pfn; current < end;) {
+        size_t order = this->find_free_block(current, &head);
+        size_t block_end = head + (static_cast<size_t>(1) << order);
+
+        this->remove(head, order);
+        this->free_frames_ -= static_cast<size_t>(1) << order;
+
+        // Give back the parts of the block outside of the range
+        if (head < pfn) {
+            this->free_range(head, pfn - head);
+        }
+
+        if (block_end > end) {
+            this->free_range(end, block_end - end);
+        }
+
+        current = block_end;
+    }
+
+    return true;
+}
+}  // namespace memory
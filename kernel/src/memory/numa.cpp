@@ -0,0 +1,268 @@
+#include <arch/arch.h>
+#include <system/log.h>
+
+#include <utility>
+
+#include <acpi/acpi.hpp>
+#include <cpu/smp.hpp>
+#include <memory/numa.hpp>
+
+namespace memory {
+// clang-format off
+
+namespace {
+/// Upper bound for the number of memory ranges taken from the SRAT.
+constexpr size_t max_numa_ranges = 32;
+
+/// Memory range with a known NUMA node.
+struct numa_range {
+    paddr_t base;  ///< First address of the range.
+    paddr_t end;   ///< Address one past the end of the range.
+    size_t node;   ///< Node of the range.
+};
+
+/// Local APIC with a known NUMA node.
+struct numa_apic {
+    uint32_t apic_id;  ///< Local APIC ID.
+    size_t node;       ///< Node of the processor.
+};
+
+numa_range numa_ranges[max_numa_ranges];  ///< Memory ranges, sorted by address.
+size_t numa_range_count = 0;  ///< Number of valid entries in `numa_ranges`.
+
+numa_apic numa_apics[MAX_CPUS];  ///< Processors listed by the SRAT.
+size_t numa_apic_count = 0;  ///< Number of valid entries in `numa_apics`.
+
+uint32_t numa_domains[max_numa_nodes];  ///< Proximity domain of every node.
+size_t node_count = 1;  ///< Number of NUMA nodes.
+
+size_t cpu_nodes[MAX_CPUS];  ///< NUMA node of every CPU.
+}  // namespace
+
+// clang-format on
+
+/// \brief Get the node of a proximity domain, adding it if it is new.
+///
+/// Proximity domains are arbitrary numbers, nodes are numbered densely in
+/// the order their domains show up. Domains beyond \ref max_numa_nodes are
+/// folded into node 0.
+///
+/// \param domain The proximity domain.
+/// \return The node of the domain.
+size_t node_of_domain(uint32_t domain) {
+    for (size_t i = 0; i < node_count; ++i) {
+        if (numa_domains[i] == domain) {
+            return i;
+        }
+    }
+
+    if (node_count == max_numa_nodes) {
+        log_message(LOG_LEVEL_WARNING,
+                    "Too many NUMA nodes, folding domain %u into node 0.",
+                    domain);
+        return 0;
+    }
+
+    numa_domains[node_count] = domain;
+    return node_count++;
+}
+
+/// \brief Record a memory affinity entry of the SRAT.
+///
+/// \param entry The entry.
+void add_memory_affinity(const acpi::srat_memory_affinity* entry) {
+    if ((entry->flags & acpi::srat_enabled) == 0 || entry->length == 0) {
+        return;
+    }
+
+    if (numa_range_count == max_numa_ranges) {
+        log_message(LOG_LEVEL_WARNING,
+                    "Too many NUMA memory ranges, ignoring %p.",
+                    reinterpret_cast<void*>(entry->base));
+        return;
+    }
+
+    numa_range& range = numa_ranges[numa_range_count++];
+
+    range.base = entry->base;
+    range.end = entry->base + entry->length;
+    range.node = node_of_domain(entry->proximity_domain);
+}
+
+/// \brief Record the proximity domain of a processor listed by the SRAT.
+///
+/// \param apic_id The (x2)APIC ID of the processor.
+/// \param domain The proximity domain of the processor.
+void add_apic_affinity(uint32_t apic_id, uint32_t domain) {
+    if (numa_apic_count == MAX_CPUS) {
+        return;
+    }
+
+    numa_apics[numa_apic_count++] = {apic_id, node_of_domain(domain)};
+}
+
+/// \brief Discover the NUMA topology from the ACPI SRAT.
+///
+/// Memory ranges and processors are assigned to nodes as described by the
+/// SRAT. If the table is missing or describes no memory, all memory and CPUs
+/// belong to node 0. Every processor started by \ref arch::smp_initialize is
+/// registered right away, processors started later have to be registered
+/// with \ref numa_register_cpu.
+void numa_initialize() {
+    const acpi::sdt_header* table = acpi::find_table("SRAT");
+
+    if (table != nullptr) {
+        node_count = 0;
+
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(table);
+        size_t offset = sizeof(acpi::srat_header);
+
+        while (offset + sizeof(acpi::srat_entry) <= table->length) {
+            const acpi::srat_entry* entry =
+                reinterpret_cast<const acpi::srat_entry*>(data + offset);
+
+            if (entry->length == 0) {
+                break;
+            }
+
+            switch (entry->type) {
+                case acpi::SratProcessorAffinity: {
+                    auto cpu = reinterpret_cast<
+                        const acpi::srat_processor_affinity*>(entry);
+
+                    if (cpu->flags & acpi::srat_enabled) {
+                        uint32_t domain =
+                            cpu->proximity_domain_low |
+                            (cpu->proximity_domain_high[0] << 8) |
+                            (cpu->proximity_domain_high[1] << 16) |
+                            (cpu->proximity_domain_high[2] << 24);
+
+                        add_apic_affinity(cpu->apic_id, domain);
+                    }
+
+                    break;
+                }
+                case acpi::SratMemoryAffinity:
+                    add_memory_affinity(
+                        reinterpret_cast<const acpi::srat_memory_affinity*>(
+                            entry));
+                    break;
+                case acpi::SratX2ApicAffinity: {
+                    auto cpu =
+                        reinterpret_cast<const acpi::srat_x2apic_affinity*>(
+                            entry);
+
+                    if (cpu->flags & acpi::srat_enabled) {
+                        add_apic_affinity(cpu->x2apic_id,
+                                          cpu->proximity_domain);
+                    }
+
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            offset += entry->length;
+        }
+    }
+
+    if (numa_range_count == 0) {
+        // Without memory affinity there is nothing to keep apart
+        node_count = 1;
+        numa_apic_count = 0;
+    }
+
+    // Sort the ranges by address, there are only a handful of them
+    for (size_t i = 1; i < numa_range_count; ++i) {
+        for (size_t j = i; j > 0; --j) {
+            if (numa_ranges[j - 1].base <= numa_ranges[j].base) {
+                break;
+            }
+
+            std::swap(numa_ranges[j], numa_ranges[j - 1]);
+        }
+    }
+
+    for (size_t i = 0; i < numa_range_count; ++i) {
+        log_message(LOG_LEVEL_DEBUG, "NUMA node %lu: [%p - %p)",
+                    numa_ranges[i].node,
+                    reinterpret_cast<void*>(numa_ranges[i].base),
+                    reinterpret_cast<void*>(numa_ranges[i].end));
+    }
+
+    for (size_t i = 0; i < arch::smp_cpu_count(); ++i) {
+        numa_register_cpu(i, arch::smp_apic_id(i));
+    }
+
+    log_message(LOG_LEVEL_INFO, "Found %lu NUMA node(s).", node_count);
+}
+
+/// \brief Get the number of NUMA nodes.
+///
+/// \return The number of nodes, at least 1.
+size_t numa_node_count() {
+    return node_count;
+}
+
+/// \brief Get the NUMA node a physical address belongs to.
+///
+/// \param address The physical address.
+/// \param end Optionally receives the address at which the answer may change.
+/// \return The node of the address, 0 if it is not described by the SRAT.
+size_t numa_node_of(paddr_t address, paddr_t* end) {
+    paddr_t next = ~static_cast<paddr_t>(0);
+
+    for (size_t i = 0; i < numa_range_count; ++i) {
+        const numa_range& range = numa_ranges[i];
+
+        if (address < range.base) {
+            // Addresses in a hole belong to node 0 up to the next range
+            next = range.base;
+            break;
+        }
+
+        if (address < range.end) {
+            if (end != nullptr) {
+                *end = range.end;
+            }
+
+            return range.node;
+        }
+    }
+
+    if (end != nullptr) {
+        *end = next;
+    }
+
+    return 0;
+}
+
+/// \brief Assign a CPU to the NUMA node of its local APIC.
+///
+/// CPUs whose APIC is not listed by the SRAT belong to node 0.
+///
+/// \param cpu The CPU number.
+/// \param apic_id The local APIC ID of the CPU.
+void numa_register_cpu(uint32_t cpu, uint32_t apic_id) {
+    if (cpu >= MAX_CPUS) {
+        return;
+    }
+
+    cpu_nodes[cpu] = 0;
+
+    for (size_t i = 0; i < numa_apic_count; ++i) {
+        if (numa_apics[i].apic_id == apic_id) {
+            cpu_nodes[cpu] = numa_apics[i].node;
+            break;
+        }
+    }
+}
+
+/// \brief Get the NUMA node of the current CPU.
+///
+/// \return The node of the current CPU.
+size_t numa_current_node() {
+    return cpu_nodes[arch_current_cpu()];
+}
+}  // namespace memory
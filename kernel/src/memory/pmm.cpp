@@ -1,168 +1,1404 @@
+#include <arch/arch.h>
+#include <stdio.h>
 #include <string.h>
 #include <system/log.h>
 
 #include <algorithm>
 
+#include <cpu/smp.hpp>
+#include <cpu/tsc.hpp>
+#include <memory/frame_stack.hpp>
 #include <memory/memory.hpp>
+#include <memory/numa.hpp>
+#include <memory/page.hpp>
 #include <memory/pmm.hpp>
+#include <memory/zone.hpp>
 
 #include <utils/misc.hpp>
+#include <utils/per_cpu.hpp>
 
 namespace memory {
 // clang-format off
 
 namespace {
-utils::bitmap<uint8_t> phys_bitmap;  ///< Bitmap to track allocated physical memory pages.
-utils::ticket_spinlock phys_lock;  ///< Spinlock for synchronized access to physical memory management.
+phys_zone phys_zones[max_numa_nodes][zone_count];  ///< Physical memory zones, indexed by NUMA node and \ref zone_type.
+
+/// Names of the zones, indexed by \ref zone_type.
+constexpr const char* zone_names[zone_count] = {"DMA", "DMA32", "Normal"};
 
-size_t last_index = 0;  ///< Last index used for tracking available memory pages.
 paddr_t highest_usable_memory = 0;  ///< Highest usable memory address.
 
-size_t phys_page_size = 0;  ///< Size of a physical memory page.
+page* page_database = nullptr;  ///< Page frame database, indexed by page frame number.
+size_t page_database_size = 0;  ///< Number of entries in `page_database`.
+
+size_t phys_page_size = 0;  ///< Size of a physical memory page.
+
+size_t usable_mem = 0;    ///< Total usable physical memory.
+size_t total_mem = 0;     ///< Total physical memory.
+size_t reserved_mem = 0;  ///< Memory used by the kernel, the bootloader and the zones' metadata.
+size_t reclaimed_mem = 0;  ///< Bootloader memory handed over to the zones after boot.
+
+/// Largest number of memory map entries kept once the bootloader memory is reclaimed.
+constexpr size_t max_boot_memmap_entries = 256;
+
+memory_map boot_memmap[max_boot_memmap_entries];  ///< Copy of the bootloader's memory map.
+memory_map* boot_memmap_entries[max_boot_memmap_entries];  ///< Pointers into `boot_memmap`.
+char boot_loader_name[64];     ///< Copy of the bootloader's name.
+char boot_loader_version[64];  ///< Copy of the bootloader's version.
+char boot_cmdline[256];        ///< Copy of the kernel command line.
+
+/// Largest number of bootloader page table frames which can be kept in use.
+constexpr size_t max_boot_table_frames = 512;
+
+size_t boot_table_frames[max_boot_table_frames];  ///< Frames of the active page tables.
+size_t boot_table_count = 0;  ///< Number of valid entries in `boot_table_frames`.
+paddr_t boot_page_tables = 0;  ///< Physical address of the bootloader's PML4.
+
+/// Per-CPU cache of free pages, only touched by its own CPU with interrupts disabled.
+struct __ALIGNED(64) page_cache {
+    size_t count;  ///< Number of cached pages.
+    size_t pages[max_page_cache_size];  ///< Page frame numbers of the cached pages.
+
+    size_t hits;     ///< Requests served from the cache.
+    size_t misses;   ///< Requests which found the cache empty.
+    size_t refills;  ///< Batches moved from the zones.
+    size_t drains;   ///< Batches moved back to the zones.
+};
+
+__PER_CPU utils::per_cpu<page_cache> page_caches;  ///< Page cache of every CPU.
+size_t page_cache_size = 64;  ///< Maximum number of pages held by a page cache.
+size_t page_cache_batch = 16;  ///< Number of pages moved between a cache and the zones at once.
+
+numa_fallback numa_policy = NumaFallbackAny;  ///< Whether allocations may leave the local node.
+
+/// Upper bound for the number of frames on the lock-free stack of a node.
+constexpr size_t max_free_stack_size = 1024;
+
+frame_stack free_stacks[max_numa_nodes];  ///< Lock-free stacks of free single frames, per NUMA node.
+
+/// Number of pages kept zeroed in advance by the idle loop.
+constexpr size_t zero_pool_size = 256;
+
+/// Pool of free pages which have already been filled with zeroes.
+struct zero_pool {
+    size_t count;  ///< Number of pooled pages.
+    size_t pages[zero_pool_size];  ///< Page frame numbers of the pooled pages.
+
+    size_t hits;  ///< Zeroed requests served from the pool.
+    utils::irq_lock lock;  ///< Spinlock for synchronized access to the pool.
+};
+
+zero_pool zeroed_pages[max_numa_nodes];  ///< Pages zeroed ahead of time, per NUMA node.
+
+/// Upper bound for the number of call sites tracked by the allocation telemetry.
+constexpr size_t max_alloc_sites = 128;
+
+/// Allocation counters of one caller of \ref request_page or \ref request_pages.
+struct alloc_site {
+    std::atomic<uintptr_t> site;  ///< Return address of the call, 0 if the slot is unused.
+    std::atomic<size_t> calls;     ///< Number of requests.
+    std::atomic<size_t> pages;     ///< Number of pages handed out.
+    std::atomic<size_t> failures;  ///< Number of requests which could not be served.
+};
+
+alloc_site alloc_sites[max_alloc_sites];  ///< Open-addressed table of call sites.
+std::atomic<size_t> untracked_allocs = 0;  ///< Requests from sites which found the table full.
+
+/// Frames initialized by one step of the deferred initialization, 128 MiB with 4 KiB pages.
+constexpr size_t init_chunk_frames = static_cast<size_t>(1) << 15;
+
+/// Memory initialized by \ref phys_initialize itself, everything above is deferred.
+constexpr size_t eager_init_memory = 128 * get_page_size(MiB2);
+
+/// Range of usable frames, copied out of the memory map for the deferred initialization.
+struct init_range {
+    size_t start;  ///< First page frame number.
+    size_t end;    ///< Page frame number one past the end.
+};
+
+init_range init_ranges[max_boot_memmap_entries];  ///< Usable memory, sorted like the memory map.
+size_t init_range_count = 0;  ///< Number of valid entries in `init_ranges`.
+size_t init_chunk_count = 0;  ///< Number of chunks covering the page frame database.
+
+std::atomic<size_t> next_init_chunk = 0;   ///< Next chunk to be taken by a CPU.
+std::atomic<size_t> done_init_chunks = 0;  ///< Number of chunks published to the zones.
+std::atomic<uint64_t> init_chunk_ticks = 0;  ///< TSC cycles spent on deferred chunks, summed over all CPUs.
+std::atomic<size_t> parked_init_workers = 0;  ///< Helpers done with the deferred initialization.
+size_t init_workers = 0;  ///< Application processors helping with the deferred initialization.
+uint64_t deferred_init_start = 0;  ///< TSC value when the deferred initialization started.
+std::atomic<bool> deferred_init_pending = false;  ///< Whether some memory is not published yet.
+}  // namespace
+
+// clang-format on
+
+bool finish_deferred_init();
+
+/// \brief Get the type of the zone a page falls into by its address.
+///
+/// \param page The page frame number.
+/// \return The zone type.
+zone_type zone_type_of(size_t page) {
+    paddr_t address = page * phys_page_size;
+
+    for (size_t i = 0; i < zone_count - 1; ++i) {
+        if (address < zone_limit(static_cast<zone_type>(i))) {
+            return static_cast<zone_type>(i);
+        }
+    }
+
+    return ZoneNormal;
+}
+
+/// \brief Get the zone a page belongs to.
+///
+/// The frame ranges of the zones of different nodes may interleave, so the
+/// node is looked up first.
+///
+/// \param page The page frame number.
+/// \return Pointer to the zone, or nullptr if the page is not managed.
+phys_zone* zone_of(size_t page) {
+    size_t node = numa_node_of(page * phys_page_size);
+    phys_zone& zone = phys_zones[node][zone_type_of(page)];
+
+    return zone.initialized() && zone.contains(page) ? &zone : nullptr;
+}
+
+/// \brief Get the NUMA node a page belongs to.
+///
+/// \param page The page frame number.
+/// \return The node of the page.
+size_t node_of(size_t page) {
+    return numa_node_of(page * phys_page_size);
+}
+
+/// \brief Get the number of nodes an allocation may be served from.
+///
+/// \return The number of nodes allowed by the fallback policy.
+size_t allowed_nodes() {
+    return numa_policy == NumaFallbackLocalOnly ? 1 : numa_node_count();
+}
+
+/// \brief Get the node to try at some step of an allocation.
+///
+/// Allocations start at the local node and visit the others in order.
+///
+/// \param local The node of the current CPU.
+/// \param step The number of nodes tried already.
+/// \return The node to try.
+size_t fallback_node(size_t local, size_t step) {
+    return (local + step) % numa_node_count();
+}
+
+/// \brief Get information about the physical memory.
+///
+/// This function retrieves metadata about the physical memory, including total memory,
+/// used memory, and free memory.
+///
+/// \return A structure (\ref phys_metadata_t) containing the following information:
+///   - \c total_memory: The total size of physical memory in bytes.
+///   - \c used_memory: The amount of used physical memory in bytes.
+///   - \c free_memory: The amount of free physical memory in bytes.
+///   - \c reclaimed_memory: The bootloader memory given back after boot.
+///   - \c nodes: The usable, used and free memory of every NUMA node, not
+///     counting the memory reserved before the zones were set up.
+phys_metadata_t get_phys_info() {
+    phys_metadata_t data = {};
+    size_t total_frames[max_numa_nodes] = {};
+    size_t used_frames[max_numa_nodes] = {};
+
+    data.node_count = numa_node_count();
+
+    for (size_t i = 0; i < data.node_count; ++i) {
+        for (const phys_zone& zone : phys_zones[i]) {
+            total_frames[i] += zone.total_frames();
+            used_frames[i] += zone.total_frames() - zone.free_frames();
+        }
+
+        // Cached, stacked and pooled pages are free from the caller's point
+        // of view
+        used_frames[i] -= zeroed_pages[i].count + free_stacks[i].size();
+    }
+
+    for (size_t cpu = 0; cpu < arch::smp_cpu_count(); ++cpu) {
+        const page_cache& cache = page_caches.on(cpu);
+
+        for (size_t i = 0; i < cache.count; ++i) {
+            used_frames[node_of(cache.pages[i])]--;
+        }
+    }
+
+    size_t used = 0;
+
+    for (size_t i = 0; i < data.node_count; ++i) {
+        phys_node_info_t& node = data.nodes[i];
+
+        node.total_memory = total_frames[i] * phys_page_size;
+        node.used_memory = used_frames[i] * phys_page_size;
+        node.free_memory = node.total_memory - node.used_memory;
+
+        used += node.used_memory;
+    }
+
+    data.total_memory = total_mem;
+    data.used_memory = reserved_mem + used;
+    data.free_memory = total_mem - data.used_memory;
+    data.reclaimed_memory = reclaimed_mem;
+    data.highest_address = highest_usable_memory;
+
+    return data;
+}
+
+/// \brief Get information about a physical memory zone.
+///
+/// \param zone The zone.
+/// \return A structure (\ref phys_zone_info_t) describing the zone on all
+///         NUMA nodes.
+phys_zone_info_t get_phys_zone_info(zone_type zone) {
+    phys_zone_info_t info = {};
+
+    info.name = zone_names[zone];
+
+    for (size_t i = 0; i < numa_node_count(); ++i) {
+        const phys_zone& target = phys_zones[i][zone];
+
+        if (target.initialized()) {
+            info.total_memory += target.total_frames() * phys_page_size;
+            info.free_memory += target.free_frames() * phys_page_size;
+        }
+    }
+
+    return info;
+}
+
+/// \brief Get fragmentation statistics for a page size class.
+///
+/// The free blocks of a class are counted from the buddy free lists of every
+/// zone, where a free block of a higher order holds several blocks of the
+/// class. Pages held by the per-CPU caches and the pre-zeroed pool are not
+/// taken into account.
+///
+/// \param shift The page size class.
+/// \return A structure (\ref phys_frag_stats_t) containing the statistics.
+phys_frag_stats_t get_phys_frag_stats(page_size_shift shift) {
+    phys_frag_stats_t stats = {};
+    size_t page_shift = __builtin_ctzll(phys_page_size);
+
+    if (shift < page_shift || shift - page_shift > max_order) {
+        return stats;
+    }
+
+    size_t order = shift - page_shift;
+
+    for (size_t i = 0; i < numa_node_count(); ++i) {
+        for (phys_zone& zone : phys_zones[i]) {
+            if (!zone.initialized()) {
+                continue;
+            }
+
+            stats.free_blocks += zone.free_blocks(order);
+            stats.ideal_blocks += zone.free_frames() >> order;
+        }
+    }
+
+    if (stats.ideal_blocks != 0) {
+        stats.fragmentation =
+            100 - (stats.free_blocks * 100) / stats.ideal_blocks;
+    }
+
+    return stats;
+}
+
+/// \brief Print fragmentation statistics of every page size class to the log.
+void print_frag_stats() {
+    const page_size_shift shifts[] = {KiB4, MiB2, GiB1};
+
+    for (page_size_shift shift : shifts) {
+        phys_frag_stats_t stats = get_phys_frag_stats(shift);
+
+        log_message(LOG_LEVEL_DEBUG,
+                    "%lu KiB blocks: %lu free of %lu ideal (%lu%% fragmented)",
+                    get_page_size(shift) / 1024, stats.free_blocks,
+                    stats.ideal_blocks, stats.fragmentation);
+    }
+}
+
+/// \brief Print per-CPU page cache statistics to the log.
+void print_cache_stats() {
+    phys_cache_stats_t stats = get_phys_cache_stats();
+    size_t requests = stats.hits + stats.misses;
+
+    log_message(LOG_LEVEL_DEBUG,
+                "Page cache: %lu hits, %lu misses (%lu%% hit rate), %lu "
+                "refills, %lu drains, %lu pages cached",
+                stats.hits, stats.misses,
+                requests != 0 ? (stats.hits * 100) / requests : 0,
+                stats.refills, stats.drains, stats.cached_pages);
+    log_message(LOG_LEVEL_DEBUG, "Zeroed pool: %lu hits, %lu pages pooled",
+                stats.zeroed_hits, stats.zeroed_pages);
+    log_message(LOG_LEVEL_DEBUG, "Free stacks: %lu pages stacked",
+                stats.stacked_pages);
+}
+
+/// \brief Print physical memory metadata to the log.
+///
+/// This function retrieves physical memory metadata using \ref get_phys_info and prints
+/// it to the log with information on total memory, used memory, and free memory.
+void print_metadata() {
+    phys_metadata_t data = get_phys_info();
+
+    log_message(
+        LOG_LEVEL_DEBUG,
+        "Total Memory: %lu MB, Used Memory: %lu MB, Free Memory: %lu MB",
+        bytes_to_mb(data.total_memory), bytes_to_mb(data.used_memory),
+        bytes_to_mb(data.free_memory));
+
+    for (size_t i = 0; i < zone_count; ++i) {
+        phys_zone_info_t info = get_phys_zone_info(static_cast<zone_type>(i));
+
+        log_message(LOG_LEVEL_DEBUG, "Zone %s: %lu MB, Free: %lu MB",
+                    info.name, bytes_to_mb(info.total_memory),
+                    bytes_to_mb(info.free_memory));
+    }
+
+    for (size_t i = 0; i < data.node_count; ++i) {
+        log_message(LOG_LEVEL_DEBUG, "Node %lu: %lu MB, Free: %lu MB", i,
+                    bytes_to_mb(data.nodes[i].total_memory),
+                    bytes_to_mb(data.nodes[i].free_memory));
+    }
+
+    print_cache_stats();
+    print_frag_stats();
+}
+
+/// \brief Print allocator telemetry to the serial port.
+///
+/// Every line starts with `pmm-telemetry` followed by `key=value` pairs, so
+/// dumps taken over time can be compared by scripts:
+///   - one line per NUMA node and zone with its free frames and longest run,
+///   - one line per buddy order with the exact number of free blocks of that
+///     order and the share of free memory unusable for a block of that order,
+///   - one line per allocation call site with its request counters.
+///
+/// Pages held by the per-CPU caches, the free stacks and the pre-zeroed pools
+/// count as allocated here, their totals are printed separately.
+void phys_dump_telemetry() {
+    phys_cache_stats_t cache = get_phys_cache_stats();
+    size_t blocks[max_order + 1] = {};
+    size_t free_frames = 0;
+    size_t largest_run = 0;
+
+    for (size_t i = 0; i < numa_node_count(); ++i) {
+        for (size_t j = 0; j < zone_count; ++j) {
+            phys_zone& zone = phys_zones[i][j];
+
+            if (!zone.initialized()) {
+                continue;
+            }
+
+            size_t run = zone.largest_free_run();
+
+            for (size_t order = 0; order <= max_order; ++order) {
+                blocks[order] += zone.free_list_blocks(order);
+            }
+
+            free_frames += zone.free_frames();
+            largest_run = std::max(largest_run, run);
+
+            printf("pmm-telemetry node=%lu zone=%s total_frames=%lu "
+                   "free_frames=%lu largest_run=%lu\n",
+                   i, zone.name(), zone.total_frames(), zone.free_frames(),
+                   run);
+        }
+    }
+
+    printf("pmm-telemetry free_frames=%lu largest_run=%lu cached=%lu "
+           "stacked=%lu zeroed=%lu\n",
+           free_frames, largest_run, cache.cached_pages, cache.stacked_pages,
+           cache.zeroed_pages);
+
+    // Frames in free blocks of at least the order, from the largest order down
+    size_t usable = 0;
+    size_t unusable[max_order + 1];
+
+    for (size_t order = max_order + 1; order-- > 0;) {
+        usable += blocks[order] << order;
+        unusable[order] =
+            free_frames != 0 ? 100 - (usable * 100) / free_frames : 0;
+    }
+
+    for (size_t order = 0; order <= max_order; ++order) {
+        printf("pmm-telemetry order=%lu free_blocks=%lu unusable_pct=%lu\n",
+               order, blocks[order], unusable[order]);
+    }
+
+    for (const alloc_site& entry : alloc_sites) {
+        uintptr_t site = entry.site.load(std::memory_order_relaxed);
+
+        if (site == 0) {
+            continue;
+        }
+
+        printf("pmm-telemetry site=%p calls=%lu pages=%lu failures=%lu\n",
+               reinterpret_cast<void*>(site),
+               entry.calls.load(std::memory_order_relaxed),
+               entry.pages.load(std::memory_order_relaxed),
+               entry.failures.load(std::memory_order_relaxed));
+    }
+
+    printf("pmm-telemetry untracked=%lu\n",
+           untracked_allocs.load(std::memory_order_relaxed));
+}
+
+/// \brief Get statistics about the per-CPU page caches, summed over all CPUs.
+///
+/// The caches of other CPUs are read without synchronization, so the result
+/// is only a snapshot.
+///
+/// \return A structure (\ref phys_cache_stats_t) containing the statistics.
+phys_cache_stats_t get_phys_cache_stats() {
+    phys_cache_stats_t stats = {};
+
+    for (size_t cpu = 0; cpu < arch::smp_cpu_count(); ++cpu) {
+        const page_cache& cache = page_caches.on(cpu);
+
+        stats.hits += cache.hits;
+        stats.misses += cache.misses;
+        stats.refills += cache.refills;
+        stats.drains += cache.drains;
+        stats.cached_pages += cache.count;
+    }
+
+    for (const zero_pool& pool : zeroed_pages) {
+        stats.zeroed_hits += pool.hits;
+        stats.zeroed_pages += pool.count;
+    }
+
+    for (const frame_stack& stack : free_stacks) {
+        stats.stacked_pages += stack.size();
+    }
+
+    return stats;
+}
+
+/// \brief Tune the per-CPU page caches.
+///
+/// Caches holding more pages than the new size are trimmed the next time a
+/// page is freed into them. Disabling the caches leaves the pages they hold
+/// in place until they are enabled again.
+///
+/// \param size Maximum number of pages held by each cache (0 disables them).
+/// \param batch Number of pages moved from or to the zones at once.
+void set_phys_cache_size(size_t size, size_t batch) {
+    page_cache_size = std::min(size, max_page_cache_size);
+    page_cache_batch =
+        std::clamp<size_t>(batch, 1, std::max<size_t>(page_cache_size, 1));
+}
+
+/// \brief Choose what happens when the node of the calling CPU runs out of memory.
+///
+/// \param policy The fallback policy.
+void set_numa_fallback(numa_fallback policy) {
+    numa_policy = policy;
+}
+
+/// \brief Request pages from the zones allowed by a mask.
+///
+/// The zones of the local node are tried first, then those of the other
+/// nodes if the fallback policy allows it. Within a node, zones are tried
+/// from the highest to the lowest, so that the scarce low memory is kept for
+/// the requests which cannot be served elsewhere.
+///
+/// \param count Number of pages to request.
+/// \param zones Zones the pages may come from.
+/// \return The page frame number of the allocation or phys_zone::npos.
+size_t request_zone_page(size_t count, zone_mask zones) {
+    size_t local = numa_current_node();
+
+    for (size_t i = 0; i < allowed_nodes(); ++i) {
+        phys_zone* node = phys_zones[fallback_node(local, i)];
+
+        for (size_t j = zone_count; j-- > 0;) {
+            if ((zones & (1u << j)) == 0 || !node[j].initialized()) {
+                continue;
+            }
+
+            size_t page = node[j].allocate(count);
+
+            if (page != phys_zone::npos) {
+                return page;
+            }
+        }
+    }
+
+    return phys_zone::npos;
+}
+
+/// \brief Take a single frame from the lock-free stack of a node.
+///
+/// \param node The NUMA node.
+/// \return The page frame number of the page or phys_zone::npos.
+size_t request_stacked_page(size_t node) {
+    if (page_database == nullptr) {
+        return phys_zone::npos;
+    }
+
+    size_t page = free_stacks[node].pop(page_database);
+    return page != frame_stack::npos ? page : phys_zone::npos;
+}
+
+/// \brief Put a single frame on the lock-free stack of its node.
+///
+/// The size check races with other CPUs, so a stack may grow slightly
+/// beyond \ref max_free_stack_size.
+///
+/// \param page The page frame number of the page.
+/// \return True if the frame was stacked, false if the stack is full.
+bool free_stacked_page(size_t page) {
+    if (page >= page_database_size) {
+        return false;
+    }
+
+    frame_stack& stack = free_stacks[node_of(page)];
+
+    if (stack.size() >= max_free_stack_size) {
+        return false;
+    }
+
+    stack.push(page_database, page);
+    return true;
+}
+
+/// \brief Move a batch of pages from the zones into a page cache.
+///
+/// Pages are taken from the local node first, and from the lock-free stack
+/// of a node before its zones.
+///
+/// \param cache The page cache of the current CPU.
+void refill_page_cache(page_cache& cache) {
+    size_t batch = std::min(page_cache_batch, page_cache_size - cache.count);
+    size_t local = numa_current_node();
+
+    for (size_t i = 0; i < allowed_nodes() && batch != 0; ++i) {
+        size_t target = fallback_node(local, i);
+        phys_zone* node = phys_zones[target];
+
+        while (batch != 0) {
+            size_t page = request_stacked_page(target);
+
+            if (page == phys_zone::npos) {
+                break;
+            }
+
+            cache.pages[cache.count++] = page;
+            batch--;
+        }
+
+        for (size_t j = zone_count; j-- > 0 && batch != 0;) {
+            if (!node[j].initialized()) {
+                continue;
+            }
+
+            size_t count =
+                node[j].allocate_batch(cache.pages + cache.count, batch);
+
+            cache.count += count;
+            batch -= count;
+        }
+    }
+
+    cache.refills++;
+}
+
+/// \brief Move pages from a page cache back to their zones.
+///
+/// Enough pages are released to leave room for a full batch of frees. They
+/// go to the lock-free stacks while those have room, and to the zones
+/// otherwise.
+///
+/// \param cache The page cache of the current CPU.
+void drain_page_cache(page_cache& cache) {
+    size_t keep = page_cache_size - std::min(page_cache_batch, page_cache_size);
+
+    if (cache.count <= keep) {
+        return;
+    }
+
+    size_t* pages = cache.pages + keep;
+    size_t count = 0;
+
+    for (size_t i = keep; i < cache.count; ++i) {
+        if (!free_stacked_page(cache.pages[i])) {
+            pages[count++] = cache.pages[i];
+        }
+    }
+
+    // Group the released pages by zone, so that every zone lock is only
+    // taken once and no zone sees the pages of another node's zone
+    while (count != 0) {
+        phys_zone* zone = zone_of(pages[0]);
+        size_t grouped = 1;
+
+        for (size_t i = 1; i < count; ++i) {
+            if (zone_of(pages[i]) == zone) {
+                std::swap(pages[i], pages[grouped++]);
+            }
+        }
+
+        if (zone != nullptr) {
+            zone->free_batch(pages, grouped);
+        }
+
+        pages += grouped;
+        count -= grouped;
+    }
+
+    cache.count = keep;
+    cache.drains++;
+}
+
+/// \brief Take a page from the page cache of the current CPU.
+///
+/// An empty cache is refilled from the zones first.
+///
+/// \return The page frame number of the page or phys_zone::npos.
+size_t request_cached_page() {
+    bool irqs = interrupt_status();
+    interrupt_disable();
+
+    page_cache& cache = *page_caches;
+    size_t page = phys_zone::npos;
+
+    if (cache.count != 0) {
+        cache.hits++;
+    } else {
+        cache.misses++;
+        refill_page_cache(cache);
+    }
+
+    if (cache.count != 0) {
+        page = cache.pages[--cache.count];
+    }
+
+    if (irqs) {
+        interrupt_enable();
+    }
+
+    return page;
+}
+
+/// \brief Put a page into the page cache of the current CPU.
+///
+/// A full cache is drained to the zones first.
+///
+/// \param page The page frame number of the page.
+void free_cached_page(size_t page) {
+    bool irqs = interrupt_status();
+    interrupt_disable();
+
+    page_cache& cache = *page_caches;
+
+    if (cache.count >= page_cache_size) {
+        drain_page_cache(cache);
+    }
+
+    cache.pages[cache.count++] = page;
+
+    if (irqs) {
+        interrupt_enable();
+    }
+}
+
+/// \brief Give freshly allocated frames their first reference.
+///
+/// \param pfn First page frame number.
+/// \param count Number of frames.
+void mark_allocated(size_t pfn, size_t count) {
+    size_t end = std::min(pfn + count, page_database_size);
+
+    for (size_t i = pfn; i < end; ++i) {
+        page_database[i].refcount.store(1, std::memory_order_relaxed);
+    }
+}
+
+/// \brief Reset the page frame database entries of freed frames.
+///
+/// \param pfn First page frame number.
+/// \param count Number of frames.
+void mark_free(size_t pfn, size_t count) {
+    size_t end = std::min(pfn + count, page_database_size);
+
+    for (size_t i = pfn; i < end; ++i) {
+        page_database[i].refcount.store(0, std::memory_order_relaxed);
+        page_database[i].flags &= ~PageHead;
+        page_database[i].order = 0;
+    }
+}
+
+/// \brief Take a page from the pre-zeroed pool of a node.
+///
+/// \param node The NUMA node.
+/// \return The page frame number of the page or phys_zone::npos.
+size_t request_zeroed_page(size_t node) {
+    zero_pool& pool = zeroed_pages[node];
+    utils::scoped_lock guard(pool.lock);
+
+    if (pool.count == 0) {
+        return phys_zone::npos;
+    }
+
+    pool.hits++;
+    return pool.pages[--pool.count];
+}
+
+/// \brief Count a request in the allocation telemetry of its call site.
+///
+/// Sites are hashed into a fixed table and claimed with a compare-exchange,
+/// so recording takes no lock. Once the table is full, requests of new sites
+/// are only counted as untracked.
+///
+/// \param caller Return address of the request.
+/// \param pages Number of pages handed out, 0 if the request failed.
+void record_alloc_site(void* caller, size_t pages) {
+    uintptr_t site = reinterpret_cast<uintptr_t>(caller);
+    size_t slot = ((site * 0x9e3779b97f4a7c15ul) >> 32) % max_alloc_sites;
+
+    for (size_t i = 0; i < max_alloc_sites; ++i) {
+        alloc_site& entry = alloc_sites[(slot + i) % max_alloc_sites];
+        uintptr_t current = entry.site.load(std::memory_order_relaxed);
+
+        if (current == 0) {
+            entry.site.compare_exchange_strong(current, site,
+                                               std::memory_order_relaxed);
+            current = entry.site.load(std::memory_order_relaxed);
+        }
+
+        if (current != site) {
+            continue;
+        }
+
+        entry.calls.fetch_add(1, std::memory_order_relaxed);
+
+        if (pages != 0) {
+            entry.pages.fetch_add(pages, std::memory_order_relaxed);
+        } else {
+            entry.failures.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return;
+    }
+
+    untracked_allocs.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// \brief Request a specific number of pages from the physical memory.
+///
+/// Unconstrained single pages are taken from the local pre-zeroed pool when
+/// zeroed memory is requested, and from the page cache of the current CPU
+/// otherwise, so that they only take a zone lock once per batch. Everything
+/// else is served by the allowed zones directly, preferring the NUMA node of
+/// the current CPU. Zeroing happens without any lock held.
+///
+/// \param count Number of pages to request (default is 1).
+/// \param flags Allocation flags (default is \ref AllocZeroed).
+/// \param zones Zones the pages may come from (default is \ref ZoneMaskAny).
+/// \return A pointer to the allocated memory or nullptr if allocation fails.
+/// \note The memory must be freed using \ref free_page when it is no longer needed.
+void* request_page(size_t count, alloc_flags flags, zone_mask zones) {
+    if (count == 0) {
+        return nullptr;
+    }
+
+    bool zero = (flags & AllocZeroed) != 0;
+    bool cached = count == 1 && zones == ZoneMaskAny;
+    bool prezeroed = false;
+    size_t local = numa_current_node();
+    size_t page = phys_zone::npos;
+
+    if (cached && zero) {
+        page = request_zeroed_page(local);
+        prezeroed = page != phys_zone::npos;
+    }
+
+    if (page == phys_zone::npos && cached && page_cache_size != 0) {
+        page = request_cached_page();
+    }
+
+    if (page == phys_zone::npos && cached) {
+        // Without a cache, the lock-free stacks are the fast path
+        for (size_t i = 0; i < allowed_nodes() && page == phys_zone::npos;
+             ++i) {
+            page = request_stacked_page(fallback_node(local, i));
+        }
+    }
+
+    if (page == phys_zone::npos) {
+        page = request_zone_page(count, zones);
+    }
+
+    if (page == phys_zone::npos && cached) {
+        // Fall back to the pools before giving up, their pages are zeroed
+        for (size_t i = 0; i < allowed_nodes() && page == phys_zone::npos;
+             ++i) {
+            page = request_zeroed_page(fallback_node(local, i));
+        }
+
+        prezeroed = page != phys_zone::npos;
+    }
+
+    if (page == phys_zone::npos && finish_deferred_init()) {
+        // The memory was there, just not published yet
+        page = request_zone_page(count, zones);
+    }
+
+    if (page == phys_zone::npos) {
+        record_alloc_site(__builtin_return_address(0), 0);
+        log_message(LOG_LEVEL_EMERGENCY, "Out of physical memory!");
+        return nullptr;
+    }
+
+    record_alloc_site(__builtin_return_address(0), count);
+    mark_allocated(page, count);
+
+    void* ret = reinterpret_cast<void*>(page * phys_page_size);
+
+    if (zero && !prezeroed) {
+        // Zero out the allocated memory
+        memset(utils::to_higher_half(ret), 0, count * phys_page_size);
+    }
+
+    return ret;
+}
+
+/// \brief Allocate a naturally aligned block straight from the zones.
+///
+/// The zones of the local node are tried first, each node's zones from the
+/// highest to the lowest allowed one.
+///
+/// \param order Order of the block.
+/// \param align Alignment of the block as an order.
+/// \param zones Zones the block may come from.
+/// \return Page frame number of the block, or \ref phys_zone::npos.
+size_t request_zone_block(size_t order, size_t align, zone_mask zones) {
+    size_t local = numa_current_node();
+    size_t page = phys_zone::npos;
+
+    for (size_t i = 0; i < allowed_nodes() && page == phys_zone::npos; ++i) {
+        phys_zone* node = phys_zones[fallback_node(local, i)];
+
+        for (size_t j = zone_count; j-- > 0 && page == phys_zone::npos;) {
+            if ((zones & (1u << j)) != 0 && node[j].initialized()) {
+                page = node[j].allocate_aligned(order, align);
+            }
+        }
+    }
+
+    return page;
+}
+
+/// \brief Request a naturally aligned block of `2^order` contiguous pages.
+///
+/// The zones of the local node are tried first, each node's zones from the
+/// highest to the lowest allowed one. If memory is still being initialized
+/// in the background, the request waits for it before failing.
+///
+/// \param order Order of the block, e.g. 9 for 2 MiB with 4 KiB pages.
+/// \param align Alignment of the block as an order (default is the block's own).
+/// \param flags Allocation flags (default is \ref AllocZeroed).
+/// \param zones Zones the block may come from (default is \ref ZoneMaskAny).
+/// \return A pointer to the allocated memory, or nullptr if no such block is
+///         available.
+void* request_pages(size_t order, size_t align, alloc_flags flags,
+                    zone_mask zones) {
+    size_t frames = highest_usable_memory / phys_page_size;
+
+    // No block or alignment beyond the usable memory can ever be served
+    if (order >= 64 || align >= 64 ||
+        (static_cast<size_t>(1) << std::max(order, align)) > frames) {
+        record_alloc_site(__builtin_return_address(0), 0);
+        return nullptr;
+    }
+
+    size_t count = static_cast<size_t>(1) << order;
+    size_t page = request_zone_block(order, align, zones);
+
+    if (page == phys_zone::npos && finish_deferred_init()) {
+        page = request_zone_block(order, align, zones);
+    }
+
+    if (page == phys_zone::npos) {
+        // Large blocks may be unavailable because of fragmentation alone,
+        // so leave it to the caller to fall back to smaller pages
+        record_alloc_site(__builtin_return_address(0), 0);
+        return nullptr;
+    }
+
+    record_alloc_site(__builtin_return_address(0), count);
+
+    if (page < page_database_size) {
+        // The whole block is referenced through its head frame
+        page_database[page].refcount.store(1, std::memory_order_relaxed);
+        page_database[page].flags |= PageHead;
+        page_database[page].order = order;
+    }
+
+    void* ret = reinterpret_cast<void*>(page * phys_page_size);
+
+    if ((flags & AllocZeroed) != 0) {
+        // Zero out the allocated memory
+        memset(utils::to_higher_half(ret), 0, count * phys_page_size);
+    }
+
+    return ret;
+}
+
+/// \brief Free a block of pages obtained through \ref request_pages.
+///
+/// \param address Pointer to the starting address of the block.
+/// \param order Order of the block.
+void free_pages(void* address, size_t order) {
+    free_page(address, static_cast<size_t>(1) << order);
+}
+
+/// \brief Zero one free page in the background for later zeroed requests.
+///
+/// The page is taken straight from the zones, so the per-CPU cache
+/// statistics only count real requests, and zeroed without holding a lock,
+/// then added to the pre-zeroed pool of its node. Every CPU only fills the
+/// pool of its own node.
+///
+/// \return True if a page was added to a pre-zeroed pool, false if the pool
+///         is full or no memory is available.
+bool phys_zero_idle_page() {
+    {
+        zero_pool& pool = zeroed_pages[numa_current_node()];
+        utils::scoped_lock guard(pool.lock);
+
+        if (pool.count >= zero_pool_size) {
+            return false;
+        }
+    }
+
+    size_t page = request_zone_page(1, ZoneMaskAny);
+
+    if (page == phys_zone::npos) {
+        return false;
+    }
+
+    void* address = reinterpret_cast<void*>(page * phys_page_size);
+    memset(utils::to_higher_half(address), 0, phys_page_size);
+
+    bool pooled = false;
+
+    {
+        zero_pool& pool = zeroed_pages[node_of(page)];
+        utils::scoped_lock guard(pool.lock);
+
+        // Another CPU may have filled the pool in the meantime
+        if (pool.count < zero_pool_size) {
+            pool.pages[pool.count++] = page;
+            pooled = true;
+        }
+    }
+
+    if (!pooled) {
+        zone_of(page)->free(page, 1);
+    }
+
+    return pooled;
+}
+
+/// \brief Free a specific number of pages in the physical memory.
+///
+/// Single pages of the local NUMA node go to the page cache of the current
+/// CPU, other single pages to the lock-free stack of their node. Ranges, and
+/// single pages finding the stack full, are handed back to the zone they
+/// belong to.
+///
+/// A second free of the same pages is caught by the reference count of the
+/// first frame, even while a single page sits in a cache or on a stack.
+///
+/// \param address Pointer to the starting address of the memory to free.
+/// \param count Number of pages to free (default is 1).
+void free_page(void* address, size_t count) {
+    if (address == nullptr || count == 0) {
+        return;
+    }
+
+    // Calculate the page index based on the provided address
+    size_t page = reinterpret_cast<paddr_t>(address) / phys_page_size;
+    phys_zone* zone = zone_of(page);
 
-size_t usable_mem = 0;  ///< Total usable physical memory.
-size_t total_mem = 0;   ///< Total physical memory.
-size_t used_mem = 0;    ///< Total used physical memory.
-}  // namespace
+    if (zone == nullptr) {
+        log_message(LOG_LEVEL_ERROR, "Freeing unmanaged physical page %p.",
+                    address);
+        return;
+    }
 
-// clang-format on
+    // Every allocation hands out its first frame with one reference, which
+    // exactly one of several frees of the same pages takes back
+    bool owned = page < page_database_size
+                     ? page_database[page].refcount.exchange(
+                           0, std::memory_order_acq_rel) == 1
+                     : count != 1 || zone->is_allocated(page);
 
-/// \brief Get information about the physical memory.
+    if (!owned) {
+        log_message(LOG_LEVEL_ERROR,
+                    "Double free of physical pages %p (%lu pages).", address,
+                    count);
+        return;
+    }
+
+    // Reset the entries first, the frames may be reused as soon as they are
+    // handed back
+    mark_free(page, count);
+
+    if (count == 1 && page_cache_size != 0 &&
+        node_of(page) == numa_current_node()) {
+        free_cached_page(page);
+        return;
+    }
+
+    if (count == 1 && free_stacked_page(page)) {
+        return;
+    }
+
+    if (!zone->free(page, count)) {
+        log_message(LOG_LEVEL_ERROR,
+                    "Freeing physical pages %p (%lu pages) which are not "
+                    "allocated.",
+                    address, count);
+    }
+}
+
+/// \brief Get the page frame database entry of a page frame number.
 ///
-/// This function retrieves metadata about the physical memory, including total memory,
-/// used memory, and free memory.
+/// \param pfn The page frame number.
+/// \return Pointer to the entry, or nullptr if the frame is not covered.
+page* pfn_to_page(size_t pfn) {
+    return pfn < page_database_size ? &page_database[pfn] : nullptr;
+}
+
+/// \brief Get the page frame database entry of a physical address.
 ///
-/// \return A structure (\ref phys_metadata_t) containing the following information:
-///   - \c total_memory: The total size of physical memory in bytes.
-///   - \c used_memory: The amount of used physical memory in bytes.
-///   - \c free_memory: The amount of free physical memory in bytes.
-phys_metadata_t get_phys_info() {
-    phys_metadata_t data;
+/// \param address The physical address.
+/// \return Pointer to the entry, or nullptr if the frame is not covered.
+page* phys_to_page(paddr_t address) {
+    return pfn_to_page(address / phys_page_size);
+}
 
-    data.total_memory = total_mem;
-    data.used_memory = used_mem;
-    data.free_memory = total_mem - used_mem;
+/// \brief Get the page frame number of a page frame database entry.
+///
+/// \param frame Pointer to the entry.
+/// \return The page frame number.
+size_t page_to_pfn(const page* frame) {
+    return frame - page_database;
+}
 
-    return data;
+/// \brief Get the physical address of a page frame database entry.
+///
+/// \param frame Pointer to the entry.
+/// \return The physical address of the frame.
+paddr_t page_to_phys(const page* frame) {
+    return page_to_pfn(frame) * phys_page_size;
 }
 
-/// \brief Print physical memory metadata to the log.
+/// \brief Take an additional reference to an allocated frame.
 ///
-/// This function retrieves physical memory metadata using \ref get_phys_info and prints
-/// it to the log with information on total memory, used memory, and free memory.
-void print_metadata() {
-    phys_metadata_t data = get_phys_info();
+/// \param frame Pointer to the entry.
+void page_get(page* frame) {
+    frame->refcount.fetch_add(1, std::memory_order_relaxed);
+}
 
-    log_message(
-        LOG_LEVEL_DEBUG,
-        "Total Memory: %lu MB, Used Memory: %lu MB, Free Memory: %lu MB",
-        bytes_to_mb(data.total_memory), bytes_to_mb(data.used_memory),
-        bytes_to_mb(data.free_memory));
+/// \brief Drop a reference to an allocated frame, freeing it on the last one.
+///
+/// Blocks from \ref request_pages are freed as a whole when the reference
+/// held by their head frame is dropped.
+///
+/// \param frame Pointer to the entry.
+void page_put(page* frame) {
+    if (frame->refcount.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    // The free takes back the reference this dropped
+    frame->refcount.store(1, std::memory_order_relaxed);
+
+    void* address = reinterpret_cast<void*>(page_to_phys(frame));
+
+    if ((frame->flags & PageHead) != 0) {
+        free_pages(address, frame->order);
+    } else {
+        free_page(address, 1);
+    }
 }
 
-/// \brief Request a specific number of pages from the physical memory.
+/// \brief Split a range of page frames at NUMA node and zone boundaries.
 ///
-/// This function attempts to allocate a contiguous block of pages from the physical memory.
+/// \param start First page frame number of the range.
+/// \param end Page frame number one past the end of the range.
+/// \param func Called with the node, the zone type and the first and one past
+///             the last page frame number of every piece.
+template <typename Func>
+void for_each_piece(size_t start, size_t end, Func func) {
+    while (start < end) {
+        paddr_t node_end = 0;
+        size_t node = numa_node_of(start * phys_page_size, &node_end);
+        zone_type zone = zone_type_of(start);
+
+        paddr_t limit = std::min(node_end, zone_limit(zone));
+        size_t last =
+            std::clamp<size_t>(limit / phys_page_size, start + 1, end);
+
+        func(node, zone, start, last);
+        start = last;
+    }
+}
+
+/// \brief Find the region to store the metadata of a node's zones in.
 ///
-/// \param limit The upper limit of pages to search.
-/// \param count Number of pages to request.
-/// \return A pointer to the allocated memory or nullptr if allocation fails.
-void* request_page_(size_t limit, size_t count) {
-    size_t i = 0;
+/// The highest usable region of the node large enough to hold the metadata
+/// is preferred, to keep it local and the low zones free for the devices
+/// which depend on them. If the node has no such region, the highest one of
+/// any node is used.
+///
+/// \param bootinfo Pointer to the boot information.
+/// \param node The NUMA node.
+/// \param size Size of the metadata in bytes.
+/// \return The memory map entry, or nullptr if no region is large enough.
+memory_map* find_metadata_region(bootinfo_t* bootinfo, size_t node,
+                                 size_t size) {
+    memory_map* fallback = nullptr;
 
-    while (last_index < limit) {
-        if (!phys_bitmap[last_index++]) {
-            if (++i == count) {
-                size_t page = last_index - count;
+    for (size_t i = bootinfo->memmap_size; i-- > 0;) {
+        memory_map* entry = bootinfo->memmaps[i];
 
-                // Mark the allocated pages as used in the bitmap
-                for (size_t j = page; j < last_index; ++j) {
-                    phys_bitmap[j] = true;
-                }
+        if (entry->type != MEMORY_MAP_USABLE || entry->length < size) {
+            continue;
+        }
 
-                return reinterpret_cast<void*>(page * phys_page_size);
-            }
-        } else {
-            i = 0;
+        paddr_t node_end = 0;
+
+        if (numa_node_of(entry->base, &node_end) == node &&
+            entry->base + size <= node_end) {
+            return entry;
+        }
+
+        if (fallback == nullptr) {
+            fallback = entry;
         }
     }
 
-    return nullptr;
+    return fallback;
 }
 
-/// \brief Request a specific number of pages from the physical memory.
+/// \brief Assign a range of managed frames to their zone in the page frame
+///        database.
 ///
-/// This function is a synchronized wrapper for \ref request_page_.
+/// \param node The NUMA node of the frames.
+/// \param zone The zone type of the frames.
+/// \param first First page frame number.
+/// \param last Page frame number one past the last frame.
+void claim_pages(size_t node, zone_type zone, size_t first, size_t last) {
+    last = std::min(last, page_database_size);
+
+    for (size_t i = first; i < last; ++i) {
+        page_database[i].flags &= ~PageReserved;
+        page_database[i].zone = node * zone_count + zone;
+    }
+}
+
+/// \brief Place the page frame database.
 ///
-/// \param count Number of pages to request (default is 1).
-/// \return A pointer to the allocated memory or nullptr if allocation fails.
-/// \note The memory must be freed using \ref free_page when it is no longer needed.
-void* request_page(size_t count) {
-    if (count == 0) {
-        return nullptr;
+/// The database is carved out of the memory map like the zones' metadata,
+/// so the frames holding it are never handed to the zones. Its entries are
+/// filled in chunk by chunk by \ref initialize_chunk.
+///
+/// \param bootinfo Pointer to the boot information.
+/// \param frames Number of frames to cover.
+void place_page_database(bootinfo_t* bootinfo, size_t frames) {
+    size_t size = utils::align_up(frames * sizeof(page), phys_page_size);
+    memory_map* entry = find_metadata_region(bootinfo, 0, size);
+
+    if (entry == nullptr) {
+        log_message(LOG_LEVEL_ERROR,
+                    "No room for the page frame database (%lu bytes).", size);
+        return;
     }
 
-    utils::scoped_lock guard(phys_lock);
+    page_database =
+        reinterpret_cast<page*>(utils::to_higher_half(entry->base));
+    page_database_size = frames;
+
+    entry->base += size;
+    entry->length -= size;
+    reserved_mem += size;
 
-    size_t i = last_index;
-    void* ret = request_page_(highest_usable_memory / phys_page_size, count);
+    log_message(LOG_LEVEL_DEBUG,
+                "Page frame database stored @ %p (%lu frames, %lu KiB, %lu "
+                "bytes per frame).",
+                page_database, frames, size / 1024, sizeof(page));
+}
+
+/// \brief Initialize one chunk of physical memory.
+///
+/// The chunk's page frame database entries are reset, its usable frames are
+/// claimed by their zones and then published to the allocator. Chunks are
+/// disjoint, so they may be initialized concurrently; only publishing takes
+/// the zones' locks.
+///
+/// \param chunk Index of the chunk.
+void initialize_chunk(size_t chunk) {
+    size_t base = chunk * init_chunk_frames;
+    size_t limit = base + init_chunk_frames;
+    size_t entries = std::min(limit, page_database_size);
 
-    if (ret == nullptr) {
-        // Reset last_index and try again from the beginning
-        last_index = 0;
-        ret = request_page_(i, count);
+    if (page_database != nullptr && base < entries) {
+        memset(&page_database[base], 0, (entries - base) * sizeof(page));
 
-        if (ret == nullptr) {
-            log_message(LOG_LEVEL_EMERGENCY, "Out of physical memory!");
+        for (size_t i = base; i < entries; ++i) {
+            page_database[i].flags = PageReserved;
         }
     }
 
-    // Zero out the allocated memory
-    memset(utils::to_higher_half(ret), 0, count * phys_page_size);
-    used_mem += (count * phys_page_size);
+    for (size_t i = 0; i < init_range_count; ++i) {
+        size_t start = std::max(init_ranges[i].start, base);
+        size_t end = std::min(init_ranges[i].end, limit);
 
-    return ret;
+        if (start >= end) {
+            continue;
+        }
+
+        for_each_piece(start, end,
+                       [](size_t node, zone_type zone, size_t first,
+                          size_t last) {
+                           if (phys_zones[node][zone].initialized()) {
+                               claim_pages(node, zone, first, last);
+                               phys_zones[node][zone].add_range(first,
+                                                                last - first);
+                           }
+                       });
+    }
 }
 
-/// \brief Free a specific number of pages in the physical memory.
+/// \brief Initialize deferred chunks until none is left to take.
+void run_deferred_chunks() {
+    while (true) {
+        size_t chunk = next_init_chunk.fetch_add(1, std::memory_order_relaxed);
+
+        if (chunk >= init_chunk_count) {
+            return;
+        }
+
+        uint64_t start = x86_rdtsc();
+
+        initialize_chunk(chunk);
+
+        init_chunk_ticks.fetch_add(x86_rdtsc() - start,
+                                   std::memory_order_relaxed);
+        done_init_chunks.fetch_add(1, std::memory_order_release);
+    }
+}
+
+/// \brief Work of the application processors helping with the deferred
+///        initialization.
 ///
-/// This function marks a range of pages as free in the physical memory bitmap.
+/// Once there is nothing left to do, the processor returns to its idle loop.
 ///
-/// \param address Pointer to the starting address of the memory to free.
-/// \param count Number of pages to free (default is 1).
-void free_page(void* address, size_t count) {
-    if (address == nullptr) {
-        return;
+/// \param argument Unused.
+void deferred_init_worker(void* argument) {
+    (void)argument;
+
+    run_deferred_chunks();
+    parked_init_workers.fetch_add(1, std::memory_order_release);
+}
+
+/// \brief Let the application processors initialize the deferred chunks.
+void start_deferred_init() {
+    deferred_init_start = x86_rdtsc();
+    deferred_init_pending.store(true, std::memory_order_release);
+
+    for (size_t cpu = 1; cpu < arch::smp_cpu_count(); ++cpu) {
+        if (arch::smp_call(cpu, deferred_init_worker, nullptr)) {
+            init_workers++;
+        }
     }
+}
 
-    utils::scoped_lock guard(phys_lock);
+/// \brief Wait for the deferred initialization, taking part in it.
+///
+/// Any CPU may call this when an allocation fails. It helps with the chunks
+/// left and waits until every chunk is published, but only the bootstrap
+/// processor waits for the helpers to park, as the current CPU may be one of
+/// them, and ends the deferred initialization.
+///
+/// \return True if the caller should retry its allocation, false if the
+///         deferred initialization was already done.
+bool finish_deferred_init() {
+    if (!deferred_init_pending.load(std::memory_order_acquire)) {
+        return false;
+    }
 
-    // Calculate the page index based on the provided address
-    size_t page = reinterpret_cast<paddr_t>(address) / phys_page_size;
+    uint64_t wait_start = x86_rdtsc();
+
+    run_deferred_chunks();
+
+    // Chunks are never dropped halfway, whoever took them finishes them
+    while (done_init_chunks.load(std::memory_order_acquire) <
+           init_chunk_count) {
+        pause();
+    }
+
+    if (arch_current_cpu() != 0) {
+        return true;
+    }
+
+    while (parked_init_workers.load(std::memory_order_acquire) <
+           init_workers) {
+        pause();
+    }
 
-    // Mark the pages as free in the bitmap
-    for (size_t i = page; i < (page + count); ++i) {
-        phys_bitmap[i] = true;
+    if (!deferred_init_pending.exchange(false, std::memory_order_acq_rel)) {
+        return true;
     }
 
-    // Update used memory count
-    used_mem -= count * phys_page_size;
+    uint64_t end = x86_rdtsc();
+    uint64_t work = arch::tsc_to_ns(init_chunk_ticks.load());
+    uint64_t waited = arch::tsc_to_ns(end - wait_start);
+
+    log_message(LOG_LEVEL_INFO,
+                "Deferred memory initialization done after %lu us: %lu "
+                "us of work on %lu helper CPU(s), BSP waited %lu us.",
+                arch::tsc_to_ns(end - deferred_init_start) / 1000,
+                work / 1000, init_workers, waited / 1000);
+
+    print_metadata();
+    return true;
 }
 
 /// \brief Initialize physical memory management.
 ///
 /// This function initializes the physical memory manager using the provided boot information
-/// and sets the size of a physical memory page.
+/// and sets the size of a physical memory page. Usable memory is split into
+/// the DMA, DMA32 and Normal zones of every NUMA node, whose metadata is
+/// placed on the node itself whenever possible.
 ///
 /// \param bootinfo Pointer to the boot information.
 /// \param page_size Size of a physical memory page.
 void phys_initialize(bootinfo_t* bootinfo, size_t page_size) {
+    uint64_t start_ticks = x86_rdtsc();
+
     phys_page_size = page_size;
     paddr_t top_mem = 0;
 
     // Initialize utils library with boot information
     utils::initialize(bootinfo);
 
+    // Remember the bootloader's page tables, the kernel may replace them
+    boot_page_tables = utils::align_down(x86_get_cr3(), 0x1000ul);
+
+    // Discover which memory belongs to which node
+    numa_initialize();
+
     // Iterate through the memory map provided by the bootloader
     for (size_t i = 0; i < bootinfo->memmap_size; ++i) {
         paddr_t top = bootinfo->memmaps[i]->base + bootinfo->memmaps[i]->length;
@@ -175,7 +1411,7 @@ void phys_initialize(bootinfo_t* bootinfo, size_t page_size) {
                 break;
             case MEMORY_MAP_KERNEL_AND_MODULES:
             case MEMORY_MAP_BOOTLOADER_RECLAIMABLE:
-                used_mem += bootinfo->memmaps[i]->length;
+                reserved_mem += bootinfo->memmaps[i]->length;
                 break;
             default:
                 continue;
@@ -184,54 +1420,345 @@ void phys_initialize(bootinfo_t* bootinfo, size_t page_size) {
         total_mem += bootinfo->memmaps[i]->length;
     }
 
-    // Calculate the number of entries needed for the physical memory bitmap
-    size_t bitmap_entries = highest_usable_memory / page_size;
-    size_t bitmap_size = utils::align_up(bitmap_entries / 8, page_size);
-    bitmap_entries = bitmap_size * 8;
+    // Calculate the frame range of every zone from the usable memory it holds
+    size_t zone_base[max_numa_nodes][zone_count];
+    size_t zone_end[max_numa_nodes][zone_count] = {};
+    size_t zone_metadata[max_numa_nodes][zone_count] = {};
+    size_t node_metadata[max_numa_nodes] = {};
+
+    for (size_t i = 0; i < max_numa_nodes; ++i) {
+        for (size_t j = 0; j < zone_count; ++j) {
+            zone_base[i][j] = ~static_cast<size_t>(0);
+        }
+    }
 
-    // Find a suitable region in usable memory for the physical memory bitmap
     for (size_t i = 0; i < bootinfo->memmap_size; ++i) {
-        if (bootinfo->memmaps[i]->type != MEMORY_MAP_USABLE) {
+        // Bootloader memory joins the zones once it is reclaimed
+        if (bootinfo->memmaps[i]->type != MEMORY_MAP_USABLE &&
+            bootinfo->memmaps[i]->type != MEMORY_MAP_BOOTLOADER_RECLAIMABLE) {
+            continue;
+        }
+
+        size_t start = bootinfo->memmaps[i]->base / page_size;
+        size_t end = start + bootinfo->memmaps[i]->length / page_size;
+
+        for_each_piece(start, end,
+                       [&](size_t node, zone_type zone, size_t first,
+                           size_t last) {
+                           zone_base[node][zone] =
+                               std::min(zone_base[node][zone], first);
+                           zone_end[node][zone] =
+                               std::max(zone_end[node][zone], last);
+                       });
+    }
+
+    for (size_t i = 0; i < numa_node_count(); ++i) {
+        for (size_t j = 0; j < zone_count; ++j) {
+            if (zone_base[i][j] >= zone_end[i][j]) {
+                continue;
+            }
+
+            zone_metadata[i][j] = utils::align_up(
+                phys_zone::metadata_size(zone_base[i][j], zone_end[i][j],
+                                         page_size),
+                page_size);
+            node_metadata[i] += zone_metadata[i][j];
+        }
+    }
+
+    // Place the metadata of every node's zones, preferably on the node itself
+    for (size_t i = 0; i < numa_node_count(); ++i) {
+        if (node_metadata[i] == 0) {
+            continue;
+        }
+
+        memory_map* entry =
+            find_metadata_region(bootinfo, i, node_metadata[i]);
+
+        if (entry == nullptr) {
+            log_message(LOG_LEVEL_ERROR,
+                        "No room for the metadata of node %lu (%lu bytes).",
+                        i, node_metadata[i]);
             continue;
         }
 
-        // If the region is large enough for the bitmap, initialize it
-        if (bootinfo->memmaps[i]->length >= bitmap_size) {
-            phys_bitmap.initialize(
-                reinterpret_cast<uint8_t*>(
-                    utils::to_higher_half(bootinfo->memmaps[i]->base)),
-                bitmap_entries);
+        for (size_t j = 0; j < zone_count; ++j) {
+            if (zone_metadata[i][j] == 0) {
+                continue;
+            }
+
+            void* metadata =
+                reinterpret_cast<void*>(utils::to_higher_half(entry->base));
+
+            phys_zones[i][j].initialize(zone_names[j], zone_base[i][j],
+                                        zone_end[i][j], page_size, metadata);
 
-            // Set all bitmap entries to 1 (indicating used)
-            memset(phys_bitmap.data(), 0xFF, bitmap_entries);
+            log_message(LOG_LEVEL_DEBUG,
+                        "Node %lu zone %s metadata stored @ %p (%lu bytes, "
+                        "bitmap %lu bytes, index %lu bytes).",
+                        i, zone_names[j], metadata, zone_metadata[i][j],
+                        phys_zones[i][j].bitmap_bytes(),
+                        phys_zones[i][j].index_bytes());
 
             // Adjust the length and base of the region
-            bootinfo->memmaps[i]->length -= bitmap_size;
-            bootinfo->memmaps[i]->base += bitmap_size;
+            entry->base += zone_metadata[i][j];
+            entry->length -= zone_metadata[i][j];
+        }
+
+        // Update used memory count
+        reserved_mem += node_metadata[i];
+    }
 
-            // Update used memory count
-            used_mem += bitmap_size;
+    // Cover every frame up to the end of the highest zone
+    size_t frames = 0;
 
-            break;
+    for (size_t i = 0; i < numa_node_count(); ++i) {
+        for (size_t j = 0; j < zone_count; ++j) {
+            if (phys_zones[i][j].initialized()) {
+                frames = std::max(frames, zone_end[i][j]);
+            }
         }
     }
 
-    // Mark pages as free in the bitmap based on usable memory regions
+    place_page_database(bootinfo, frames);
+
+    // Keep the usable regions, the memory map lives in bootloader memory
     for (size_t i = 0; i < bootinfo->memmap_size; ++i) {
-        if (bootinfo->memmaps[i]->type != MEMORY_MAP_USABLE) {
+        if (bootinfo->memmaps[i]->type != MEMORY_MAP_USABLE ||
+            init_range_count == max_boot_memmap_entries) {
+            continue;
+        }
+
+        size_t start = bootinfo->memmaps[i]->base / page_size;
+        size_t end = start + bootinfo->memmaps[i]->length / page_size;
+
+        init_ranges[init_range_count++] = {start, end};
+    }
+
+    // Hand the low memory over to the zones right away, enough to keep
+    // booting, and leave the rest to the application processors
+    size_t eager_chunks = utils::div_roundup(eager_init_memory / page_size,
+                                             init_chunk_frames);
+
+    init_chunk_count = utils::div_roundup(frames, init_chunk_frames);
+    eager_chunks = std::min(eager_chunks, init_chunk_count);
+
+    for (size_t i = 0; i < eager_chunks; ++i) {
+        initialize_chunk(i);
+    }
+
+    next_init_chunk.store(eager_chunks, std::memory_order_relaxed);
+    done_init_chunks.store(eager_chunks, std::memory_order_relaxed);
+
+    if (eager_chunks < init_chunk_count) {
+        start_deferred_init();
+    }
+
+    uint64_t elapsed = arch::tsc_to_ns(x86_rdtsc() - start_ticks);
+
+    if (eager_chunks == init_chunk_count) {
+        print_metadata();
+    }
+
+    log_message(LOG_LEVEL_INFO,
+                "Successfully initialized Physical Memory Manager in %lu us "
+                "(%lu of %lu chunks deferred to %lu CPU(s)).",
+                elapsed / 1000, init_chunk_count - eager_chunks,
+                init_chunk_count, init_workers);
+}
+
+/// \brief Record the frames of a page table hierarchy.
+///
+/// \param table Physical address of the table.
+/// \param level Paging level of the table, 4 for the PML4.
+/// \return False if there are too many frames to keep track of.
+bool collect_boot_tables(paddr_t table, size_t level) {
+    constexpr uint64_t page_present = 1ul << 0;
+    constexpr uint64_t page_huge = 1ul << 7;
+    constexpr uint64_t page_address_mask = 0x000FFFFFFFFFF000ul;
+
+    if (boot_table_count == max_boot_table_frames) {
+        return false;
+    }
+
+    boot_table_frames[boot_table_count++] = table / phys_page_size;
+
+    if (level == 1) {
+        return true;
+    }
+
+    const uint64_t* entries =
+        reinterpret_cast<const uint64_t*>(utils::to_higher_half(table));
+
+    for (size_t i = 0; i < 512; ++i) {
+        if ((entries[i] & page_present) == 0 ||
+            (level != 4 && (entries[i] & page_huge) != 0)) {
             continue;
         }
 
-        for (paddr_t j = 0; j < bootinfo->memmaps[i]->length; j += page_size) {
-            phys_bitmap[(bootinfo->memmaps[i]->base + j) / page_size] = false;
+        if (!collect_boot_tables(entries[i] & page_address_mask, level - 1)) {
+            return false;
         }
     }
 
-    // Log information about the physical memory bitmap and print metadata
-    log_message(LOG_LEVEL_DEBUG, "Bitmap stored @ %p (%lu entries).",
-                phys_bitmap.data(), bitmap_entries);
-    print_metadata();
+    return true;
+}
+
+/// \brief Check if a frame holds one of the active page tables.
+///
+/// \param page The page frame number.
+/// \return True if the frame holds a page table, false otherwise.
+bool is_boot_table(size_t page) {
+    for (size_t i = 0; i < boot_table_count; ++i) {
+        if (boot_table_frames[i] == page) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// \brief Hand a range of reclaimed frames over to the zones.
+///
+/// Frames outside of every zone stay reserved and are left out of the
+/// statistics.
+///
+/// \param start First page frame number of the range.
+/// \param end Page frame number one past the end of the range.
+void reclaim_range(size_t start, size_t end) {
+    size_t added = 0;
+
+    for_each_piece(start, end,
+                   [&added](size_t node, zone_type zone, size_t first,
+                            size_t last) {
+                       phys_zone& target = phys_zones[node][zone];
+
+                       if (target.initialized() && target.contains(first)) {
+                           target.add_range(first, last - first);
+                           claim_pages(node, zone, first, last);
+                           added += last - first;
+                       }
+                   });
+
+    reclaimed_mem += added * phys_page_size;
+    reserved_mem -= added * phys_page_size;
+    usable_mem += added * phys_page_size;
+}
+
+/// \brief Hand the bootloader-reclaimable memory over to the allocator.
+///
+/// The memory map, the bootloader's name and version and the kernel command
+/// line are copied into kernel memory first, and the boot information is
+/// updated to point to the copies. The kernel still runs on the bootloader's
+/// page tables unless the kernel's own were loaded, so the frames holding
+/// them stay reserved. The deferred initialization of physical memory is
+/// finished first, and every processor has to have left the bootloader's
+/// stacks, otherwise nothing is reclaimed.
+///
+/// \param bootinfo Pointer to the boot information.
+void phys_reclaim_bootloader_memory(bootinfo_t* bootinfo) {
+    // The helpers read the bootloader's structures, and the application
+    // processors may still run on its stacks
+    finish_deferred_init();
+
+    if (!arch::smp_wait_for_aps()) {
+        log_message(LOG_LEVEL_WARNING,
+                    "Application processors still run on the bootloader's "
+                    "stacks, keeping all bootloader memory.");
+        return;
+    }
+
+    if (bootinfo->stack_top != 0) {
+        log_message(LOG_LEVEL_WARNING,
+                    "The bootstrap processor still runs on the bootloader's "
+                    "stack, keeping all bootloader memory.");
+        return;
+    }
+
+    uint64_t start_ticks = x86_rdtsc();
+    size_t used_before = get_phys_info().used_memory;
+
+    // Copy out everything the kernel still needs from the bootloader memory
+    size_t count = std::min(bootinfo->memmap_size, max_boot_memmap_entries);
+
+    for (size_t i = 0; i < count; ++i) {
+        boot_memmap[i] = *bootinfo->memmaps[i];
+        boot_memmap_entries[i] = &boot_memmap[i];
+    }
+
+    bootinfo->memmaps = boot_memmap_entries;
+    bootinfo->memmap_size = count;
+
+    strncpy(boot_loader_name, bootinfo->bootloader.name,
+            sizeof(boot_loader_name) - 1);
+    strncpy(boot_loader_version, bootinfo->bootloader.version,
+            sizeof(boot_loader_version) - 1);
+
+    bootinfo->bootloader.name = boot_loader_name;
+    bootinfo->bootloader.version = boot_loader_version;
+
+    if (bootinfo->cmdline != nullptr) {
+        strncpy(boot_cmdline, bootinfo->cmdline, sizeof(boot_cmdline) - 1);
+        bootinfo->cmdline = boot_cmdline;
+    }
+
+    // The processors' entries are gone with the bootloader memory
+    bootinfo->cpus = nullptr;
+
+    // Once the kernel runs on its own page tables, the bootloader's are unused
+    paddr_t tables = utils::align_down(x86_get_cr3(), 0x1000ul);
+
+    if (tables == boot_page_tables && !collect_boot_tables(tables, 4)) {
+        log_message(LOG_LEVEL_WARNING,
+                    "Too many bootloader page tables, keeping all bootloader "
+                    "memory.");
+        return;
+    }
+
+    size_t kept_pages = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        memory_map* entry = bootinfo->memmaps[i];
+
+        if (entry->type != MEMORY_MAP_BOOTLOADER_RECLAIMABLE) {
+            continue;
+        }
+
+        size_t start = entry->base / phys_page_size;
+        size_t end = start + entry->length / phys_page_size;
+        size_t run = start;
+        size_t kept = 0;
+
+        for (size_t page = start; page < end; ++page) {
+            if (is_boot_table(page)) {
+                if (run < page) {
+                    reclaim_range(run, page);
+                }
+
+                run = page + 1;
+                kept++;
+            }
+        }
+
+        if (run < end) {
+            reclaim_range(run, end);
+        }
+
+        if (kept == 0) {
+            entry->type = MEMORY_MAP_USABLE;
+        }
+
+        kept_pages += kept;
+    }
+
+    size_t used_after = get_phys_info().used_memory;
+    uint64_t elapsed = arch::tsc_to_ns(x86_rdtsc() - start_ticks);
+
     log_message(LOG_LEVEL_INFO,
-                "Successfully initialized Physical Memory Manager.");
+                "Reclaimed %lu KiB of bootloader memory, kept %lu KiB "
+                "(used %lu MB -> %lu MB) in %lu us.",
+                reclaimed_mem / 1024, (kept_pages * phys_page_size) / 1024,
+                bytes_to_mb(used_before), bytes_to_mb(used_after),
+                elapsed / 1000);
 }
-}  // namespace memory
\ No newline at end of file
+}  // namespace memory
@@ -0,0 +1,999 @@
+#include <arch/arch.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include <cpu/smp.hpp>
+#include <cpu/tsc.hpp>
+#include <memory/pmm.hpp>
+#include <memory/pmm_bench.hpp>
+#include <memory/vmalloc.hpp>
+#include <memory/vmm.hpp>
+
+#include <utils/misc.hpp>
+#include <utils/mutex.hpp>
+
+namespace memory {
+// clang-format off
+
+namespace {
+/// Number of linear sub-buckets per power of two in a latency histogram.
+constexpr size_t histogram_sub_bits = 3;
+constexpr size_t histogram_sub_buckets = 1 << histogram_sub_bits;
+
+/// Number of buckets needed to cover every 64-bit cycle count.
+constexpr size_t histogram_buckets = (64 - histogram_sub_bits + 1) * histogram_sub_buckets;
+
+/// Log-linear histogram of latencies in TSC cycles.
+///
+/// Every power of two is split into \ref histogram_sub_buckets buckets, so a
+/// percentile is off by at most 12.5% while the histogram stays small.
+struct latency_histogram {
+    uint64_t buckets[histogram_buckets];  ///< Number of samples per bucket.
+    uint64_t count;   ///< Number of samples.
+    uint64_t total;   ///< Sum of all samples.
+    uint64_t max;     ///< Largest sample.
+};
+
+latency_histogram alloc_latency;  ///< Latencies of the allocations of a workload.
+latency_histogram free_latency;   ///< Latencies of the frees of a workload.
+
+/// Results of one CPU running the contention workload.
+struct contention_results {
+    latency_histogram alloc;  ///< Latencies of the allocations.
+    latency_histogram free;   ///< Latencies of the frees.
+    size_t failures;          ///< Number of failed allocations.
+};
+
+/// Results of one CPU running the stress workload.
+struct stress_results {
+    size_t operations;  ///< Number of allocations and frees.
+    size_t failures;    ///< Number of failed allocations.
+    size_t duplicates;  ///< Frames handed out while already handed out.
+};
+
+/// Allocation held by the stress workload.
+struct stress_slot {
+    void* address;  ///< Physical address, nullptr if the slot is empty.
+    size_t count;   ///< Number of pages.
+};
+
+/// Results of one CPU running the lock workload.
+struct lock_results {
+    latency_histogram acquire;  ///< Latencies of the acquisitions.
+};
+
+std::atomic<size_t> workers_waiting = 0;  ///< CPUs waiting for a multi-CPU workload to start.
+std::atomic<bool> workers_started = false;  ///< Whether a multi-CPU workload started.
+
+alignas(64) utils::ticket_spinlock ticket_lock;  ///< Ticket lock of the lock workload.
+alignas(64) utils::queued_spinlock queued_lock;  ///< Queued lock of the lock workload.
+alignas(64) size_t lock_counter = 0;  ///< Counter incremented under the lock by the lock workload.
+void* lock_target = nullptr;  ///< The lock the lock workload currently contends on.
+std::atomic<uint64_t>* stress_claims = nullptr;  ///< One bit per frame, set while the stress workload holds the frame.
+
+uint64_t rng_state = 0x9E3779B97F4A7C15;  ///< State of the workloads' random number generator.
+
+constexpr size_t churn_iterations = 100000;  ///< Allocations of the churn workload.
+constexpr size_t mixed_iterations = 50000;   ///< Operations of the mixed-order workload.
+constexpr size_t mixed_slots = 256;          ///< Blocks held at once by the mixed-order workload.
+constexpr size_t mixed_max_order = 9;        ///< Largest order of the mixed-order workload.
+constexpr size_t frag_max_pages = 32768;     ///< Single pages allocated to fragment memory.
+constexpr size_t frag_large_order = 9;       ///< Order of the large allocations after fragmenting.
+constexpr size_t frag_large_count = 64;      ///< Large allocations attempted after fragmenting.
+constexpr size_t contention_batch = 32;      ///< Pages held at once per CPU by the contention workload.
+constexpr size_t stress_iterations = 50000;  ///< Operations per CPU of the stress workload.
+constexpr size_t stress_slots = 64;          ///< Allocations held at once per CPU by the stress workload.
+constexpr size_t stress_max_pages = 8;       ///< Largest multi-page allocation of the stress workload.
+constexpr size_t lock_iterations = 20000;    ///< Acquisitions per CPU of the lock workload.
+constexpr size_t lock_max_cpus = 16;         ///< Most CPUs contending in the lock workload.
+constexpr size_t switch_iterations = 10000;  ///< Round trips between two spaces of the switch workload.
+constexpr size_t switch_order = 6;           ///< Order of the block touched after every switch.
+constexpr size_t switch_pages = 1 << switch_order;  ///< Pages touched after every switch.
+constexpr vaddr_t switch_base = 0x400000;    ///< Where the switch workload maps its pages.
+constexpr size_t fault_pages = 4096;         ///< Pages of the lazy buffer of the fault workload.
+constexpr size_t blit_iterations = 16;       ///< Full frames copied per cache type by the blit workload.
+}  // namespace
+
+// clang-format on
+
+/// \brief Get the next number of the workloads' random number generator.
+///
+/// \return A pseudo-random number (xorshift64).
+uint64_t bench_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/// \brief Get the bucket of a latency.
+///
+/// \param cycles The latency in TSC cycles.
+/// \return Index of the bucket.
+size_t histogram_bucket(uint64_t cycles) {
+    if (cycles < histogram_sub_buckets) {
+        return cycles;
+    }
+
+    size_t exponent = 63 - __builtin_clzll(cycles);
+    size_t sub = (cycles >> (exponent - histogram_sub_bits)) &
+                 (histogram_sub_buckets - 1);
+
+    return (exponent - histogram_sub_bits + 1) * histogram_sub_buckets + sub;
+}
+
+/// \brief Get the smallest latency of a bucket.
+///
+/// \param bucket Index of the bucket.
+/// \return The latency in TSC cycles.
+uint64_t histogram_bucket_base(size_t bucket) {
+    if (bucket < histogram_sub_buckets) {
+        return bucket;
+    }
+
+    size_t exponent = bucket / histogram_sub_buckets + histogram_sub_bits - 1;
+    uint64_t sub = bucket % histogram_sub_buckets;
+
+    return (histogram_sub_buckets + sub) << (exponent - histogram_sub_bits);
+}
+
+/// \brief Record a latency.
+///
+/// \param histogram The histogram.
+/// \param cycles The latency in TSC cycles.
+void histogram_record(latency_histogram& histogram, uint64_t cycles) {
+    histogram.buckets[histogram_bucket(cycles)]++;
+    histogram.count++;
+    histogram.total += cycles;
+
+    if (cycles > histogram.max) {
+        histogram.max = cycles;
+    }
+}
+
+/// \brief Get a percentile of the recorded latencies.
+///
+/// \param histogram The histogram.
+/// \param permille The percentile in tenths of a percent, e.g. 999.
+/// \return The smallest latency of the bucket holding the percentile, in TSC
+///         cycles.
+uint64_t histogram_percentile(const latency_histogram& histogram,
+                              uint64_t permille) {
+    uint64_t rank = utils::div_roundup(histogram.count * permille, 1000);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < histogram_buckets; ++i) {
+        seen += histogram.buckets[i];
+
+        if (seen >= rank && seen != 0) {
+            return histogram_bucket_base(i);
+        }
+    }
+
+    return histogram.max;
+}
+
+/// \brief Print the results of one operation of a workload.
+///
+/// \param workload Name of the workload.
+/// \param operation Name of the operation.
+/// \param histogram The recorded latencies.
+/// \param failures Number of failed operations.
+void print_result(const char* workload, const char* operation,
+                  const latency_histogram& histogram, size_t failures) {
+    uint64_t total_ns = arch::tsc_to_ns(histogram.total);
+    uint64_t ops_per_sec =
+        total_ns != 0 ? (histogram.count * 1000000000) / total_ns : 0;
+
+    printf("pmm-bench workload=%s op=%s count=%lu failures=%lu "
+           "total_ns=%lu ops_per_sec=%lu p50_ns=%lu p99_ns=%lu "
+           "p999_ns=%lu max_ns=%lu\n",
+           workload, operation, histogram.count, failures, total_ns,
+           ops_per_sec, arch::tsc_to_ns(histogram_percentile(histogram, 500)),
+           arch::tsc_to_ns(histogram_percentile(histogram, 990)),
+           arch::tsc_to_ns(histogram_percentile(histogram, 999)),
+           arch::tsc_to_ns(histogram.max));
+}
+
+/// \brief Clear the histograms before a workload.
+void reset_histograms() {
+    memset(&alloc_latency, 0, sizeof(alloc_latency));
+    memset(&free_latency, 0, sizeof(free_latency));
+}
+
+/// \brief Allocate a single page and record the latency.
+///
+/// \return The page, or nullptr on failure.
+void* timed_request_page() {
+    uint64_t start = x86_rdtsc();
+    void* page = request_page(1, AllocAny);
+    histogram_record(alloc_latency, x86_rdtsc() - start);
+
+    return page;
+}
+
+/// \brief Free a single page and record the latency.
+///
+/// \param page The page.
+void timed_free_page(void* page) {
+    uint64_t start = x86_rdtsc();
+    free_page(page);
+    histogram_record(free_latency, x86_rdtsc() - start);
+}
+
+/// \brief Allocate and immediately free single pages.
+///
+/// This is the best case of the allocator, every page should come straight
+/// from the per-CPU cache.
+void bench_churn() {
+    size_t failures = 0;
+
+    reset_histograms();
+
+    for (size_t i = 0; i < churn_iterations; ++i) {
+        void* page = timed_request_page();
+
+        if (page == nullptr) {
+            failures++;
+            continue;
+        }
+
+        timed_free_page(page);
+    }
+
+    print_result("churn", "alloc", alloc_latency, failures);
+    print_result("churn", "free", free_latency, 0);
+}
+
+/// \brief Allocate and free blocks of random orders in random order.
+///
+/// The workload keeps up to \ref mixed_slots blocks of order 0 to
+/// \ref mixed_max_order alive, and either frees or fills a random slot.
+void bench_mixed() {
+    void* blocks[mixed_slots] = {};
+    uint8_t orders[mixed_slots] = {};
+    size_t failures = 0;
+
+    reset_histograms();
+
+    for (size_t i = 0; i < mixed_iterations; ++i) {
+        size_t slot = bench_random() % mixed_slots;
+        uint64_t start = x86_rdtsc();
+
+        if (blocks[slot] != nullptr) {
+            free_pages(blocks[slot], orders[slot]);
+            histogram_record(free_latency, x86_rdtsc() - start);
+
+            blocks[slot] = nullptr;
+            continue;
+        }
+
+        size_t order = bench_random() % (mixed_max_order + 1);
+
+        start = x86_rdtsc();
+        blocks[slot] = request_pages(order, 0, AllocAny);
+        histogram_record(alloc_latency, x86_rdtsc() - start);
+
+        orders[slot] = order;
+        failures += blocks[slot] == nullptr;
+    }
+
+    for (size_t i = 0; i < mixed_slots; ++i) {
+        if (blocks[i] != nullptr) {
+            free_pages(blocks[i], orders[i]);
+        }
+    }
+
+    print_result("mixed", "alloc", alloc_latency, failures);
+    print_result("mixed", "free", free_latency, 0);
+}
+
+/// \brief Fragment memory with single pages, then ask for large blocks.
+///
+/// Every other page of a large number of single pages is freed again, which
+/// leaves holes no large block fits in. The large allocations afterwards show
+/// how quickly the allocator finds the memory that is still contiguous.
+void bench_fragmentation() {
+    phys_metadata_t info = get_phys_info();
+    size_t count = std::min<size_t>(frag_max_pages,
+                                    info.free_memory / default_page_size / 2);
+
+    // The page list itself lives in a block of pages
+    size_t list_order = 0;
+
+    while ((default_page_size << list_order) < count * sizeof(void*)) {
+        list_order++;
+    }
+
+    void** pages =
+        reinterpret_cast<void**>(request_pages(list_order, 0, AllocAny));
+
+    if (pages == nullptr) {
+        printf("pmm-bench workload=fragmentation skipped=no-memory\n");
+        return;
+    }
+
+    pages = reinterpret_cast<void**>(utils::to_higher_half(pages));
+    reset_histograms();
+
+    for (size_t i = 0; i < count; ++i) {
+        pages[i] = timed_request_page();
+    }
+
+    for (size_t i = 1; i < count; i += 2) {
+        if (pages[i] != nullptr) {
+            timed_free_page(pages[i]);
+            pages[i] = nullptr;
+        }
+    }
+
+    print_result("fragmentation", "alloc", alloc_latency, 0);
+    print_result("fragmentation", "free", free_latency, 0);
+
+    void* large[frag_large_count] = {};
+    size_t failures = 0;
+
+    reset_histograms();
+
+    for (size_t i = 0; i < frag_large_count; ++i) {
+        uint64_t start = x86_rdtsc();
+        large[i] = request_pages(frag_large_order, 0, AllocAny);
+        histogram_record(alloc_latency, x86_rdtsc() - start);
+
+        failures += large[i] == nullptr;
+    }
+
+    print_result("fragmentation", "large_alloc", alloc_latency, failures);
+
+    for (size_t i = 0; i < frag_large_count; ++i) {
+        if (large[i] != nullptr) {
+            free_pages(large[i], frag_large_order);
+        }
+    }
+
+    for (size_t i = 0; i < count; i += 2) {
+        if (pages[i] != nullptr) {
+            free_page(pages[i]);
+        }
+    }
+
+    free_pages(reinterpret_cast<void*>(utils::from_higher_half(pages)),
+               list_order);
+}
+
+/// \brief Add the samples of one histogram to another.
+///
+/// \param target The histogram receiving the samples.
+/// \param source The histogram whose samples are added.
+void histogram_merge(latency_histogram& target,
+                     const latency_histogram& source) {
+    for (size_t i = 0; i < histogram_buckets; ++i) {
+        target.buckets[i] += source.buckets[i];
+    }
+
+    target.count += source.count;
+    target.total += source.total;
+    target.max = std::max(target.max, source.max);
+}
+
+/// \brief Wait until every CPU of a multi-CPU workload is ready.
+void wait_for_workers() {
+    workers_waiting.fetch_add(1, std::memory_order_release);
+
+    while (!workers_started.load(std::memory_order_acquire)) {
+        pause();
+    }
+}
+
+/// \brief Run a workload on several CPUs at once.
+///
+/// Every CPU calls `worker` with its own results, the bootstrap processor
+/// included, and the worker starts with \ref wait_for_workers so they all
+/// start together.
+///
+/// \param cpus Number of CPUs, starting with the bootstrap processor.
+/// \param worker The workload of one CPU.
+/// \param results Array of the results of every CPU.
+/// \param size Size of the results of one CPU.
+/// \return Cycles from the start until the last CPU finished.
+uint64_t run_on_cpus(size_t cpus, arch::smp_function worker, void* results,
+                     size_t size) {
+    char* cpu_results = static_cast<char*>(results);
+
+    workers_waiting.store(0, std::memory_order_relaxed);
+    workers_started.store(false, std::memory_order_relaxed);
+
+    for (size_t cpu = 1; cpu < cpus; ++cpu) {
+        arch::smp_call(cpu, worker, cpu_results + cpu * size);
+    }
+
+    while (workers_waiting.load(std::memory_order_acquire) < cpus - 1) {
+        pause();
+    }
+
+    uint64_t start = x86_rdtsc();
+
+    workers_started.store(true, std::memory_order_release);
+    worker(cpu_results);
+
+    for (size_t cpu = 1; cpu < cpus; ++cpu) {
+        arch::smp_wait(cpu);
+    }
+
+    return x86_rdtsc() - start;
+}
+
+/// \brief Get the order of a block holding the results of every CPU.
+///
+/// \param size Size of the results of one CPU.
+/// \return The order.
+size_t results_order(size_t size) {
+    size_t pages =
+        utils::div_roundup(arch::smp_cpu_count() * size, default_page_size);
+
+    return pages <= 1 ? 0 : 64 - __builtin_clzl(pages - 1);
+}
+
+/// \brief Allocate and free batches of pages on one CPU of the contention
+///        workload.
+///
+/// \param argument The \ref contention_results of the CPU.
+void contention_worker(void* argument) {
+    contention_results* results = static_cast<contention_results*>(argument);
+    void* pages[contention_batch];
+
+    wait_for_workers();
+
+    for (size_t i = 0; i < churn_iterations / contention_batch; ++i) {
+        for (size_t j = 0; j < contention_batch; ++j) {
+            uint64_t start = x86_rdtsc();
+            pages[j] = request_page(1, AllocAny);
+            histogram_record(results->alloc, x86_rdtsc() - start);
+
+            results->failures += pages[j] == nullptr;
+        }
+
+        for (size_t j = 0; j < contention_batch; ++j) {
+            if (pages[j] == nullptr) {
+                continue;
+            }
+
+            uint64_t start = x86_rdtsc();
+            free_page(pages[j]);
+            histogram_record(results->free, x86_rdtsc() - start);
+        }
+    }
+}
+
+/// \brief Allocate and free batches of pages on every CPU at once.
+///
+/// Holding a batch per CPU pushes the per-CPU caches into refills and
+/// drains, which is where CPUs contend for the shared free stacks and zones.
+/// The latencies of all CPUs are reported together.
+void bench_contention() {
+    size_t cpus = arch::smp_cpu_count();
+    size_t order = results_order(sizeof(contention_results));
+
+    // The direct map is the same on every CPU, unlike vmalloc mappings
+    void* block = request_pages(order, 0, AllocZeroed);
+
+    if (block == nullptr) {
+        printf("pmm-bench workload=contention skipped=no-memory\n");
+        return;
+    }
+
+    contention_results* results = static_cast<contention_results*>(
+        utils::to_higher_half(block));
+    size_t failures = 0;
+
+    reset_histograms();
+    run_on_cpus(cpus, contention_worker, results, sizeof(contention_results));
+
+    for (size_t cpu = 0; cpu < cpus; ++cpu) {
+        histogram_merge(alloc_latency, results[cpu].alloc);
+        histogram_merge(free_latency, results[cpu].free);
+        failures += results[cpu].failures;
+    }
+
+    free_pages(block, order);
+
+    printf("pmm-bench workload=contention cpus=%lu\n", cpus);
+    print_result("contention", "alloc", alloc_latency, failures);
+    print_result("contention", "free", free_latency, 0);
+}
+
+/// \brief Claim or release the frames of an allocation of the stress
+///        workload.
+///
+/// \param address Physical address of the allocation.
+/// \param count Number of pages.
+/// \param claim Whether to set the frames' bits rather than clear them.
+/// \return Number of frames whose bit already had the new value.
+size_t stress_mark(void* address, size_t count, bool claim) {
+    size_t pfn = reinterpret_cast<paddr_t>(address) / default_page_size;
+    size_t conflicts = 0;
+
+    for (size_t i = pfn; i < pfn + count; ++i) {
+        uint64_t bit = static_cast<uint64_t>(1) << (i % 64);
+        uint64_t old =
+            claim ? stress_claims[i / 64].fetch_or(bit,
+                                                   std::memory_order_acq_rel)
+                  : stress_claims[i / 64].fetch_and(
+                        ~bit, std::memory_order_acq_rel);
+
+        conflicts += ((old & bit) != 0) == claim;
+    }
+
+    return conflicts;
+}
+
+/// \brief Allocate and free pages through every path on one CPU of the
+///        stress workload.
+///
+/// Single pages of any zone take the per-CPU cache and the lock-free stacks,
+/// while single pages of the DMA32 zone and runs of pages take the zones'
+/// locked path. Every frame handed out is claimed in `stress_claims`.
+///
+/// \param argument The \ref stress_results of the CPU.
+void stress_worker(void* argument) {
+    stress_results* results = static_cast<stress_results*>(argument);
+    stress_slot slots[stress_slots] = {};
+    uint64_t state = reinterpret_cast<uintptr_t>(argument) | 1;
+
+    wait_for_workers();
+
+    for (size_t i = 0; i < stress_iterations; ++i) {
+        // xorshift64, every CPU has its own sequence
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        stress_slot& slot = slots[state % stress_slots];
+
+        if (slot.address != nullptr) {
+            results->duplicates += stress_mark(slot.address, slot.count, false);
+            free_page(slot.address, slot.count);
+            slot.address = nullptr;
+        } else {
+            size_t kind = (state >> 32) % 4;
+
+            slot.count = kind == 3 ? 2 + (state >> 40) % (stress_max_pages - 1)
+                                   : 1;
+            slot.address = request_page(slot.count, AllocAny,
+                                        kind == 2 ? ZoneMaskDMA32
+                                                  : ZoneMaskAny);
+
+            if (slot.address == nullptr) {
+                results->failures++;
+            } else {
+                results->duplicates +=
+                    stress_mark(slot.address, slot.count, true);
+            }
+        }
+
+        results->operations++;
+    }
+
+    for (stress_slot& slot : slots) {
+        if (slot.address != nullptr) {
+            results->duplicates += stress_mark(slot.address, slot.count, false);
+            free_page(slot.address, slot.count);
+        }
+    }
+}
+
+/// \brief Allocate from every path on every CPU at once and check that no
+///        frame is handed out twice.
+///
+/// A frame found claimed by another allocation, or released while it was
+/// not claimed, counts as a duplicate and fails the workload.
+void bench_stress() {
+    size_t cpus = arch::smp_cpu_count();
+    size_t order = results_order(sizeof(stress_results));
+    size_t frames = get_phys_info().highest_address / default_page_size;
+    size_t claim_pages = utils::div_roundup(
+        utils::div_roundup(frames, 64) * sizeof(uint64_t), default_page_size);
+    size_t claim_order =
+        claim_pages <= 1 ? 0 : 64 - __builtin_clzl(claim_pages - 1);
+
+    void* block = request_pages(order, 0, AllocZeroed);
+    void* claims = request_pages(claim_order, 0, AllocZeroed);
+
+    if (block == nullptr || claims == nullptr) {
+        printf("pmm-bench workload=stress skipped=no-memory\n");
+        free_pages(block, order);
+        free_pages(claims, claim_order);
+        return;
+    }
+
+    stress_results* results =
+        static_cast<stress_results*>(utils::to_higher_half(block));
+    stress_claims = static_cast<std::atomic<uint64_t>*>(
+        utils::to_higher_half(claims));
+
+    uint64_t wall_ns = arch::tsc_to_ns(
+        run_on_cpus(cpus, stress_worker, results, sizeof(stress_results)));
+
+    stress_results total = {};
+
+    for (size_t cpu = 0; cpu < cpus; ++cpu) {
+        total.operations += results[cpu].operations;
+        total.failures += results[cpu].failures;
+        total.duplicates += results[cpu].duplicates;
+    }
+
+    stress_claims = nullptr;
+    free_pages(claims, claim_order);
+    free_pages(block, order);
+
+    printf("pmm-bench workload=stress cpus=%lu operations=%lu failures=%lu "
+           "duplicates=%lu wall_ns=%lu\n",
+           cpus, total.operations, total.failures, total.duplicates, wall_ns);
+
+    if (total.duplicates != 0) {
+        printf("pmm-bench workload=stress error=duplicate-frames count=%lu\n",
+               total.duplicates);
+    }
+}
+
+/// \brief Take and release a lock over and over on one CPU of the lock
+///        workload.
+///
+/// The critical section only increments a counter, so the latencies are
+/// those of handing the lock and its cache line between CPUs.
+///
+/// \tparam Lock Type of the lock in \ref lock_target.
+/// \param argument The \ref lock_results of the CPU.
+template <typename Lock>
+void lock_worker(void* argument) {
+    lock_results* results = static_cast<lock_results*>(argument);
+    Lock* lock = static_cast<Lock*>(lock_target);
+
+    wait_for_workers();
+
+    for (size_t i = 0; i < lock_iterations; ++i) {
+        uint64_t start = x86_rdtsc();
+        lock->lock();
+        histogram_record(results->acquire, x86_rdtsc() - start);
+
+        lock_counter++;
+
+        lock->unlock();
+    }
+}
+
+/// \brief Contend on one lock from several CPUs at once.
+///
+/// A lost increment of the counter is reported as a failure.
+///
+/// \tparam Lock Type of the lock.
+/// \param name Name of the lock in the results.
+/// \param workload Name of the workload in the latency results.
+/// \param lock The lock.
+/// \param cpus Number of contending CPUs.
+/// \param results Results of every CPU, zeroed.
+template <typename Lock>
+void bench_lock(const char* name, const char* workload, Lock& lock,
+                size_t cpus, lock_results* results) {
+    size_t expected = cpus * lock_iterations;
+
+    lock_target = &lock;
+    lock_counter = 0;
+
+    reset_histograms();
+    uint64_t wall_ns = arch::tsc_to_ns(
+        run_on_cpus(cpus, lock_worker<Lock>, results, sizeof(lock_results)));
+
+    for (size_t cpu = 0; cpu < cpus; ++cpu) {
+        histogram_merge(alloc_latency, results[cpu].acquire);
+    }
+
+    memset(results, 0, cpus * sizeof(lock_results));
+
+    printf("pmm-bench workload=lock lock=%s cpus=%lu wall_ns=%lu "
+           "acquisitions_per_sec=%lu\n",
+           name, cpus, wall_ns,
+           wall_ns != 0 ? (expected * 1000000000) / wall_ns : 0);
+
+    print_result(workload, "acquire", alloc_latency,
+                 lock_counter != expected ? expected - lock_counter : 0);
+}
+
+/// \brief Compare the ticket lock with the queued lock under contention.
+///
+/// Runs on 1, 2, 4, 8 and 16 CPUs, as far as there are CPUs. The ticket
+/// lock makes every waiter spin on the same cache line, so its handovers
+/// should slow down with the number of waiters, unlike the queued lock's.
+void bench_locks() {
+    size_t max_cpus = std::min(arch::smp_cpu_count(), lock_max_cpus);
+    size_t order = results_order(sizeof(lock_results));
+    void* block = request_pages(order, 0, AllocZeroed);
+
+    if (block == nullptr) {
+        printf("pmm-bench workload=lock skipped=no-memory\n");
+        return;
+    }
+
+    lock_results* results =
+        static_cast<lock_results*>(utils::to_higher_half(block));
+
+    for (size_t cpus = 1;; cpus *= 2) {
+        cpus = std::min(cpus, max_cpus);
+
+        bench_lock("ticket", "lock-ticket", ticket_lock, cpus, results);
+        bench_lock("queued", "lock-queued", queued_lock, cpus, results);
+
+        if (cpus == max_cpus) {
+            break;
+        }
+    }
+
+    free_pages(block, order);
+}
+
+/// \brief Switch between two address spaces and touch the same pages in both.
+///
+/// \param spaces The two address spaces.
+/// \param histogram Where to record the latency of a round trip.
+void switch_round_trips(address_space* spaces, latency_histogram& histogram) {
+    for (size_t i = 0; i < switch_iterations; ++i) {
+        uint64_t start = x86_rdtsc();
+
+        for (size_t j = 0; j < 2; ++j) {
+            spaces[j].activate();
+
+            for (size_t k = 0; k < switch_pages; ++k) {
+                volatile uint64_t* word = reinterpret_cast<uint64_t*>(
+                    switch_base + k * default_page_size);
+                *word = *word + 1;
+            }
+        }
+
+        histogram_record(histogram, x86_rdtsc() - start);
+    }
+}
+
+/// \brief Switch between two address spaces with and without PCIDs.
+///
+/// Both spaces map the same pages, which are touched after every switch, so
+/// a round trip includes the page walks of the TLB misses a switch causes.
+/// With PCIDs, the translations of both spaces and the kernel's survive.
+void bench_switch() {
+    address_space spaces[2];
+    void* pages = request_pages(switch_order, 0, AllocAny);
+    bool ready = pages != nullptr;
+
+    for (size_t i = 0; i < 2 && ready; ++i) {
+        ready = spaces[i].initialize() &&
+                spaces[i].map(switch_base, reinterpret_cast<paddr_t>(pages),
+                              switch_pages * default_page_size, VmWrite);
+    }
+
+    if (!ready) {
+        printf("pmm-bench workload=switch skipped=no-memory\n");
+    }
+
+    reset_histograms();
+
+    bool irqs = interrupt_status();
+    interrupt_disable();
+
+    if (ready && set_pcid_enabled(true)) {
+        switch_round_trips(spaces, alloc_latency);
+    }
+
+    if (ready) {
+        set_pcid_enabled(false);
+        switch_round_trips(spaces, free_latency);
+        set_pcid_enabled(true);
+    }
+
+    kernel_space().activate();
+
+    if (irqs) {
+        interrupt_enable();
+    }
+
+    if (ready) {
+        print_result("switch", "pcid", alloc_latency, 0);
+        print_result("switch", "no-pcid", free_latency, 0);
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+        spaces[i].destroy();
+    }
+
+    if (pages != nullptr) {
+        free_pages(pages, switch_order);
+    }
+}
+
+/// \brief Touch every page of a lazy vmalloc buffer.
+///
+/// Every first touch goes through the page fault handler, which backs the
+/// page, so a touch measures the round trip of a lazily backed page.
+void bench_fault() {
+    size_t size = fault_pages * default_page_size;
+    uintptr_t buffer = reinterpret_cast<uintptr_t>(vmalloc(size, VmallocLazy));
+
+    if (buffer == 0) {
+        printf("pmm-bench workload=fault skipped=no-memory\n");
+        return;
+    }
+
+    reset_histograms();
+
+    for (size_t i = 0; i < fault_pages; ++i) {
+        volatile uint64_t* word =
+            reinterpret_cast<uint64_t*>(buffer + i * default_page_size);
+        uint64_t start = x86_rdtsc();
+
+        *word = i;
+        histogram_record(alloc_latency, x86_rdtsc() - start);
+    }
+
+    vfree(reinterpret_cast<void*>(buffer));
+    vmalloc_purge();
+
+    print_result("fault", "touch", alloc_latency, 0);
+}
+
+/// \brief Copy full frames to the framebuffer with every cache type.
+///
+/// The framebuffer's mapping is switched between the cache types, with the
+/// caches written back in between, and restored to write-combining at the
+/// end. Every operation is one full frame.
+void bench_blit() {
+    size_t size = 0;
+    void* framebuffer = framebuffer_mapping(&size);
+
+    if (framebuffer == nullptr) {
+        printf("pmm-bench workload=blit skipped=no-framebuffer\n");
+        return;
+    }
+
+    void* frame = vmalloc(size, VmallocZeroed);
+
+    if (frame == nullptr) {
+        printf("pmm-bench workload=blit skipped=no-memory\n");
+        return;
+    }
+
+    const struct {
+        const char* name;
+        vm_flags cache;
+    } types[] = {
+        {"wc", VmWriteCombining},
+        {"uc", VmUncached},
+        {"wt", VmWriteThrough},
+        {"wb", VmWriteBack},
+    };
+
+    vaddr_t virt = reinterpret_cast<vaddr_t>(framebuffer);
+
+    printf("pmm-bench workload=blit bytes=%lu\n", size);
+
+    for (const auto& type : types) {
+        reset_histograms();
+
+        x86_wbinvd();
+        kernel_space().protect(virt, size, VmWrite | type.cache);
+
+        for (size_t i = 0; i < blit_iterations; ++i) {
+            uint64_t start = x86_rdtsc();
+            memcpy(framebuffer, frame, size);
+            histogram_record(alloc_latency, x86_rdtsc() - start);
+        }
+
+        print_result("blit", type.name, alloc_latency, 0);
+    }
+
+    x86_wbinvd();
+    kernel_space().protect(virt, size, VmWrite | VmWriteCombining);
+
+    vfree(frame);
+}
+
+/// \brief Check if a workload is selected.
+///
+/// \param selection Comma separated names of the selected workloads.
+/// \param length Length of `selection`.
+/// \param name Name of the workload.
+/// \return True if the workload is selected or nothing is, false otherwise.
+bool bench_selected(const char* selection, size_t length, const char* name) {
+    if (selection == nullptr || length == 0) {
+        return true;
+    }
+
+    size_t name_length = strlen(name);
+
+    for (size_t i = 0; i < length;) {
+        size_t end = i;
+
+        while (end < length && selection[end] != ',') {
+            end++;
+        }
+
+        if (end - i == name_length &&
+            strncmp(selection + i, name, name_length) == 0) {
+            return true;
+        }
+
+        i = end + 1;
+    }
+
+    return false;
+}
+
+/// \brief Run the physical memory allocator benchmarks.
+///
+/// The workloads are `churn`, `mixed`, `fragmentation` and `contention`,
+/// `stress`, which checks that concurrent allocations never share a frame,
+/// as well as `lock`, `switch`, `fault` and `blit`, which measure spinlocks,
+/// address space switches, lazily backed pages and framebuffer cache types
+/// rather than the allocator.
+/// Every workload prints one line per operation with its throughput and
+/// p50/p99/p999 latencies, which include the cost of reading the TSC.
+///
+/// \param selection Comma separated names of the workloads to run, all of
+///                  them if empty.
+/// \param length Length of `selection`.
+void phys_run_benchmarks(const char* selection, size_t length) {
+    if (arch::tsc_frequency() == 0) {
+        printf("pmm-bench skipped=no-tsc\n");
+        return;
+    }
+
+    phys_metadata_t before = get_phys_info();
+
+    printf("pmm-bench begin tsc_hz=%lu free_bytes=%lu\n",
+           arch::tsc_frequency(), before.free_memory);
+
+    if (bench_selected(selection, length, "churn")) {
+        bench_churn();
+    }
+
+    if (bench_selected(selection, length, "mixed")) {
+        bench_mixed();
+    }
+
+    if (bench_selected(selection, length, "fragmentation")) {
+        bench_fragmentation();
+    }
+
+    if (bench_selected(selection, length, "contention")) {
+        bench_contention();
+    }
+
+    if (bench_selected(selection, length, "stress")) {
+        bench_stress();
+    }
+
+    if (bench_selected(selection, length, "lock")) {
+        bench_locks();
+    }
+
+    if (bench_selected(selection, length, "switch")) {
+        bench_switch();
+    }
+
+    if (bench_selected(selection, length, "fault")) {
+        bench_fault();
+    }
+
+    if (bench_selected(selection, length, "blit")) {
+        bench_blit();
+    }
+
+    phys_metadata_t after = get_phys_info();
+
+    // Every workload gives back what it took, anything else is a leak
+    printf("pmm-bench end free_bytes=%lu leaked_bytes=%lu\n", after.free_memory,
+           before.free_memory > after.free_memory
+               ? before.free_memory - after.free_memory
+               : 0);
+}
+}  // namespace memory
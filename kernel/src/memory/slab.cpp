@@ -0,0 +1,557 @@
+#include <arch/arch.h>
+#include <stdio.h>
+#include <system/log.h>
+
+#include <utility>
+
+#include <cpu/tsc.hpp>
+#include <memory/page.hpp>
+#include <memory/pmm.hpp>
+#include <memory/slab.hpp>
+
+#include <utils/misc.hpp>
+
+namespace memory {
+/// \struct slab_cache::slab
+/// \brief Bookkeeping of a slab, stored at the end of its block.
+///
+/// The free list sits between the objects and the header.
+struct slab_cache::slab {
+    slab* next;           ///< Next slab of the list the slab is on.
+    slab* prev;           ///< Previous slab of the list the slab is on.
+    slab_cache* cache;    ///< Cache the slab belongs to.
+    uint16_t* free_list;  ///< Indices of the free objects.
+    uint32_t free_count;  ///< Number of valid entries in `free_list`.
+};
+
+static_assert(sizeof(slab_cache::slab) + alignof(slab_cache::slab) <= 64,
+              "the slab header must fit into the reserved bytes");
+
+/// \struct slab_cache::magazine
+/// \brief A stack of up to \ref magazine_size objects.
+struct slab_cache::magazine {
+    magazine* next;                ///< Next magazine in the depot.
+    size_t count;                  ///< Number of objects held.
+    void* objects[magazine_size];  ///< The objects held.
+};
+
+static_assert(sizeof(slab_cache::magazine) == 128,
+              "a magazine should fill two cache lines");
+
+// clang-format off
+
+namespace {
+/// Caches of the power-of-two sizes served by kmalloc, naturally aligned.
+slab_cache kmalloc_caches[] = {
+    {"kmalloc-16", 16, 16},     {"kmalloc-32", 32, 32},
+    {"kmalloc-64", 64, 64},     {"kmalloc-128", 128, 128},
+    {"kmalloc-256", 256, 256},  {"kmalloc-512", 512, 512},
+    {"kmalloc-1024", 1024, 1024}, {"kmalloc-2048", 2048, 2048},
+};
+
+/// Shift of the size of the smallest kmalloc cache.
+constexpr size_t kmalloc_min_shift = 4;
+
+/// Cache of the magazines, which cannot have magazines of its own.
+slab_cache magazine_cache("magazine", sizeof(slab_cache::magazine), 0,
+                          nullptr, SlabNoMagazines);
+
+slab_cache* cache_list = nullptr;  ///< Every cache which ever had a slab.
+utils::ticket_spinlock cache_list_lock;  ///< Lock protecting `cache_list`.
+uint64_t last_dump_ticks = 0;  ///< Time stamp of the previous telemetry dump.
+}  // namespace
+
+// clang-format on
+
+/// \brief Add a slab to the front of a list.
+///
+/// \param head Head of the list.
+/// \param entry The slab.
+void list_push(slab_cache::slab*& head, slab_cache::slab* entry) {
+    entry->prev = nullptr;
+    entry->next = head;
+
+    if (head != nullptr) {
+        head->prev = entry;
+    }
+
+    head = entry;
+}
+
+/// \brief Remove a slab from a list.
+///
+/// \param head Head of the list.
+/// \param entry The slab.
+void list_remove(slab_cache::slab*& head, slab_cache::slab* entry) {
+    if (entry->prev != nullptr) {
+        entry->prev->next = entry->next;
+    } else {
+        head = entry->next;
+    }
+
+    if (entry->next != nullptr) {
+        entry->next->prev = entry->prev;
+    }
+}
+
+/// \brief Get the page frame database entry of a heap address.
+///
+/// \param address Address within the higher half direct map.
+/// \return Pointer to the entry, or nullptr if the frame is not covered.
+page* heap_page(uintptr_t address) {
+    return phys_to_page(utils::from_higher_half(address));
+}
+
+/// \brief Create a slab with every object constructed.
+///
+/// The frames of the slab are marked as \ref PageSlab and point to the slab
+/// header, which is how freed objects find their slab. The first slab puts
+/// the cache on the list of caches reported by \ref slab_dump_telemetry.
+///
+/// \return Pointer to the slab, or nullptr if out of memory.
+slab_cache::slab* slab_cache::grow_() {
+    void* block = request_pages(this->order_, 0, AllocAny);
+
+    if (block == nullptr) {
+        return nullptr;
+    }
+
+    {
+        utils::scoped_lock guard(cache_list_lock);
+
+        if (!this->listed_) {
+            this->next_cache_ = cache_list;
+            this->listed_ = true;
+            cache_list = this;
+        }
+    }
+
+    size_t bytes = default_page_size << this->order_;
+    uintptr_t base = utils::to_higher_half(reinterpret_cast<uintptr_t>(block));
+    uintptr_t indices = base + this->capacity_ * this->size_;
+    uintptr_t header = utils::align_up(
+        indices + this->capacity_ * sizeof(uint16_t), alignof(slab));
+
+    slab* fresh = reinterpret_cast<slab*>(header);
+    fresh->cache = this;
+    fresh->free_list = reinterpret_cast<uint16_t*>(indices);
+    fresh->free_count = this->capacity_;
+
+    for (size_t i = 0; i < this->capacity_; ++i) {
+        // Hand out the lowest addresses first
+        fresh->free_list[i] = this->capacity_ - 1 - i;
+
+        if (this->ctor_ != nullptr) {
+            this->ctor_(reinterpret_cast<void*>(base + i * this->size_));
+        }
+    }
+
+    for (size_t i = 0; i < bytes / default_page_size; ++i) {
+        page* frame = heap_page(base + i * default_page_size);
+
+        frame->private_data = header;
+        frame->flags |= PageSlab;
+    }
+
+    return fresh;
+}
+
+/// \brief Give the pages of a slab back to the allocator.
+///
+/// \param victim The slab, which has no allocated objects.
+void slab_cache::release_(slab* victim) {
+    size_t bytes = default_page_size << this->order_;
+    uintptr_t base =
+        utils::align_down(reinterpret_cast<uintptr_t>(victim), bytes);
+
+    for (size_t i = 0; i < bytes / default_page_size; ++i) {
+        page* frame = heap_page(base + i * default_page_size);
+
+        frame->private_data = 0;
+        frame->flags &= ~PageSlab;
+    }
+
+    free_pages(reinterpret_cast<void*>(utils::from_higher_half(base)),
+               this->order_);
+}
+
+/// \brief Allocate an object from the slabs.
+///
+/// Partially used slabs are filled first, then the empty slab kept by the
+/// cache. A new slab is only created if neither is available, without the
+/// lock held.
+///
+/// \return Pointer to the object, or nullptr if out of memory.
+void* slab_cache::allocate_slab_() {
+    utils::scoped_lock guard(this->lock_);
+
+    if (this->partial_ == nullptr && this->empty_ != nullptr) {
+        list_push(this->partial_, this->empty_);
+        this->empty_ = nullptr;
+    }
+
+    if (this->partial_ == nullptr) {
+        this->lock_.unlock();
+        slab* fresh = this->grow_();
+        this->lock_.lock();
+
+        if (fresh == nullptr) {
+            return nullptr;
+        }
+
+        list_push(this->partial_, fresh);
+        this->slab_count_++;
+    }
+
+    slab* source = this->partial_;
+    size_t index = source->free_list[--source->free_count];
+
+    if (source->free_count == 0) {
+        list_remove(this->partial_, source);
+        list_push(this->full_, source);
+    }
+
+    this->active_++;
+
+    size_t bytes = default_page_size << this->order_;
+    uintptr_t base =
+        utils::align_down(reinterpret_cast<uintptr_t>(source), bytes);
+
+    return reinterpret_cast<void*>(base + index * this->size_);
+}
+
+/// \brief Give an object back to its slab.
+///
+/// A slab which becomes empty is kept if the cache has no empty slab yet,
+/// otherwise its pages are freed.
+///
+/// \param object Pointer to an object of the cache.
+void slab_cache::free_slab_(void* object) {
+    page* frame = heap_page(reinterpret_cast<uintptr_t>(object));
+    slab* owner = reinterpret_cast<slab*>(frame->private_data);
+    size_t bytes = default_page_size << this->order_;
+    uintptr_t offset = reinterpret_cast<uintptr_t>(object) -
+                       utils::align_down(frame->private_data, bytes);
+    slab* victim = nullptr;
+
+    {
+        utils::scoped_lock guard(this->lock_);
+
+        if (owner->free_count == this->capacity_) {
+            log_message(LOG_LEVEL_ERROR, "Double free of %p in %s.", object,
+                        this->name_);
+            return;
+        }
+
+        if (owner->free_count == 0) {
+            list_remove(this->full_, owner);
+            list_push(this->partial_, owner);
+        }
+
+        owner->free_list[owner->free_count++] = offset / this->size_;
+        this->active_--;
+
+        if (owner->free_count == this->capacity_) {
+            list_remove(this->partial_, owner);
+
+            if (this->empty_ == nullptr) {
+                this->empty_ = owner;
+            } else {
+                victim = owner;
+                this->slab_count_--;
+            }
+        }
+    }
+
+    if (victim != nullptr) {
+        this->release_(victim);
+    }
+}
+
+/// \brief Allocate an object.
+///
+/// The object comes from the loaded magazine of the current CPU, or from
+/// the previous one if it is full. When both are empty, the empty previous
+/// magazine is traded for a full one from the depot, and only if the depot
+/// has none the object comes from the slabs.
+///
+/// \return Pointer to the object, or nullptr if out of memory.
+void* slab_cache::allocate() {
+    if (this->capacity_ == 0) {
+        log_message(LOG_LEVEL_ERROR, "Objects of cache %s do not fit a slab.",
+                    this->name_);
+        return nullptr;
+    }
+
+    if ((this->flags_ & SlabNoMagazines) != 0) {
+        return this->allocate_slab_();
+    }
+
+    bool irqs = interrupt_status();
+    interrupt_disable();
+
+    cpu_cache& cpu = this->cpus_[arch_current_cpu()];
+
+    if ((cpu.loaded == nullptr || cpu.loaded->count == 0) &&
+        cpu.previous != nullptr && cpu.previous->count != 0) {
+        std::swap(cpu.loaded, cpu.previous);
+    }
+
+    if (cpu.loaded == nullptr || cpu.loaded->count == 0) {
+        utils::scoped_lock guard(this->depot_lock_);
+        magazine* full = this->full_magazines_;
+
+        if (full != nullptr) {
+            this->full_magazines_ = full->next;
+            this->full_count_--;
+
+            if (cpu.previous != nullptr) {
+                cpu.previous->next = this->empty_magazines_;
+                this->empty_magazines_ = cpu.previous;
+                this->empty_count_++;
+            }
+
+            cpu.previous = cpu.loaded;
+            cpu.loaded = full;
+        }
+    }
+
+    void* object = nullptr;
+
+    if (cpu.loaded != nullptr && cpu.loaded->count != 0) {
+        object = cpu.loaded->objects[--cpu.loaded->count];
+    } else {
+        object = this->allocate_slab_();
+    }
+
+    if (object != nullptr) {
+        cpu.allocs++;
+    }
+
+    if (irqs) {
+        interrupt_enable();
+    }
+
+    return object;
+}
+
+/// \brief Free an object of the cache.
+///
+/// The object goes to the loaded magazine of the current CPU, or to the
+/// previous one if it is empty. When both are full, the full previous
+/// magazine goes to the depot and an empty one is taken from the depot, or
+/// allocated. If the depot holds \ref max_depot_magazines full magazines
+/// already, the previous magazine is emptied into the slabs instead. Only if
+/// all of that fails the object goes back to its slab.
+///
+/// \param object Pointer to the object, in its constructed state.
+void slab_cache::free(void* object) {
+    page* frame = heap_page(reinterpret_cast<uintptr_t>(object));
+
+    if (frame == nullptr || (frame->flags & PageSlab) == 0) {
+        log_message(LOG_LEVEL_ERROR, "Freeing %p which is not in a slab.",
+                    object);
+        return;
+    }
+
+    slab* owner = reinterpret_cast<slab*>(frame->private_data);
+    size_t bytes = default_page_size << this->order_;
+    uintptr_t offset = reinterpret_cast<uintptr_t>(object) -
+                       utils::align_down(frame->private_data, bytes);
+
+    if (owner->cache != this || offset % this->size_ != 0) {
+        log_message(LOG_LEVEL_ERROR, "Freeing %p which is no object of %s.",
+                    object, this->name_);
+        return;
+    }
+
+    if ((this->flags_ & SlabNoMagazines) != 0) {
+        this->free_slab_(object);
+        return;
+    }
+
+    bool irqs = interrupt_status();
+    interrupt_disable();
+
+    cpu_cache& cpu = this->cpus_[arch_current_cpu()];
+
+    if ((cpu.loaded == nullptr || cpu.loaded->count == magazine_size) &&
+        cpu.previous != nullptr && cpu.previous->count == 0) {
+        std::swap(cpu.loaded, cpu.previous);
+    }
+
+    if (cpu.loaded == nullptr || cpu.loaded->count == magazine_size) {
+        magazine* empty = nullptr;
+        bool depot_full = false;
+
+        {
+            utils::scoped_lock guard(this->depot_lock_);
+            depot_full = this->full_count_ >= max_depot_magazines;
+            empty = this->empty_magazines_;
+
+            if (!depot_full && empty != nullptr) {
+                this->empty_magazines_ = empty->next;
+                this->empty_count_--;
+            }
+        }
+
+        if (depot_full && cpu.previous != nullptr) {
+            // Bound the memory parked in the depot, the previous magazine is
+            // full and can be emptied into the slabs instead
+            for (size_t i = 0; i < cpu.previous->count; ++i) {
+                this->free_slab_(cpu.previous->objects[i]);
+            }
+
+            cpu.previous->count = 0;
+            std::swap(cpu.loaded, cpu.previous);
+        } else if (!depot_full) {
+            if (empty == nullptr) {
+                empty = static_cast<magazine*>(magazine_cache.allocate());
+            }
+
+            if (empty != nullptr) {
+                utils::scoped_lock guard(this->depot_lock_);
+                empty->count = 0;
+
+                if (cpu.previous != nullptr) {
+                    cpu.previous->next = this->full_magazines_;
+                    this->full_magazines_ = cpu.previous;
+                    this->full_count_++;
+                }
+
+                cpu.previous = cpu.loaded;
+                cpu.loaded = empty;
+            }
+        }
+    }
+
+    if (cpu.loaded != nullptr && cpu.loaded->count != magazine_size) {
+        cpu.loaded->objects[cpu.loaded->count++] = object;
+    } else {
+        this->free_slab_(object);
+    }
+
+    cpu.frees++;
+
+    if (irqs) {
+        interrupt_enable();
+    }
+}
+
+/// \brief Print the counters of the cache and of every CPU using it.
+///
+/// The counters of other CPUs are read without synchronization, so they are
+/// only a snapshot.
+///
+/// \param elapsed Nanoseconds since the previous dump, for the rates.
+void slab_cache::dump_telemetry(uint64_t elapsed) {
+    size_t full = 0;
+    size_t empty = 0;
+
+    {
+        utils::scoped_lock guard(this->depot_lock_);
+        full = this->full_count_;
+        empty = this->empty_count_;
+    }
+
+    printf("slab-telemetry cache=%s object_size=%lu slabs=%lu "
+           "slab_objects=%lu slab_active=%lu depot_full=%lu "
+           "depot_empty=%lu\n",
+           this->name_, this->size_, this->slab_count_,
+           this->total_objects(), this->active_, full, empty);
+
+    for (size_t i = 0; i < MAX_CPUS; ++i) {
+        cpu_cache& cpu = this->cpus_[i];
+        size_t allocs = cpu.allocs;
+        size_t frees = cpu.frees;
+
+        if (allocs == 0 && frees == 0) {
+            continue;
+        }
+
+        size_t alloc_rate = 0;
+        size_t free_rate = 0;
+
+        if (elapsed != 0) {
+            alloc_rate = (allocs - cpu.dumped_allocs) * 1000000000ul / elapsed;
+            free_rate = (frees - cpu.dumped_frees) * 1000000000ul / elapsed;
+        }
+
+        printf("slab-telemetry cache=%s cpu=%lu allocs=%lu frees=%lu "
+               "allocs_per_sec=%lu frees_per_sec=%lu\n",
+               this->name_, i, allocs, frees, alloc_rate, free_rate);
+
+        cpu.dumped_allocs = allocs;
+        cpu.dumped_frees = frees;
+    }
+}
+
+/// \brief Allocate memory from the kernel heap.
+///
+/// Requests up to \ref kmalloc_max_size bytes are served by the cache of the
+/// next power of two, larger ones by a block of pages.
+///
+/// \param size Size of the memory in bytes.
+/// \return Pointer to the memory, aligned to `size` rounded up to a power of
+///         two (at least 16 bytes), or nullptr if out of memory.
+void* kmalloc(size_t size) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    if (size <= kmalloc_max_size) {
+        size_t shift = size <= 16 ? kmalloc_min_shift
+                                  : 64 - __builtin_clzl(size - 1);
+
+        return kmalloc_caches[shift - kmalloc_min_shift].allocate();
+    }
+
+    size_t pages = utils::div_roundup(size, default_page_size);
+    size_t order = pages <= 1 ? 0 : 64 - __builtin_clzl(pages - 1);
+    void* block = request_pages(order, 0, AllocAny);
+
+    return block != nullptr ? utils::to_higher_half(block) : nullptr;
+}
+
+/// \brief Free memory obtained through \ref kmalloc.
+///
+/// The page frame database tells whether the memory belongs to a slab or is
+/// a block of pages, and the block's order.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void kfree(void* address) {
+    if (address == nullptr) {
+        return;
+    }
+
+    page* frame = heap_page(reinterpret_cast<uintptr_t>(address));
+
+    if (frame != nullptr && (frame->flags & PageSlab) != 0) {
+        reinterpret_cast<slab_cache::slab*>(frame->private_data)
+            ->cache->free(address);
+    } else if (frame != nullptr && (frame->flags & PageHead) != 0) {
+        free_pages(utils::from_higher_half(address), frame->order);
+    } else {
+        log_message(LOG_LEVEL_ERROR, "Freeing %p which is not on the heap.",
+                    address);
+    }
+}
+
+/// \brief Print the counters of every object cache to the serial port.
+///
+/// Lines start with `slab-telemetry` followed by `key=value` pairs: one per
+/// cache with its slab and depot usage, and one per cache and CPU with its
+/// allocations and frees, in total and per second since the previous dump.
+/// Caches which never had a slab are left out.
+void slab_dump_telemetry() {
+    uint64_t now = x86_rdtsc();
+    uint64_t elapsed = arch::tsc_to_ns(now - last_dump_ticks);
+    last_dump_ticks = now;
+
+    utils::scoped_lock guard(cache_list_lock);
+
+    for (slab_cache* cache = cache_list; cache; cache = cache->next_cache()) {
+        cache->dump_telemetry(elapsed);
+    }
+}
+}  // namespace memory
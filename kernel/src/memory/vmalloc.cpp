@@ -0,0 +1,625 @@
+#include <system/log.h>
+
+#include <cpu/smp.hpp>
+#include <memory/page.hpp>
+#include <memory/pmm.hpp>
+#include <memory/slab.hpp>
+#include <memory/vmalloc.hpp>
+#include <memory/vmm.hpp>
+
+#include <utils/misc.hpp>
+
+namespace memory {
+/// \struct vm_range
+/// \brief A range of the vmalloc region, as node of a treap.
+///
+/// Free ranges and buffers live in two treaps ordered by address. Every node
+/// also knows the size of the largest range below it, which lets the lowest
+/// free range large enough for a request be found in logarithmic time.
+struct vm_range {
+    vaddr_t start;      ///< First address of the range.
+    size_t size;        ///< Size of the range in bytes.
+    size_t max_size;    ///< Largest `size` in the subtree.
+    uint32_t priority;  ///< Heap priority, random.
+    uint32_t flags;     ///< \ref vmalloc_flags of a buffer.
+    vm_range* left;     ///< Subtree of the lower ranges.
+    vm_range* right;    ///< Subtree of the higher ranges.
+    vm_range* next;     ///< Next range waiting for the TLB flush.
+};
+
+// clang-format off
+
+namespace {
+slab_cache vm_range_cache("vm_range", sizeof(vm_range));  ///< Cache of the range nodes.
+
+vm_range* free_ranges = nullptr;  ///< Treap of the free address space.
+vm_range* buffers = nullptr;      ///< Treap of the allocated buffers.
+vm_range* lazy_ranges = nullptr;  ///< Freed buffers waiting for the TLB flush.
+page* lazy_frames = nullptr;      ///< Frames of the freed buffers, linked through `next`.
+size_t lazy_bytes = 0;            ///< Size of the ranges in `lazy_ranges`.
+uint32_t priority_seed = 2463534242u;  ///< State of the priority generator.
+utils::irq_lock vmalloc_lock;     ///< Lock protecting everything above.
+}  // namespace
+
+// clang-format on
+
+/// \brief Get the next treap priority.
+///
+/// \return A pseudo-random number (xorshift32).
+uint32_t next_priority() {
+    priority_seed ^= priority_seed << 13;
+    priority_seed ^= priority_seed >> 17;
+    priority_seed ^= priority_seed << 5;
+    return priority_seed;
+}
+
+/// \brief Recompute the largest size below a node.
+///
+/// \param node The node.
+void range_update(vm_range* node) {
+    size_t max_size = node->size;
+
+    if (node->left != nullptr && node->left->max_size > max_size) {
+        max_size = node->left->max_size;
+    }
+
+    if (node->right != nullptr && node->right->max_size > max_size) {
+        max_size = node->right->max_size;
+    }
+
+    node->max_size = max_size;
+}
+
+/// \brief Split a treap into the ranges below an address and the others.
+///
+/// \param root The treap.
+/// \param start The address.
+/// \param lower Receives the ranges starting below `start`.
+/// \param upper Receives the remaining ranges.
+void range_split(vm_range* root, vaddr_t start, vm_range*& lower,
+                 vm_range*& upper) {
+    if (root == nullptr) {
+        lower = upper = nullptr;
+        return;
+    }
+
+    if (root->start < start) {
+        range_split(root->right, start, root->right, upper);
+        lower = root;
+    } else {
+        range_split(root->left, start, lower, root->left);
+        upper = root;
+    }
+
+    range_update(root);
+}
+
+/// \brief Join two treaps, every range of the first below the second's.
+///
+/// \param lower The treap of the lower ranges.
+/// \param upper The treap of the higher ranges.
+/// \return The joined treap.
+vm_range* range_merge(vm_range* lower, vm_range* upper) {
+    if (lower == nullptr || upper == nullptr) {
+        return lower != nullptr ? lower : upper;
+    }
+
+    if (lower->priority > upper->priority) {
+        lower->right = range_merge(lower->right, upper);
+        range_update(lower);
+        return lower;
+    }
+
+    upper->left = range_merge(lower, upper->left);
+    range_update(upper);
+    return upper;
+}
+
+/// \brief Insert a range into a treap.
+///
+/// \param root The treap.
+/// \param node The range, not overlapping any other of the treap.
+void range_insert(vm_range*& root, vm_range* node) {
+    vm_range* lower = nullptr;
+    vm_range* upper = nullptr;
+
+    node->left = node->right = nullptr;
+    range_update(node);
+
+    range_split(root, node->start, lower, upper);
+    root = range_merge(range_merge(lower, node), upper);
+}
+
+/// \brief Remove the range starting at an address from a treap.
+///
+/// \param root The treap.
+/// \param start First address of the range.
+/// \return The range, or nullptr if the treap has none starting there.
+vm_range* range_remove(vm_range*& root, vaddr_t start) {
+    vm_range* lower = nullptr;
+    vm_range* middle = nullptr;
+    vm_range* upper = nullptr;
+
+    range_split(root, start, lower, middle);
+    range_split(middle, start + 1, middle, upper);
+    root = range_merge(lower, upper);
+
+    return middle;
+}
+
+/// \brief Find the range containing an address.
+///
+/// \param root The treap.
+/// \param address The address.
+/// \return The range, or nullptr if no range contains the address.
+vm_range* range_find(vm_range* root, vaddr_t address) {
+    while (root != nullptr) {
+        if (address < root->start) {
+            root = root->left;
+        } else if (address - root->start < root->size) {
+            return root;
+        } else {
+            root = root->right;
+        }
+    }
+
+    return nullptr;
+}
+
+/// \brief Find the lowest range of a minimum size.
+///
+/// \param root The treap.
+/// \param size The minimum size in bytes.
+/// \return The range, or nullptr if no range is large enough.
+vm_range* range_first_fit(vm_range* root, size_t size) {
+    while (root != nullptr && root->max_size >= size) {
+        if (root->left != nullptr && root->left->max_size >= size) {
+            root = root->left;
+        } else if (root->size >= size) {
+            return root;
+        } else {
+            root = root->right;
+        }
+    }
+
+    return nullptr;
+}
+
+/// \brief Give a range back to the free address space.
+///
+/// The range is merged with its free neighbours.
+///
+/// \param node The range, which must not be on any treap.
+void release_range(vm_range* node) {
+    vm_range* lower = nullptr;
+    vm_range* upper = nullptr;
+
+    range_split(free_ranges, node->start, lower, upper);
+
+    vm_range* before = lower;
+
+    while (before != nullptr && before->right != nullptr) {
+        before = before->right;
+    }
+
+    vm_range* after = upper;
+
+    while (after != nullptr && after->left != nullptr) {
+        after = after->left;
+    }
+
+    if (before != nullptr && before->start + before->size == node->start) {
+        range_remove(lower, before->start);
+        node->start = before->start;
+        node->size += before->size;
+        vm_range_cache.free(before);
+    }
+
+    if (after != nullptr && node->start + node->size == after->start) {
+        range_remove(upper, after->start);
+        node->size += after->size;
+        vm_range_cache.free(after);
+    }
+
+    node->left = node->right = nullptr;
+    range_update(node);
+
+    free_ranges = range_merge(range_merge(lower, node), upper);
+}
+
+/// \brief Carve a range out of the free address space.
+///
+/// \param node Receives the first address and size of the range.
+/// \param size Size of the range in bytes.
+/// \return True on success, false if no free range is large enough.
+bool reserve_range(vm_range* node, size_t size) {
+    utils::scoped_lock guard(vmalloc_lock);
+    vm_range* fit = range_first_fit(free_ranges, size);
+
+    if (fit == nullptr) {
+        return false;
+    }
+
+    // Taking the front of the range keeps the order of the treap intact
+    range_remove(free_ranges, fit->start);
+    node->start = fit->start;
+    node->size = size;
+    fit->start += size;
+    fit->size -= size;
+
+    if (fit->size != 0) {
+        range_insert(free_ranges, fit);
+    } else {
+        vm_range_cache.free(fit);
+    }
+
+    range_insert(buffers, node);
+    return true;
+}
+
+/// \brief Unmap the pages of a buffer without flushing the TLB.
+///
+/// The frames behind the pages are put on the list of frames to free after
+/// the next flush.
+///
+/// \param start First mapped address.
+/// \param pages Number of mapped pages.
+void unmap_buffer(vaddr_t start, size_t pages) {
+    page* frames = nullptr;
+    page* last = nullptr;
+
+    for (size_t i = 0; i < pages; ++i) {
+        paddr_t phys = kernel_space().translate(start + i * default_page_size);
+        page* frame = phys != address_space::npos ? phys_to_page(phys)
+                                                   : nullptr;
+
+        if (frame != nullptr) {
+            frame->next = frames;
+            frames = frame;
+            last = last != nullptr ? last : frame;
+        }
+    }
+
+    kernel_space().unmap(start, pages * default_page_size, false);
+
+    if (last != nullptr) {
+        utils::scoped_lock guard(vmalloc_lock);
+        last->next = lazy_frames;
+        lazy_frames = frames;
+    }
+}
+
+/// \brief Allocate a virtually contiguous buffer.
+///
+/// The buffer is built from single frames, so it does not depend on
+/// contiguous physical memory. The lowest free range of address space large
+/// enough is taken, and freed ranges are only reused once the TLB was
+/// flushed, so a lack of address space triggers a purge first. The pages of
+/// a \ref VmallocLazy buffer are left unmapped until they are touched.
+///
+/// \param size Size of the buffer in bytes.
+/// \param flags Guard pages and contents (default is \ref VmallocDefault).
+/// \return Page aligned pointer to the buffer, or nullptr if out of memory
+///         or address space.
+void* vmalloc(size_t size, vmalloc_flags flags) {
+    if (size == 0 || size > vmalloc_size) {
+        return nullptr;
+    }
+
+    size_t pages = utils::div_roundup(size, default_page_size);
+    size_t guard_size = (flags & VmallocGuard) != 0 ? default_page_size : 0;
+    vm_range* node = static_cast<vm_range*>(vm_range_cache.allocate());
+
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    node->priority = next_priority();
+    node->flags = flags;
+
+    size_t span = pages * default_page_size + 2 * guard_size;
+
+    if (!reserve_range(node, span)) {
+        vmalloc_purge();
+
+        if (!reserve_range(node, span)) {
+            log_message(LOG_LEVEL_ERROR,
+                        "Out of vmalloc space for %lu bytes.", size);
+            vm_range_cache.free(node);
+            return nullptr;
+        }
+    }
+
+    vaddr_t start = node->start + guard_size;
+    alloc_flags alloc = (flags & VmallocZeroed) != 0 ? AllocZeroed : AllocAny;
+
+    for (size_t i = 0; i < pages && (flags & VmallocLazy) == 0; ++i) {
+        void* frame = request_page(1, alloc);
+        vaddr_t virt = start + i * default_page_size;
+
+        if (frame == nullptr ||
+            !kernel_space().map(virt, reinterpret_cast<paddr_t>(frame),
+                                default_page_size, VmWrite)) {
+            // Translations may have been cached speculatively, so the
+            // partial buffer waits for the next flush like a freed one
+            free_page(frame);
+            unmap_buffer(start, i);
+
+            utils::scoped_lock guard(vmalloc_lock);
+            range_remove(buffers, node->start);
+            node->next = lazy_ranges;
+            lazy_ranges = node;
+            lazy_bytes += node->size;
+            return nullptr;
+        }
+    }
+
+    return reinterpret_cast<void*>(start);
+}
+
+/// \brief Back the page of a lazy buffer an access faulted on.
+///
+/// Called by the page fault handler, so the pages of a lazy buffer must not
+/// be touched first with locks of the physical memory allocator or of the
+/// kernel's page tables held. The check for a page mapped in the meantime
+/// and the mapping happen under one lock, so concurrent faults on the same
+/// page map one frame.
+///
+/// \param address The faulting address.
+/// \return True if the page is mapped now, false if the address is not
+///         within a lazy buffer or out of memory.
+bool vmalloc_fault(vaddr_t address) {
+    vaddr_t virt = utils::align_down(address, default_page_size);
+    utils::scoped_lock guard(vmalloc_lock);
+    vm_range* node = range_find(buffers, virt);
+
+    if (node == nullptr || (node->flags & VmallocLazy) == 0) {
+        return false;
+    }
+
+    size_t guard_size =
+        (node->flags & VmallocGuard) != 0 ? default_page_size : 0;
+
+    if (virt - node->start < guard_size ||
+        node->start + node->size - virt <= guard_size) {
+        return false;
+    }
+
+    // Pages of lazy buffers are only mapped under `vmalloc_lock`
+    if (kernel_space().translate_unlocked(virt) != address_space::npos) {
+        return true;
+    }
+
+    void* frame = request_page(1, AllocZeroed);
+
+    if (frame == nullptr) {
+        log_message(LOG_LEVEL_ERROR, "No memory to back %p.",
+                    reinterpret_cast<void*>(address));
+        return false;
+    }
+
+    if (!kernel_space().map(virt, reinterpret_cast<paddr_t>(frame),
+                            default_page_size, VmWrite)) {
+        free_page(frame);
+        return false;
+    }
+
+    return true;
+}
+
+/// \brief Free a buffer obtained through \ref vmalloc.
+///
+/// The pages are unmapped right away, so later accesses fault, but the TLB
+/// is only flushed once \ref vmalloc_lazy_max bytes of address space were
+/// freed. Until then neither the address space nor the frames are reused.
+///
+/// \param address Pointer to the buffer, may be nullptr.
+void vfree(void* address) {
+    if (address == nullptr) {
+        return;
+    }
+
+    vaddr_t virt = reinterpret_cast<vaddr_t>(address);
+    vm_range* node = nullptr;
+
+    {
+        utils::scoped_lock guard(vmalloc_lock);
+        node = range_find(buffers, virt);
+
+        if (node != nullptr) {
+            size_t guard_size =
+                (node->flags & VmallocGuard) != 0 ? default_page_size : 0;
+
+            if (node->start + guard_size == virt) {
+                range_remove(buffers, node->start);
+            } else {
+                node = nullptr;
+            }
+        }
+    }
+
+    if (node == nullptr) {
+        log_message(LOG_LEVEL_ERROR, "Freeing %p which is no vmalloc buffer.",
+                    address);
+        return;
+    }
+
+    size_t guard_size =
+        (node->flags & VmallocGuard) != 0 ? default_page_size : 0;
+
+    if ((node->flags & VmallocIo) != 0) {
+        // The memory belongs to the device, only the mapping goes away
+        kernel_space().unmap(node->start, node->size, false);
+    } else {
+        unmap_buffer(node->start + guard_size,
+                     (node->size - 2 * guard_size) / default_page_size);
+    }
+
+    bool purge = false;
+
+    {
+        utils::scoped_lock guard(vmalloc_lock);
+        node->next = lazy_ranges;
+        lazy_ranges = node;
+        lazy_bytes += node->size;
+        purge = lazy_bytes >= vmalloc_lazy_max;
+    }
+
+    if (purge) {
+        vmalloc_purge();
+    }
+}
+
+/// \brief Map device memory, such as registers or a framebuffer.
+///
+/// The mapping takes address space from the vmalloc region and is removed
+/// like a buffer, except that the memory stays with the device. Memory must
+/// not be mapped with different cache types at once, which includes the
+/// higher half direct map for memory it covers.
+///
+/// \param phys Physical address of the memory.
+/// \param size Size of the memory in bytes.
+/// \param cache Cache type of the mapping, such as \ref VmUncached for
+///              registers or \ref VmWriteCombining for framebuffers.
+/// \return Pointer to the memory, or nullptr if out of address space.
+void* ioremap(paddr_t phys, size_t size, vm_flags cache) {
+    if (size == 0 || size > vmalloc_size) {
+        return nullptr;
+    }
+
+    paddr_t base = utils::align_down(phys, default_page_size);
+    size_t span = utils::align_up(phys + size, default_page_size) - base;
+    vm_range* node = static_cast<vm_range*>(vm_range_cache.allocate());
+
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    node->priority = next_priority();
+    node->flags = VmallocIo;
+
+    if (!reserve_range(node, span)) {
+        vmalloc_purge();
+
+        if (!reserve_range(node, span)) {
+            log_message(LOG_LEVEL_ERROR,
+                        "Out of vmalloc space to map %lu bytes at %p.", size,
+                        reinterpret_cast<void*>(phys));
+            vm_range_cache.free(node);
+            return nullptr;
+        }
+    }
+
+    vm_flags flags = VmWrite | static_cast<vm_flags>(cache & VmCacheMask);
+
+    if (!kernel_space().map(node->start, base, span, flags)) {
+        kernel_space().unmap(node->start, span, false);
+
+        utils::scoped_lock guard(vmalloc_lock);
+        range_remove(buffers, node->start);
+        node->next = lazy_ranges;
+        lazy_ranges = node;
+        lazy_bytes += node->size;
+        return nullptr;
+    }
+
+    return reinterpret_cast<void*>(node->start + (phys - base));
+}
+
+/// \brief Remove a mapping made by \ref ioremap.
+///
+/// \param address Pointer returned by \ref ioremap, may be nullptr.
+void iounmap(void* address) {
+    if (address == nullptr) {
+        return;
+    }
+
+    vfree(reinterpret_cast<void*>(
+        utils::align_down(reinterpret_cast<uintptr_t>(address),
+                          default_page_size)));
+}
+
+/// \brief Flush the TLB and release everything freed by \ref vfree since.
+///
+/// One flush covers all freed buffers, after which their frames go back to
+/// the physical memory allocator and their address space becomes free. The
+/// TLBs of the other processors are flushed as well, which only the
+/// bootstrap processor can wait for, so elsewhere everything stays queued
+/// for its next purge.
+void vmalloc_purge() {
+    vm_range* ranges = nullptr;
+    page* frames = nullptr;
+
+    {
+        utils::scoped_lock guard(vmalloc_lock);
+        ranges = lazy_ranges;
+        frames = lazy_frames;
+        lazy_ranges = nullptr;
+        lazy_frames = nullptr;
+        lazy_bytes = 0;
+    }
+
+    if (ranges == nullptr && frames == nullptr) {
+        return;
+    }
+
+    if (!arch::smp_flush_tlbs()) {
+        utils::scoped_lock guard(vmalloc_lock);
+
+        for (vm_range* node = ranges; node != nullptr;) {
+            vm_range* next = node->next;
+            node->next = lazy_ranges;
+            lazy_ranges = node;
+            lazy_bytes += node->size;
+            node = next;
+        }
+
+        for (page* frame = frames; frame != nullptr;) {
+            page* next = frame->next;
+            frame->next = lazy_frames;
+            lazy_frames = frame;
+            frame = next;
+        }
+
+        return;
+    }
+
+    while (frames != nullptr) {
+        page* next = frames->next;
+        frames->next = nullptr;
+        free_page(reinterpret_cast<void*>(page_to_phys(frames)));
+        frames = next;
+    }
+
+    utils::scoped_lock guard(vmalloc_lock);
+
+    while (ranges != nullptr) {
+        vm_range* next = ranges->next;
+        release_range(ranges);
+        ranges = next;
+    }
+}
+
+/// \brief Set up the vmalloc region.
+///
+/// The whole region starts out as one free range.
+void vmalloc_initialize() {
+    vm_range* node = static_cast<vm_range*>(vm_range_cache.allocate());
+
+    if (node == nullptr) {
+        log_message(LOG_LEVEL_ERROR, "No memory for the vmalloc region.");
+        return;
+    }
+
+    node->start = vmalloc_start;
+    node->size = vmalloc_size;
+    node->priority = next_priority();
+
+    utils::scoped_lock guard(vmalloc_lock);
+    range_insert(free_ranges, node);
+
+    log_message(LOG_LEVEL_INFO, "vmalloc region: %p - %p.",
+                reinterpret_cast<void*>(vmalloc_start),
+                reinterpret_cast<void*>(vmalloc_start + vmalloc_size));
+}
+}  // namespace memory
@@ -0,0 +1,1010 @@
+#include <arch/arch.h>
+#include <stdio.h>
+#include <system/log.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include <cpu/cpuid.hpp>
+#include <cpu/smp.hpp>
+#include <cpu/tsc.hpp>
+#include <memory/memory.hpp>
+#include <memory/pmm.hpp>
+#include <memory/vmalloc.hpp>
+#include <memory/vmm.hpp>
+
+#include <utils/misc.hpp>
+
+/// \brief Boundaries of the kernel image's segments, set by the linker.
+extern "C" char __kernel_text_start[], __kernel_text_end[],
+    __kernel_rodata_start[], __kernel_rodata_end[], __kernel_data_start[],
+    __kernel_end[];
+
+namespace memory {
+// clang-format off
+
+namespace {
+constexpr uint64_t pte_present = 1ul << 0;         ///< The entry is valid.
+constexpr uint64_t pte_write = 1ul << 1;           ///< Writes are allowed.
+constexpr uint64_t pte_user = 1ul << 2;            ///< User mode accesses are allowed.
+constexpr uint64_t pte_write_through = 1ul << 3;   ///< Write-through caching.
+constexpr uint64_t pte_cache_disable = 1ul << 4;   ///< Caching is disabled.
+constexpr uint64_t pte_huge = 1ul << 7;            ///< Maps a 2 MiB or 1 GiB page (PAT bit of 4 KiB pages).
+constexpr uint64_t pte_global = 1ul << 8;          ///< Kept in the TLB across CR3 loads.
+constexpr uint64_t pte_huge_pat = 1ul << 12;       ///< PAT bit of 2 MiB and 1 GiB pages.
+constexpr uint64_t pte_no_execute = 1ul << 63;     ///< Instruction fetches are not allowed.
+
+/// Bits of a page table entry holding the physical address.
+constexpr uint64_t pte_address_mask = 0x000ffffffffff000ul;
+
+/// Number of entries in a page table.
+constexpr size_t table_entries = 512;
+
+/// Bits of the entries pointing to page tables, rights are enforced by the leaves.
+constexpr uint64_t table_bits = pte_present | pte_write;
+
+address_space kernel_address_space;  ///< Address space of the kernel.
+
+bool has_huge_1g = false;  ///< Whether 1 GiB pages are supported.
+bool has_no_execute = false;  ///< Whether the no-execute bit is supported.
+bool has_pat = false;  ///< Whether the page attribute table is supported.
+bool has_global = false;  ///< Whether global pages are enabled.
+bool has_pcid = false;  ///< Whether process-context identifiers are enabled.
+bool has_invpcid = false;  ///< Whether the INVPCID instruction is supported.
+bool use_pcid = false;  ///< Whether address spaces are activated with their PCID.
+bool kernel_tables_active = false;  ///< Whether the kernel switched to its own page tables.
+
+/// Index of the first top-level entry of the kernel half, shared by every space.
+constexpr size_t kernel_half_entry = table_entries / 2;
+
+/// Largest process-context identifier, 0 is used when PCIDs are off.
+constexpr uint16_t max_pcid = X86_CR3_PCID_MASK;
+
+constexpr uint64_t invpcid_address = 0;  ///< INVPCID type dropping one address of a PCID.
+constexpr uint64_t invpcid_all_global = 2;  ///< INVPCID type dropping everything.
+constexpr uint64_t invpcid_all = 3;  ///< INVPCID type dropping everything but global pages.
+
+uint16_t next_pcid = 1;  ///< Next process-context identifier to hand out.
+uint64_t pcid_generation = 1;  ///< Round of handing out process-context identifiers.
+
+/// Layout of the page attribute table. The first four entries keep their power-on types, so
+/// mappings without the PAT bit mean the same with any layout. The rest follows the layout the
+/// Limine protocol specifies, with write-combining at index 5.
+constexpr uint64_t pat_layout =
+    X86_PAT_ENTRY(0, X86_PAT_WB) | X86_PAT_ENTRY(1, X86_PAT_WT) | X86_PAT_ENTRY(2, X86_PAT_UCM) |
+    X86_PAT_ENTRY(3, X86_PAT_UC) | X86_PAT_ENTRY(4, X86_PAT_WP) | X86_PAT_ENTRY(5, X86_PAT_WC) |
+    X86_PAT_ENTRY(6, X86_PAT_UCM) | X86_PAT_ENTRY(7, X86_PAT_UC);
+
+paddr_t framebuffer_base = 0;  ///< Physical address of the framebuffer, page aligned.
+size_t framebuffer_size = 0;   ///< Size of the framebuffer in bytes, 0 if there is none.
+utils::irq_lock pcid_lock;  ///< Lock protecting `next_pcid` and `pcid_generation`.
+
+std::atomic<size_t> fault_count = 0;     ///< Page faults seen by the handler.
+std::atomic<size_t> lazy_faults = 0;     ///< Faults which backed a page of a lazy buffer.
+std::atomic<size_t> spurious_faults = 0;  ///< Faults on pages mapped in the meantime.
+std::atomic<uint64_t> fault_ticks = 0;   ///< TSC cycles spent on resolved faults.
+std::atomic<uint64_t> max_fault_ticks = 0;  ///< Longest resolved fault in TSC cycles.
+}  // namespace
+
+// clang-format on
+
+/// \brief Get the shift of the page size mapped by an entry at a level.
+///
+/// \param level Paging level, 1 for page tables up to 4 for the PML4.
+/// \return The shift of the size.
+constexpr size_t level_shift(size_t level) {
+    return KiB4 + 9 * (level - 1);
+}
+
+/// \brief Get the size of the memory mapped by an entry at a level.
+///
+/// \param level Paging level, 1 for page tables up to 4 for the PML4.
+/// \return The size in bytes.
+constexpr size_t level_size(size_t level) {
+    return static_cast<size_t>(1) << level_shift(level);
+}
+
+/// \brief Get the index of the entry for an address in a table at a level.
+///
+/// \param virt The virtual address.
+/// \param level Paging level of the table.
+/// \return The index of the entry.
+constexpr size_t index_of(vaddr_t virt, size_t level) {
+    return (virt >> level_shift(level)) & (table_entries - 1);
+}
+
+/// \brief Get a page table through the higher half direct map.
+///
+/// \param table Physical address of the table.
+/// \return Pointer to the table's entries.
+uint64_t* table_at(paddr_t table) {
+    return reinterpret_cast<uint64_t*>(utils::to_higher_half(table));
+}
+
+/// \brief Allocate a zeroed page table.
+///
+/// \return Physical address of the table, or \ref address_space::npos.
+paddr_t allocate_table() {
+    void* table = request_page(1, AllocZeroed);
+
+    return table != nullptr ? reinterpret_cast<paddr_t>(table)
+                            : address_space::npos;
+}
+
+/// \brief Get the highest level a leaf may be placed at.
+///
+/// \return 3 if 1 GiB pages are supported, 2 otherwise.
+size_t max_leaf_level() {
+    return has_huge_1g ? 3 : 2;
+}
+
+/// \brief Check if an address belongs to the kernel half of every space.
+///
+/// \param virt The virtual address.
+/// \return True for the upper half of the address space, false otherwise.
+constexpr bool is_kernel_half(vaddr_t virt) {
+    return (virt >> 63) != 0;
+}
+
+/// \brief Build the bits of a leaf entry.
+///
+/// Kernel mappings are global, so they survive address space switches.
+///
+/// \param flags Access rights of the mapping.
+/// \param virt Virtual address of the mapping.
+/// \return The bits, without the address, page size and cache type bits.
+uint64_t leaf_bits(vm_flags flags, vaddr_t virt) {
+    uint64_t bits = pte_present;
+
+    if (is_kernel_half(virt) && !(flags & VmUser) && has_global) {
+        bits |= pte_global;
+    }
+
+    if (flags & VmWrite) {
+        bits |= pte_write;
+    }
+
+    if (flags & VmUser) {
+        bits |= pte_user;
+    }
+
+    if (!(flags & VmExecute) && has_no_execute) {
+        bits |= pte_no_execute;
+    }
+
+    return bits;
+}
+
+/// \brief Build the cache type bits of a leaf entry.
+///
+/// The bits select an entry of the page attribute table laid out by
+/// \ref pat_initialize. Without one, write-combining falls back to uncached.
+///
+/// \param flags Attributes of the mapping.
+/// \param level Level of the entry.
+/// \return The PWT, PCD and PAT bits.
+uint64_t cache_bits(vm_flags flags, size_t level) {
+    // The PAT bit is bit 7 in 4 KiB pages, where larger pages have their
+    // page size bit
+    uint64_t pat = level > 1 ? pte_huge_pat : pte_huge;
+
+    switch (flags & VmCacheMask) {
+        case VmUncached:
+            return pte_cache_disable | pte_write_through;
+
+        case VmWriteCombining:
+            return has_pat ? pat | pte_write_through
+                           : pte_cache_disable | pte_write_through;
+
+        case VmWriteThrough:
+            return pte_write_through;
+
+        default:
+            return 0;
+    }
+}
+
+/// \brief Allocate the top-level table of the address space.
+///
+/// Every space other than the kernel's shares the kernel half with it, by
+/// pointing to the same tables below the top level.
+///
+/// \return True on success, false if out of memory.
+bool address_space::initialize() {
+    paddr_t root = allocate_table();
+
+    if (root == npos) {
+        return false;
+    }
+
+    if (this != &kernel_address_space && kernel_address_space.root_ != 0) {
+        const uint64_t* kernel = table_at(kernel_address_space.root_);
+        uint64_t* entries = table_at(root);
+
+        for (size_t i = kernel_half_entry; i < table_entries; ++i) {
+            entries[i] = kernel[i];
+        }
+    }
+
+    this->root_ = root;
+    return true;
+}
+
+/// \brief Free the tables of the address space.
+///
+/// The tables of the kernel half are shared and stay. The space must not be
+/// active on any CPU. Its process-context identifier is not reused before
+/// the next round of handing them out.
+void address_space::destroy() {
+    if (this->root_ == 0 || this == &kernel_address_space) {
+        return;
+    }
+
+    uint64_t* entries = table_at(this->root_);
+
+    for (size_t i = 0; i < kernel_half_entry; ++i) {
+        if ((entries[i] & pte_present) && !(entries[i] & pte_huge)) {
+            this->free_table_(entries[i] & pte_address_mask, 3);
+        }
+    }
+
+    free_page(reinterpret_cast<void*>(this->root_));
+    this->root_ = 0;
+    this->pcid_generation_ = 0;
+}
+
+/// \brief Check if the space is loaded into CR3.
+///
+/// \return True if the space is active, false otherwise.
+bool address_space::active_() const {
+    return (x86_get_cr3() & pte_address_mask) == this->root_;
+}
+
+/// \brief Drop a translation from the TLB.
+///
+/// Kernel mappings are global and cached whichever space is active, others
+/// only under the process-context identifier of their space. An inactive
+/// space without INVPCID gets its identifier flushed on the next activation.
+///
+/// \param virt Any address within the page.
+void address_space::flush_(vaddr_t virt) {
+    if (is_kernel_half(virt) || this->active_()) {
+        x86_invlpg(virt);
+    } else if (this->pcid_generation_ == pcid_generation && has_invpcid) {
+        x86_invpcid(invpcid_address, this->pcid_, virt);
+    } else if (this->pcid_generation_ == pcid_generation) {
+        this->stale_ = true;
+    }
+}
+
+/// \brief Get the leaf or first non-present entry for an address.
+///
+/// \param virt The virtual address.
+/// \param level Receives the level of the returned entry.
+/// \return Pointer to the entry.
+uint64_t* address_space::lookup_(vaddr_t virt, size_t* level) {
+    uint64_t* table = table_at(this->root_);
+
+    for (*level = 4;; --*level) {
+        uint64_t* entry = &table[index_of(virt, *level)];
+
+        if (*level == 1 || !(*entry & pte_present) || (*entry & pte_huge)) {
+            return entry;
+        }
+
+        table = table_at(*entry & pte_address_mask);
+    }
+}
+
+/// \brief Replace a huge page by a table of smaller pages.
+///
+/// The smaller pages map the same memory with the same attributes, so the
+/// translation does not change.
+///
+/// \param entry The entry mapping the huge page.
+/// \param level Level of the entry, 2 or 3.
+/// \param virt Any address within the huge page.
+/// \return True on success, false if out of memory.
+bool address_space::split_(uint64_t* entry, size_t level, vaddr_t virt) {
+    paddr_t table = allocate_table();
+
+    if (table == npos) {
+        return false;
+    }
+
+    uint64_t* entries = table_at(table);
+    size_t size = level_size(level - 1);
+    paddr_t base = *entry & pte_address_mask & ~(level_size(level) - 1);
+    uint64_t bits = *entry & ~(pte_address_mask | pte_huge);
+    bool pat = (*entry & pte_huge_pat) != 0;
+
+    // The PAT bit moves to bit 7 in 4 KiB pages
+    if (level - 1 > 1) {
+        bits |= pte_huge | (pat ? pte_huge_pat : 0);
+    } else if (pat) {
+        bits |= pte_huge;
+    }
+
+    for (size_t i = 0; i < table_entries; ++i) {
+        entries[i] = (base + i * size) | bits;
+    }
+
+    *entry = table | table_bits | (*entry & pte_user);
+    this->flush_(virt);
+
+    return true;
+}
+
+/// \brief Get the entry for an address at a level, creating tables and
+///        splitting huge pages above it as needed.
+///
+/// \param virt The virtual address.
+/// \param level Level of the entry.
+/// \param bits Bits to set in the entries pointing to the tables on the way.
+/// \return Pointer to the entry, or nullptr if out of memory.
+uint64_t* address_space::walk_(vaddr_t virt, size_t level, uint64_t bits) {
+    uint64_t* table = table_at(this->root_);
+
+    for (size_t current = 4; current > level; --current) {
+        uint64_t* entry = &table[index_of(virt, current)];
+
+        if (!(*entry & pte_present)) {
+            paddr_t next = allocate_table();
+
+            if (next == npos) {
+                return nullptr;
+            }
+
+            *entry = next | bits;
+        } else if (*entry & pte_huge) {
+            if (!this->split_(entry, current, virt)) {
+                return nullptr;
+            }
+        }
+
+        *entry |= bits;
+        table = table_at(*entry & pte_address_mask);
+    }
+
+    return &table[index_of(virt, level)];
+}
+
+/// \brief Free a page table and the tables below it.
+///
+/// \param table Physical address of the table.
+/// \param level Level of the table.
+/// \param deferred If not nullptr, the frames are put onto this list instead,
+///                 to be freed once no TLB caches the tables anymore.
+void address_space::free_table_(paddr_t table, size_t level,
+                                page** deferred) {
+    uint64_t* entries = table_at(table);
+
+    for (size_t i = 0; i < table_entries && level > 1; ++i) {
+        if ((entries[i] & pte_present) && !(entries[i] & pte_huge)) {
+            this->free_table_(entries[i] & pte_address_mask, level - 1,
+                              deferred);
+        }
+    }
+
+    page* frame = deferred != nullptr ? phys_to_page(table) : nullptr;
+
+    if (frame != nullptr) {
+        frame->next = *deferred;
+        *deferred = frame;
+    } else {
+        free_page(reinterpret_cast<void*>(table));
+    }
+}
+
+/// \brief Map a range of physical memory, replacing existing mappings.
+///
+/// Every step maps the largest page both addresses are aligned to and the
+/// remaining length covers. Tables below an entry replaced by a huge page
+/// are freed once no TLB caches them anymore. Only the bootstrap processor
+/// can flush the other processors' TLBs, so on the others the kernel's
+/// tables are kept and mapped into with smaller pages. If a page table
+/// cannot be allocated, the part of the range mapped so far stays mapped.
+///
+/// \param virt Virtual address of the range, page aligned.
+/// \param phys Physical address of the range, page aligned.
+/// \param size Size of the range in bytes, a multiple of the page size.
+/// \param flags Access rights of the mapping.
+/// \return True on success, false if the arguments are misaligned or a page
+///         table could not be allocated.
+bool address_space::map(vaddr_t virt, paddr_t phys, size_t size,
+                        vm_flags flags) {
+    if (!utils::is_aligned(virt | phys | size, level_size(1))) {
+        return false;
+    }
+
+    utils::scoped_lock guard(this->lock_);
+
+    uint64_t bits = leaf_bits(flags, virt);
+    uint64_t tables = table_bits | (bits & pte_user);
+    bool shared = this == &kernel_address_space;
+    bool keep_tables = shared && arch_current_cpu() != 0;
+    bool done = true;
+    page* freed = nullptr;
+
+    while (size != 0) {
+        size_t level = 1;
+
+        for (size_t i = max_leaf_level(); i > 1; --i) {
+            if (utils::is_aligned(virt | phys, level_size(i)) &&
+                size >= level_size(i)) {
+                level = i;
+                break;
+            }
+        }
+
+        uint64_t* entry = this->walk_(virt, level, tables);
+
+        while (keep_tables && entry != nullptr && level > 1 &&
+               (*entry & pte_present) && !(*entry & pte_huge)) {
+            entry = this->walk_(virt, --level, tables);
+        }
+
+        if (entry == nullptr) {
+            done = false;
+            break;
+        }
+
+        if (level > 1 && (*entry & pte_present) && !(*entry & pte_huge)) {
+            this->free_table_(*entry & pte_address_mask, level - 1, &freed);
+        }
+
+        *entry = phys | bits | cache_bits(flags, level) |
+                 (level > 1 ? pte_huge : 0);
+        this->flush_(virt);
+
+        virt += level_size(level);
+        phys += level_size(level);
+        size -= level_size(level);
+    }
+
+    guard.unlock();
+
+    if (freed == nullptr) {
+        return done;
+    }
+
+    // Stale paging-structure caches may still point to the freed tables
+    if (shared) {
+        arch::smp_flush_tlbs();
+    } else {
+        tlb_flush_all();
+    }
+
+    while (freed != nullptr) {
+        page* next = freed->next;
+        freed->next = nullptr;
+        free_page(reinterpret_cast<void*>(page_to_phys(freed)));
+        freed = next;
+    }
+
+    return done;
+}
+
+/// \brief Remove the mappings of a range.
+///
+/// Huge pages only partly covered by the range are split first. Page tables
+/// which become empty are kept for later mappings.
+///
+/// \param virt Virtual address of the range, page aligned.
+/// \param size Size of the range in bytes, a multiple of the page size.
+/// \param flush Whether to drop the translations from the TLB. Otherwise the
+///              caller must flush the TLB before the range or the memory
+///              behind it is reused.
+/// \return True on success, false if the arguments are misaligned or a huge
+///         page could not be split.
+bool address_space::unmap(vaddr_t virt, size_t size, bool flush) {
+    if (!utils::is_aligned(virt | size, level_size(1))) {
+        return false;
+    }
+
+    utils::scoped_lock guard(this->lock_);
+
+    while (size != 0) {
+        size_t level = 0;
+        uint64_t* entry = this->lookup_(virt, &level);
+        size_t page = level_size(level);
+        size_t step = page - (virt & (page - 1));
+
+        if (*entry & pte_present) {
+            if (step != page || size < page) {
+                if (!this->split_(entry, level, virt)) {
+                    return false;
+                }
+
+                continue;
+            }
+
+            *entry = 0;
+
+            if (flush) {
+                this->flush_(virt);
+            }
+        }
+
+        if (step >= size) {
+            break;
+        }
+
+        virt += step;
+        size -= step;
+    }
+
+    return true;
+}
+
+/// \brief Change the access rights of the mapped pages of a range.
+///
+/// Unmapped parts of the range are skipped and huge pages only partly
+/// covered by the range are split first. Changes to the kernel's space are
+/// flushed from the TLBs of every CPU, which only the bootstrap processor
+/// can do. It waits for every application processor to finish its current
+/// function first, e.g. the framebuffer's protection in \ref virt_initialize
+/// waits for the chunks of memory they initialize in the background.
+///
+/// \param virt Virtual address of the range, page aligned.
+/// \param size Size of the range in bytes, a multiple of the page size.
+/// \param flags New access rights.
+/// \return True on success, false if the arguments are misaligned, a huge
+///         page could not be split or the kernel's space is changed from an
+///         application processor.
+bool address_space::protect(vaddr_t virt, size_t size, vm_flags flags) {
+    if (!utils::is_aligned(virt | size, level_size(1))) {
+        return false;
+    }
+
+    // Other CPUs would keep using the old access rights or cache type
+    if (this == &kernel_address_space && arch_current_cpu() != 0) {
+        return false;
+    }
+
+    utils::scoped_lock guard(this->lock_);
+
+    uint64_t bits = leaf_bits(flags, virt);
+    bool done = true;
+
+    while (size != 0) {
+        size_t level = 0;
+        uint64_t* entry = this->lookup_(virt, &level);
+        size_t page = level_size(level);
+        size_t step = page - (virt & (page - 1));
+
+        if (*entry & pte_present) {
+            if (step != page || size < page) {
+                if (!this->split_(entry, level, virt)) {
+                    done = false;
+                    break;
+                }
+
+                continue;
+            }
+
+            // Bit 12 is the PAT bit of huge pages rather than address
+            uint64_t keep = level > 1
+                                ? (pte_address_mask & ~pte_huge_pat) | pte_huge
+                                : pte_address_mask;
+
+            *entry = (*entry & keep) | bits | cache_bits(flags, level);
+            this->flush_(virt);
+        }
+
+        if (step >= size) {
+            break;
+        }
+
+        virt += step;
+        size -= step;
+    }
+
+    guard.unlock();
+
+    if (this == &kernel_address_space) {
+        arch::smp_flush_tlbs();
+    }
+
+    return done;
+}
+
+/// \brief Get the physical address a virtual address is mapped to.
+///
+/// \param virt The virtual address.
+/// \return The physical address, or \ref npos if it is not mapped.
+paddr_t address_space::translate(vaddr_t virt) {
+    utils::scoped_lock guard(this->lock_);
+    return this->translate_unlocked(virt);
+}
+
+/// \brief Get the physical address a virtual address is mapped to, without
+///        taking the lock.
+///
+/// The tables are read through the higher half direct map, which stays
+/// readable even for tables freed concurrently, so the walk itself cannot
+/// fault.
+///
+/// \param virt The virtual address.
+/// \return The physical address, or \ref npos if it is not mapped.
+paddr_t address_space::translate_unlocked(vaddr_t virt) {
+    size_t level = 0;
+    uint64_t entry = *this->lookup_(virt, &level);
+
+    if (!(entry & pte_present)) {
+        return npos;
+    }
+
+    size_t page = level_size(level);
+
+    return (entry & pte_address_mask & ~(page - 1)) + (virt & (page - 1));
+}
+
+/// \brief Load the address space into CR3.
+///
+/// With PCIDs, the translations cached for the space are kept across
+/// switches. A space gets an identifier on its first activation in every
+/// round; when they run out, a new round starts with INVPCID dropping every
+/// non-global translation if available. Otherwise an identifier's stale
+/// translations are dropped when it is loaded for its new space.
+void address_space::activate() {
+    if (!use_pcid) {
+        x86_set_cr3(this->root_);
+        return;
+    }
+
+    uint64_t cr3 = this->root_;
+
+    {
+        utils::scoped_lock guard(pcid_lock);
+        bool fresh = this->pcid_generation_ != pcid_generation;
+
+        if (fresh && next_pcid > max_pcid) {
+            pcid_generation++;
+            next_pcid = 1;
+
+            if (has_invpcid) {
+                x86_invpcid(invpcid_all, 0, 0);
+            }
+        }
+
+        if (fresh) {
+            this->pcid_ = next_pcid++;
+            this->pcid_generation_ = pcid_generation;
+        }
+
+        cr3 |= this->pcid_;
+
+        if (!fresh && !this->stale_) {
+            cr3 |= X86_CR3_NOFLUSH;
+        }
+
+        this->stale_ = false;
+    }
+
+    x86_set_cr3(cr3);
+}
+
+/// \brief Get the address space of the kernel.
+///
+/// \return The kernel's address space.
+address_space& kernel_space() {
+    return kernel_address_space;
+}
+
+/// \brief Get the framebuffer in the higher half direct map.
+///
+/// \param size Receives the size of the mapping in bytes.
+/// \return Page aligned pointer to the framebuffer, or nullptr if the memory
+///         map has none.
+void* framebuffer_mapping(size_t* size) {
+    *size = framebuffer_size;
+
+    if (framebuffer_size == 0) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<void*>(utils::to_higher_half(framebuffer_base));
+}
+
+/// \brief Load the kernel's layout of the page attribute table.
+///
+/// Caches are written back before and after the change, so no line is
+/// cached under a type its mapping no longer has. Without the page
+/// attribute table, mappings only choose between write-back, write-through
+/// and uncached.
+void pat_initialize() {
+    if (!cpu_id::cpuid().read_features().had_feature(cpu_id::features::PAT)) {
+        return;
+    }
+
+    bool irqs = interrupt_status();
+    interrupt_disable();
+
+    x86_wbinvd();
+    write_msr(X86_MSR_IA32_PAT, pat_layout);
+    x86_wbinvd();
+    tlb_flush_all();
+
+    if (irqs) {
+        interrupt_enable();
+    }
+
+    has_pat = true;
+}
+
+/// \brief Drop every translation from the TLB, global ones included.
+///
+/// Without INVPCID, toggling CR4.PGE does the same for every PCID.
+void tlb_flush_all() {
+    if (has_invpcid && has_pcid) {
+        x86_invpcid(invpcid_all_global, 0, 0);
+    } else if (has_global) {
+        uint64_t cr4 = x86_get_cr4();
+        x86_set_cr4(cr4 & ~X86_CR4_PGE);
+        x86_set_cr4(cr4);
+    } else {
+        x86_set_cr3(x86_get_cr3());
+    }
+}
+
+/// \brief Turn the use of process-context identifiers on or off.
+///
+/// \param enable Whether to activate address spaces with their PCID.
+/// \return False if PCIDs are not supported, true otherwise.
+bool set_pcid_enabled(bool enable) {
+    if (!has_pcid) {
+        return false;
+    }
+
+    // Translations cached under one scheme must not leak into the other
+    use_pcid = enable;
+    tlb_flush_all();
+
+    return true;
+}
+
+/// \brief Map a segment of the kernel image.
+///
+/// \param bootinfo Pointer to the boot information.
+/// \param start First address of the segment.
+/// \param end Address one past the end of the segment.
+/// \param flags Access rights of the segment.
+/// \return True on success, false if out of memory.
+bool map_kernel_segment(bootinfo_t* bootinfo, const char* start,
+                        const char* end, vm_flags flags) {
+    vaddr_t first = utils::align_down(reinterpret_cast<vaddr_t>(start),
+                                      default_page_size);
+    vaddr_t last =
+        utils::align_up(reinterpret_cast<vaddr_t>(end), default_page_size);
+    paddr_t phys = first -
+                   reinterpret_cast<vaddr_t>(bootinfo->virtual_base_address) +
+                   reinterpret_cast<paddr_t>(bootinfo->physical_base_address);
+
+    return kernel_address_space.map(first, phys, last - first, flags);
+}
+
+/// \brief Try to resolve a page fault.
+///
+/// Only faults of the kernel on kernel addresses which are not mapped are
+/// resolved: pages of lazy vmalloc buffers are backed, and pages mapped by
+/// another CPU since the access are retried. Everything else is fatal.
+///
+/// \param address The faulting address, from CR2.
+/// \param error The error code of the fault.
+/// \return True if the access can be retried, false otherwise.
+bool handle_page_fault(vaddr_t address, uint64_t error) {
+    uint64_t start = x86_rdtsc();
+    bool resolved = false;
+
+    fault_count.fetch_add(1, std::memory_order_relaxed);
+
+    if ((error & (X86_PF_PRESENT | X86_PF_USER | X86_PF_RSVD)) != 0 ||
+        !is_kernel_half(address)) {
+        return false;
+    }
+
+    // The lock may be held by the code which faulted
+    if (kernel_address_space.translate_unlocked(address) !=
+        address_space::npos) {
+        // Paging-structure caches may still hold the tables before the change
+        x86_invlpg(address);
+        spurious_faults.fetch_add(1, std::memory_order_relaxed);
+        resolved = true;
+    } else if (address - vmalloc_start < vmalloc_size &&
+               (error & X86_PF_INSTR) == 0 && vmalloc_fault(address)) {
+        lazy_faults.fetch_add(1, std::memory_order_relaxed);
+        resolved = true;
+    }
+
+    if (resolved) {
+        uint64_t ticks = x86_rdtsc() - start;
+        uint64_t longest = max_fault_ticks.load(std::memory_order_relaxed);
+
+        fault_ticks.fetch_add(ticks, std::memory_order_relaxed);
+
+        while (ticks > longest &&
+               !max_fault_ticks.compare_exchange_weak(
+                   longest, ticks, std::memory_order_relaxed)) {
+        }
+    }
+
+    return resolved;
+}
+
+/// \brief Print the page fault counters to the serial port.
+///
+/// The line starts with `vmm-telemetry` followed by `key=value` pairs: the
+/// faults seen, those backing lazy pages and those retried as spurious, and
+/// the total, average and longest time spent on the resolved ones.
+void virt_dump_telemetry() {
+    size_t faults = fault_count.load(std::memory_order_relaxed);
+    size_t lazy = lazy_faults.load(std::memory_order_relaxed);
+    size_t spurious = spurious_faults.load(std::memory_order_relaxed);
+    uint64_t total_ns =
+        arch::tsc_to_ns(fault_ticks.load(std::memory_order_relaxed));
+    size_t resolved = lazy + spurious;
+
+    printf("vmm-telemetry faults=%lu lazy_faults=%lu spurious_faults=%lu "
+           "total_ns=%lu avg_ns=%lu max_ns=%lu\n",
+           faults, lazy, spurious, total_ns,
+           resolved != 0 ? total_ns / resolved : 0,
+           arch::tsc_to_ns(max_fault_ticks.load(std::memory_order_relaxed)));
+}
+
+/// \brief Switch an application processor to the kernel's page tables.
+///
+/// The processor gets the paging features \ref virt_initialize turned on for
+/// the bootstrap processor. It only ever runs in the kernel's space, which
+/// it loads with PCID 0.
+///
+/// \return False if the kernel stayed on the bootloader's page tables.
+bool virt_initialize_cpu() {
+    if (!kernel_tables_active) {
+        return false;
+    }
+
+    if (has_global) {
+        x86_set_cr4(x86_get_cr4() | X86_CR4_PGE);
+    }
+
+    if (has_no_execute) {
+        write_msr(X86_MSR_IA32_EFER,
+                  read_msr(X86_MSR_IA32_EFER) | X86_EFER_NXE);
+    }
+
+    if (has_pat) {
+        pat_initialize();
+    }
+
+    x86_set_cr3(kernel_address_space.root());
+
+    if (has_pcid) {
+        x86_set_cr4(x86_get_cr4() | X86_CR4_PCIDE);
+    }
+
+    return true;
+}
+
+/// \brief Build the kernel's page tables and switch to them.
+///
+/// The higher half direct map covers all physical memory up to the end of
+/// the highest memory map entry, or 4 GiB if that is higher, like the
+/// bootloader's. Holes are mapped as well, which lets the whole map use
+/// 1 GiB pages; the memory type of device memory comes from the MTRRs. The
+/// kernel image is mapped segment by segment with the access rights of each.
+///
+/// \param bootinfo Pointer to the boot information.
+void virt_initialize(bootinfo_t* bootinfo) {
+    uint64_t start_ticks = x86_rdtsc();
+    cpu_id::features features = cpu_id::cpuid().read_features();
+
+    has_huge_1g = features.had_feature(cpu_id::features::PDPE1GB);
+    has_no_execute = features.had_feature(cpu_id::features::XD);
+    has_global = features.had_feature(cpu_id::features::PGE);
+    has_invpcid = features.had_feature(cpu_id::features::INVPCID);
+
+    if (has_global) {
+        x86_set_cr4(x86_get_cr4() | X86_CR4_PGE);
+    }
+
+    if (has_no_execute) {
+        write_msr(X86_MSR_IA32_EFER,
+                  read_msr(X86_MSR_IA32_EFER) | X86_EFER_NXE);
+    }
+
+    pat_initialize();
+
+    if (!kernel_address_space.initialize()) {
+        log_message(LOG_LEVEL_ERROR,
+                    "No memory for the kernel's page tables, staying on the "
+                    "bootloader's.");
+        return;
+    }
+
+    // Every space shares the kernel half from the top-level entries down, so
+    // they must all exist before another space copies them
+    uint64_t* entries = table_at(kernel_address_space.root());
+
+    for (size_t i = kernel_half_entry; i < table_entries; ++i) {
+        paddr_t table = allocate_table();
+
+        if (table == address_space::npos) {
+            log_message(LOG_LEVEL_ERROR,
+                        "No memory for the kernel's page tables, staying on "
+                        "the bootloader's.");
+            return;
+        }
+
+        entries[i] = table | pte_present | pte_write;
+    }
+
+    paddr_t top = 4ul << 30;
+
+    for (size_t i = 0; i < bootinfo->memmap_size; ++i) {
+        top = std::max(top, bootinfo->memmaps[i]->base +
+                                bootinfo->memmaps[i]->length);
+    }
+
+    top = utils::align_up(top, level_size(2));
+
+    bool mapped =
+        kernel_address_space.map(utils::hhdm_offset, 0, top, VmWrite) &&
+        map_kernel_segment(bootinfo, __kernel_text_start, __kernel_text_end,
+                           VmRead | VmExecute) &&
+        map_kernel_segment(bootinfo, __kernel_rodata_start,
+                           __kernel_rodata_end, VmRead) &&
+        map_kernel_segment(bootinfo, __kernel_data_start, __kernel_end,
+                           VmWrite);
+
+    if (!mapped) {
+        log_message(LOG_LEVEL_ERROR,
+                    "Failed to build the kernel's page tables, staying on the "
+                    "bootloader's.");
+        return;
+    }
+
+    // Blits to the framebuffer are sequential writes, which write-combining
+    // turns into full bursts instead of single uncached stores
+    for (size_t i = 0; i < bootinfo->memmap_size; ++i) {
+        memory_map* entry = bootinfo->memmaps[i];
+
+        if (entry->type != MEMORY_MAP_FRAMEBUFFER || framebuffer_size != 0) {
+            continue;
+        }
+
+        framebuffer_base = utils::align_down(entry->base, level_size(1));
+        framebuffer_size = utils::align_up(entry->base + entry->length,
+                                           level_size(1)) -
+                           framebuffer_base;
+
+        kernel_address_space.protect(
+            utils::to_higher_half(framebuffer_base), framebuffer_size,
+            VmWrite | VmWriteCombining);
+    }
+
+    kernel_address_space.activate();
+    kernel_tables_active = true;
+
+    // CR4.PCIDE may only be set with PCID 0 loaded, which the plain load
+    // above did. Without global pages, PCIDs would not keep the kernel's
+    // translations, so they are only used together.
+    if (has_global && features.had_feature(cpu_id::features::PCID)) {
+        x86_set_cr4(x86_get_cr4() | X86_CR4_PCIDE);
+        has_pcid = true;
+        use_pcid = true;
+    } else {
+        has_invpcid = false;
+    }
+
+    uint64_t elapsed = arch::tsc_to_ns(x86_rdtsc() - start_ticks);
+
+    log_message(LOG_LEVEL_INFO,
+                "Switched to kernel page tables @ %p (HHDM %lu GiB with %s "
+                "pages, global pages %s, PCID %s, PAT %s) in %lu us.",
+                reinterpret_cast<void*>(kernel_address_space.root()),
+                top >> 30, has_huge_1g ? "1 GiB" : "2 MiB",
+                has_global ? "on" : "off", has_pcid ? "on" : "off",
+                has_pat ? "on" : "off", elapsed / 1000);
+}
+}  // namespace memory
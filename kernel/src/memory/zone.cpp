@@ -0,0 +1,405 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include <memory/memory.hpp>
+#include <memory/zone.hpp>
+
+#include <utils/misc.hpp>
+
+namespace memory {
+namespace {
+/// Smallest zone for which the bitmap gets a summary index.
+constexpr size_t summary_index_min_memory = get_page_size(GiB1);
+
+/// Frame number tracked by the first bitmap bit of a zone.
+///
+/// Aligning it like the buddy allocator keeps the bitmap's notion of
+/// alignment identical to the physical one for every buddy block size.
+constexpr size_t index_base_of(size_t base_pfn) {
+    return utils::align_down(base_pfn, static_cast<size_t>(1) << max_order);
+}
+}  // namespace
+
+/// \brief Check if a zone gets a summary index over its bitmap.
+///
+/// \param base_pfn First page frame number of the zone.
+/// \param end_pfn Page frame number one past the end of the zone.
+/// \param page_size Size of a page frame in bytes.
+/// \return True if the zone spans at least 1 GiB, false otherwise.
+bool phys_zone::wants_index(size_t base_pfn, size_t end_pfn,
+                            size_t page_size) {
+    return (end_pfn - base_pfn) * page_size >= summary_index_min_memory;
+}
+
+/// \brief Get the size of the metadata needed by a zone.
+///
+/// The metadata consists of the bitmap, its optional summary index and the
+/// buddy allocator's bookkeeping, in that order.
+///
+/// \param base_pfn First page frame number of the zone.
+/// \param end_pfn Page frame number one past the end of the zone.
+/// \param page_size Size of a page frame in bytes.
+/// \return Size of the metadata in bytes.
+size_t phys_zone::metadata_size(size_t base_pfn, size_t end_pfn,
+                                size_t page_size) {
+    size_t bits = end_pfn - index_base_of(base_pfn);
+    size_t size = utils::div_roundup(bits, 64) * sizeof(uint64_t);
+
+    if (wants_index(base_pfn, end_pfn, page_size)) {
+        size += utils::bitmap_index::index_size(bits);
+    }
+
+    return size + buddy_allocator::metadata_size(base_pfn, end_pfn);
+}
+
+/// \brief Initialize the zone with every frame marked as used.
+///
+/// Frames only become available once they are handed to \ref add_range.
+///
+/// \param name Name of the zone, used for logging.
+/// \param base_pfn First page frame number of the zone.
+/// \param end_pfn Page frame number one past the end of the zone.
+/// \param page_size Size of a page frame in bytes.
+/// \param metadata Buffer of at least \ref metadata_size bytes.
+void phys_zone::initialize(const char* name, size_t base_pfn, size_t end_pfn,
+                           size_t page_size, void* metadata) {
+    this->name_ = name;
+    this->base_pfn_ = base_pfn;
+    this->end_pfn_ = end_pfn;
+    this->index_base_ = index_base_of(base_pfn);
+
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(metadata);
+    size_t bits = end_pfn - this->index_base_;
+    size_t bitmap_size = utils::div_roundup(bits, 64) * sizeof(uint64_t);
+
+    // Set all bitmap entries to 1 (indicating used)
+    memset(buffer, 0xFF, bitmap_size);
+    this->bitmap_.initialize(reinterpret_cast<uint64_t*>(buffer), bits);
+    buffer += bitmap_size;
+
+    if (wants_index(base_pfn, end_pfn, page_size)) {
+        this->index_.initialize(&this->bitmap_,
+                                reinterpret_cast<uint64_t*>(buffer));
+        buffer += utils::bitmap_index::index_size(bits);
+    }
+
+    this->buddy_.initialize(base_pfn, end_pfn, page_size, buffer);
+}
+
+/// \brief Hand a range of usable frames over to the zone.
+///
+/// \param pfn First page frame number of the range.
+/// \param count Number of frames in the range.
+void phys_zone::add_range(size_t pfn, size_t count) {
+    utils::scoped_lock guard(this->lock_);
+
+    this->bitmap_.clear_range(pfn - this->index_base_, count);
+    this->index_.update(pfn - this->index_base_, count);
+
+    this->buddy_.free_range(pfn, count);
+    this->total_frames_ += count;
+}
+
+/// \brief Mark frames as used in the bitmap.
+///
+/// \param pfn Page frame number of the first frame.
+/// \param count Number of frames.
+void phys_zone::mark_used_(size_t pfn, size_t count) {
+    this->bitmap_.set_range(pfn - this->index_base_, count);
+    this->index_.update(pfn - this->index_base_, count);
+}
+
+/// \brief Take a run of frames found by a bitmap search.
+///
+/// The bitmap search only knows alignments up to the largest buddy block, so
+/// stricter alignments are checked on the candidates it returns.
+///
+/// \param start The bitmap index to start searching from.
+/// \param count Number of frames in the run.
+/// \param align Alignment of the run in frames.
+/// \return Page frame number of the run, or \ref npos.
+size_t phys_zone::allocate_run_(size_t start, size_t count, size_t align) {
+    size_t step = std::min(align, static_cast<size_t>(1) << max_order);
+
+    while (true) {
+        size_t index = this->index_.initialized()
+                           ? this->index_.find_zero_run(count, step, start)
+                           : this->bitmap_.find_zero_run(count, step, start);
+
+        if (index == utils::bitmap_index::npos) {
+            return npos;
+        }
+
+        size_t pfn = this->index_base_ + index;
+
+        if (!utils::is_aligned(pfn, align)) {
+            start = index + step;
+            continue;
+        }
+
+        // Keep looking past runs the free lists do not fully hold
+        if (!this->buddy_.reserve_range(pfn, count)) {
+            start = index + step;
+            continue;
+        }
+
+        this->mark_used_(pfn, count);
+        this->last_index_ = index + count;
+
+        return pfn;
+    }
+}
+
+/// \brief Allocate frames with the lock held.
+///
+/// This function takes the smallest buddy block that can hold the requested
+/// frames and gives the unused tail of that block back to the allocator.
+/// Requests larger than the biggest buddy block fall back to a bitmap search.
+///
+/// \param count Number of frames.
+/// \return Page frame number of the first frame, or \ref npos.
+size_t phys_zone::allocate_(size_t count) {
+    size_t order = order_for_count(count);
+
+    if (order > max_order) {
+        size_t page = this->allocate_run_(this->last_index_, count, 1);
+
+        if (page == npos) {
+            // Try again from the beginning
+            page = this->allocate_run_(0, count, 1);
+        }
+
+        return page;
+    }
+
+    size_t page = this->buddy_.allocate(order);
+
+    if (page == npos) {
+        return npos;
+    }
+
+    // Give back the frames which exceed the requested count
+    size_t block_size = static_cast<size_t>(1) << order;
+
+    if (block_size > count) {
+        this->buddy_.free_range(page + count, block_size - count);
+    }
+
+    this->mark_used_(page, count);
+
+    return page;
+}
+
+/// \brief Allocate contiguous frames.
+///
+/// \param count Number of frames.
+/// \return Page frame number of the first frame, or \ref npos.
+size_t phys_zone::allocate(size_t count) {
+    utils::scoped_lock guard(this->lock_);
+    return this->allocate_(count);
+}
+
+/// \brief Allocate a block of `2^order` frames aligned to `2^align` frames.
+///
+/// Blocks aligned to their own size come straight from the buddy allocator.
+/// Stricter alignments, and blocks larger than the biggest buddy block, are
+/// found with an aligned bitmap search instead.
+///
+/// \param order Order of the block.
+/// \param align Alignment of the block as an order.
+/// \return Page frame number of the block, or \ref npos.
+size_t phys_zone::allocate_aligned(size_t order, size_t align) {
+    // Neither the block nor its alignment may exceed the zone
+    if (order >= 64 || align >= 64 ||
+        (static_cast<size_t>(1) << order) > this->end_pfn_ - this->base_pfn_ ||
+        (static_cast<size_t>(1) << align) > this->end_pfn_) {
+        return npos;
+    }
+
+    utils::scoped_lock guard(this->lock_);
+
+    size_t count = static_cast<size_t>(1) << order;
+
+    if (align > order || order > max_order) {
+        size_t alignment = static_cast<size_t>(1) << std::max(order, align);
+        return this->allocate_run_(0, count, alignment);
+    }
+
+    size_t page = this->buddy_.allocate(order);
+
+    if (page != npos) {
+        this->mark_used_(page, count);
+    }
+
+    return page;
+}
+
+/// \brief Allocate single frames under one lock acquisition.
+///
+/// \param pages Array receiving the page frame numbers.
+/// \param count Maximum number of frames to allocate.
+/// \return Number of frames allocated.
+size_t phys_zone::allocate_batch(size_t* pages, size_t count) {
+    utils::scoped_lock guard(this->lock_);
+
+    size_t allocated = 0;
+
+    while (allocated < count) {
+        size_t page = this->buddy_.allocate(0);
+
+        if (page == npos) {
+            break;
+        }
+
+        this->mark_used_(page, 1);
+        pages[allocated++] = page;
+    }
+
+    return allocated;
+}
+
+/// \brief Free contiguous frames.
+///
+/// The frames are marked as free in the bitmap and returned to the buddy
+/// allocator, which merges them with any free neighbours.
+///
+/// \param pfn Page frame number of the first frame.
+/// \param count Number of frames.
+/// \return True if the frames were freed, false if one of them was not
+///         allocated.
+bool phys_zone::free(size_t pfn, size_t count) {
+    if (!this->contains(pfn) || count > this->end_pfn_ - pfn) {
+        return false;
+    }
+
+    utils::scoped_lock guard(this->lock_);
+
+    size_t index = pfn - this->index_base_;
+
+    // Refuse to free frames which are not allocated
+    if (this->bitmap_.find_first_zero(index) < index + count) {
+        return false;
+    }
+
+    this->bitmap_.clear_range(index, count);
+    this->index_.update(index, count);
+
+    this->buddy_.free_range(pfn, count);
+
+    return true;
+}
+
+/// \brief Free those of the given single frames which belong to the zone.
+///
+/// \param pages Array of page frame numbers.
+/// \param count Number of entries in the array.
+void phys_zone::free_batch(const size_t* pages, size_t count) {
+    utils::scoped_lock guard(this->lock_);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!this->contains(pages[i])) {
+            continue;
+        }
+
+        size_t index = pages[i] - this->index_base_;
+
+        this->bitmap_.set(index, false);
+        this->index_.update(index, 1);
+
+        this->buddy_.free(pages[i], 0);
+    }
+}
+
+/// \brief Check if a frame of the zone is allocated.
+///
+/// The bitmap is read without taking the lock, so the answer is only a
+/// snapshot. Other frames of the same bitmap word may change concurrently,
+/// which never affects the bit of the frame itself, so the answer is only
+/// outdated if the frame is allocated or freed at the same time.
+///
+/// \param pfn Page frame number.
+/// \return True if the frame is allocated, false otherwise.
+bool phys_zone::is_allocated(size_t pfn) const {
+    return this->bitmap_.get(pfn - this->index_base_);
+}
+
+/// \brief Get the size of the zone's bitmap.
+///
+/// \return Size of the bitmap in bytes.
+size_t phys_zone::bitmap_bytes() const {
+    return utils::div_roundup(this->bitmap_.length(), 64) * sizeof(uint64_t);
+}
+
+/// \brief Get the size of the summary index over the zone's bitmap.
+///
+/// \return Size of the index in bytes, 0 if the bitmap is not indexed.
+size_t phys_zone::index_bytes() const {
+    if (!this->indexed()) {
+        return 0;
+    }
+
+    return utils::bitmap_index::index_size(this->bitmap_.length());
+}
+
+/// \brief Count free blocks of an order, including those inside larger free
+///        blocks.
+///
+/// \param order Order of the blocks.
+/// \return The number of free blocks.
+size_t phys_zone::free_blocks(size_t order) {
+    utils::scoped_lock guard(this->lock_);
+
+    size_t blocks = 0;
+
+    for (size_t i = order; i <= max_order; ++i) {
+        blocks += this->buddy_.free_blocks(i) << (i - order);
+    }
+
+    return blocks;
+}
+
+/// \brief Count the free blocks of exactly one order.
+///
+/// \param order Order of the blocks.
+/// \return The number of blocks on the buddy free list of the order.
+size_t phys_zone::free_list_blocks(size_t order) {
+    utils::scoped_lock guard(this->lock_);
+
+    return this->buddy_.free_blocks(order);
+}
+
+/// \brief Find the longest run of free frames.
+///
+/// Neighbouring buddy blocks may form a run longer than any single block,
+/// so the bitmap is scanned instead of the free lists. The scan is linear in
+/// the size of the zone and meant for statistics, not for the hot path.
+///
+/// \return The number of frames in the run.
+size_t phys_zone::largest_free_run() {
+    utils::scoped_lock guard(this->lock_);
+
+    size_t length = this->bitmap_.length();
+    size_t largest = 0;
+    size_t start = 0;
+
+    while (start < length) {
+        size_t first = this->bitmap_.find_first_zero(start);
+
+        if (first == utils::bitmap_index::npos || first >= length) {
+            break;
+        }
+
+        size_t next = this->bitmap_.find_next_set(first);
+
+        if (next == utils::bitmap_index::npos || next > length) {
+            next = length;
+        }
+
+        largest = std::max(largest, next - first);
+        start = next;
+    }
+
+    return largest;
+}
+}  // namespace memory
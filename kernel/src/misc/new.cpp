@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <memory/slab.hpp>
+
+#include <new>
+
+/// \brief Allocate memory for an object, halting the kernel if out of memory.
+///
+/// \param size Size of the object in bytes.
+/// \return Pointer to the memory.
+void* operator new(size_t size) {
+    // operator new must return distinct non-null pointers for empty objects
+    void* address = memory::kmalloc(size != 0 ? size : 1);
+    assert_message(address != nullptr, "Out of kernel heap memory");
+
+    return address;
+}
+
+/// \brief Allocate memory for an array, halting the kernel if out of memory.
+///
+/// \param size Size of the array in bytes.
+/// \return Pointer to the memory.
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+/// \brief Allocate memory for an over-aligned object.
+///
+/// kmalloc aligns memory to its size rounded up to a power of two, so the
+/// size is raised to the alignment.
+///
+/// \param size Size of the object in bytes.
+/// \param align Alignment of the object.
+/// \return Pointer to the memory.
+void* operator new(size_t size, std::align_val_t align) {
+    size_t alignment = static_cast<size_t>(align);
+
+    return operator new(size > alignment ? size : alignment);
+}
+
+/// \brief Allocate memory for an array of over-aligned objects.
+///
+/// \param size Size of the array in bytes.
+/// \param align Alignment of the objects.
+/// \return Pointer to the memory.
+void* operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+/// \brief Allocate memory for an object, returning nullptr if out of memory.
+///
+/// \param size Size of the object in bytes.
+/// \return Pointer to the memory, or nullptr.
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return memory::kmalloc(size != 0 ? size : 1);
+}
+
+/// \brief Allocate memory for an array, returning nullptr if out of memory.
+///
+/// \param size Size of the array in bytes.
+/// \return Pointer to the memory, or nullptr.
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return memory::kmalloc(size != 0 ? size : 1);
+}
+
+/// \brief Free the memory of an object.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete(void* address) noexcept {
+    memory::kfree(address);
+}
+
+/// \brief Free the memory of an array.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete[](void* address) noexcept {
+    memory::kfree(address);
+}
+
+/// \brief Free the memory of an object of known size.
+///
+/// The heap finds the size itself, so it is ignored.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete(void* address, size_t) noexcept {
+    memory::kfree(address);
+}
+
+/// \brief Free the memory of an array of known size.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete[](void* address, size_t) noexcept {
+    memory::kfree(address);
+}
+
+/// \brief Free the memory of an over-aligned object.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete(void* address, std::align_val_t) noexcept {
+    memory::kfree(address);
+}
+
+/// \brief Free the memory of an array of over-aligned objects.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete[](void* address, std::align_val_t) noexcept {
+    memory::kfree(address);
+}
+
+/// \brief Free the memory of an over-aligned object of known size.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete(void* address, size_t, std::align_val_t) noexcept {
+    memory::kfree(address);
+}
+
+/// \brief Free the memory of an array of over-aligned objects of known size.
+///
+/// \param address Pointer to the memory, may be nullptr.
+void operator delete[](void* address, size_t, std::align_val_t) noexcept {
+    memory::kfree(address);
+}
@@ -0,0 +1,53 @@
+#include <string.h>
+
+#include <utils/cmdline.hpp>
+
+namespace utils {
+/// \brief Find an option on the kernel command line.
+///
+/// \param cmdline The command line, may be nullptr.
+/// \param name The name of the option.
+/// \param length Optionally receives the length of the value.
+/// \return Pointer to the value (empty for options without one), or nullptr
+///         if the option is missing.
+const char* cmdline_find(const char* cmdline, const char* name,
+                         size_t* length) {
+    if (cmdline == nullptr) {
+        return nullptr;
+    }
+
+    size_t name_length = strlen(name);
+    const char* option = cmdline;
+
+    while (*option != '\0') {
+        // Skip the separators in front of the option
+        while (*option == ' ') {
+            ++option;
+        }
+
+        const char* end = option;
+
+        while (*end != '\0' && *end != ' ') {
+            ++end;
+        }
+
+        if (strncmp(option, name, name_length) == 0) {
+            const char* value = option + name_length;
+
+            if (value == end || *value == '=') {
+                value += value != end;
+
+                if (length != nullptr) {
+                    *length = end - value;
+                }
+
+                return value;
+            }
+        }
+
+        option = end;
+    }
+
+    return nullptr;
+}
+}  // namespace utils
@@ -21,24 +21,119 @@ void ticket_spinlock::lock() {
 ///
 /// \return true if the lock is held, false otherwise.
 bool ticket_spinlock::is_locked() {
-    // Check if the serving ticket incremented by 1 equals the next ticket.
-    return (serving_ticket_.load(std::memory_order_relaxed) + 1) ==
+    // Every ticket handed out but not served yet belongs to the holder or a
+    // waiter.
+    return serving_ticket_.load(std::memory_order_relaxed) !=
            next_ticket_.load(std::memory_order_relaxed);
 }
 
 /// \brief Releases the lock.
 ///
-/// If the lock is held, increments the serving ticket to release the lock.
+/// Increments the serving ticket, handing the lock to the next waiter. Must
+/// only be called by the holder.
 void ticket_spinlock::unlock() {
-    // Check if the lock is currently held.
-    if (!this->is_locked()) {
-        // If the lock is not held, do nothing and return.
+    serving_ticket_.fetch_add(1, std::memory_order_release);
+}
+
+namespace {
+/// \brief Get the value of a waiter's `tail` until the lock is handed over
+///        to it.
+inline queued_spinlock::node* queue_waiting() {
+    return reinterpret_cast<queued_spinlock::node*>(1);
+}
+}  // namespace
+
+/// \brief Acquires the lock.
+///
+/// A free lock is taken by pointing its tail to itself. Otherwise a node on
+/// the stack is appended to the queue, and the caller spins on it until the
+/// predecessor clears its `tail`. Before returning, the node is replaced by
+/// the lock itself, as the stack frame is about to go away.
+void queued_spinlock::lock() {
+    while (true) {
+        node* prev = this->queue_.tail.load(std::memory_order_relaxed);
+
+        if (prev == nullptr) {
+            if (this->queue_.tail.compare_exchange_weak(
+                    prev, &this->queue_, std::memory_order_acquire,
+                    std::memory_order_relaxed)) {
+                return;
+            }
+
+            continue;
+        }
+
+        // Keep the node off the cache lines of the other waiters' nodes
+        alignas(64) node self;
+        self.tail.store(queue_waiting(), std::memory_order_relaxed);
+
+        if (!this->queue_.tail.compare_exchange_weak(
+                prev, &self, std::memory_order_acq_rel,
+                std::memory_order_relaxed)) {
+            continue;
+        }
+
+        prev->next.store(&self, std::memory_order_release);
+
+        while (self.tail.load(std::memory_order_acquire) == queue_waiting()) {
+            pause();
+        }
+
+        node* successor = self.next.load(std::memory_order_acquire);
+
+        if (successor == nullptr) {
+            node* expected = &self;
+            this->queue_.next.store(nullptr, std::memory_order_relaxed);
+
+            if (this->queue_.tail.compare_exchange_strong(
+                    expected, &this->queue_, std::memory_order_acq_rel,
+                    std::memory_order_relaxed)) {
+                return;
+            }
+
+            // Another waiter queued up behind the node and is linking itself
+            while ((successor = self.next.load(std::memory_order_acquire)) ==
+                   nullptr) {
+                pause();
+            }
+        }
+
+        this->queue_.next.store(successor, std::memory_order_relaxed);
         return;
     }
+}
+
+/// \brief Checks if the lock is currently held.
+///
+/// \return true if the lock is held, false otherwise.
+bool queued_spinlock::is_locked() {
+    return this->queue_.tail.load(std::memory_order_relaxed) != nullptr;
+}
+
+/// \brief Releases the lock.
+///
+/// Without waiters the lock is freed, otherwise the first waiter stops
+/// spinning. Must only be called by the holder.
+void queued_spinlock::unlock() {
+    node* successor = this->queue_.next.load(std::memory_order_acquire);
+
+    if (successor == nullptr) {
+        node* expected = &this->queue_;
+
+        if (this->queue_.tail.compare_exchange_strong(
+                expected, nullptr, std::memory_order_release,
+                std::memory_order_relaxed)) {
+            return;
+        }
+
+        // A waiter queued up behind the lock and is linking itself
+        while ((successor = this->queue_.next.load(
+                    std::memory_order_acquire)) == nullptr) {
+            pause();
+        }
+    }
 
-    // If the lock is held, increment the serving ticket to release the lock.
-    size_t current = serving_ticket_.load(std::memory_order_relaxed);
-    serving_ticket_.store(current + 1, std::memory_order_release);
+    successor->tail.store(nullptr, std::memory_order_release);
 }
 
 /// \brief Locks interrupts and acquires the lock.
@@ -0,0 +1,50 @@
+#include <arch/arch.h>
+#include <assert.h>
+#include <string.h>
+#include <utils/per_cpu.hpp>
+
+namespace utils {
+/// \brief Distance of every CPU's per-CPU area from the template.
+///
+/// Zero for CPUs without an area, whose copy is the template itself.
+uintptr_t per_cpu_offsets[MAX_CPUS] = {};
+
+/// \brief Distance of the current CPU's per-CPU area from the template.
+///
+/// This is what the CPU's GS base holds, kept in memory since reading the
+/// GS base itself takes an MSR access.
+__PER_CPU uintptr_t this_cpu_offset = 0;
+
+/// \brief Set up the per-CPU area of the current CPU.
+///
+/// The area is a copy of the template as it is in the kernel image, so the
+/// template must not be written to. Until a CPU calls this, its GS base is
+/// 0 and per-CPU variables resolve to the template.
+///
+/// The linker script reserves the copies without knowing \ref MAX_CPUS, so
+/// their room is checked against it here.
+///
+/// \param cpu Index of the current CPU.
+void per_cpu_initialize(size_t cpu) {
+    size_t size = __percpu_end - __percpu_start;
+
+    assert_message(
+        static_cast<size_t>(__percpu_areas_end - __percpu_areas) >=
+            size * MAX_CPUS,
+        "The linker script reserves per-CPU areas for fewer than MAX_CPUS.");
+    assert(cpu < MAX_CPUS);
+
+    char* area = __percpu_areas + cpu * size;
+    uintptr_t offset = area - __percpu_start;
+
+    memcpy(area, __percpu_start, size);
+
+    per_cpu_offsets[cpu] = offset;
+    *per_cpu_ptr(&this_cpu_offset, cpu) = offset;
+
+    write_msr(X86_MSR_IA32_GS_BASE, offset);
+
+    // The kernel never runs on the user's GS base, which starts out as 0
+    write_msr(X86_MSR_IA32_KERNEL_GS_BASE, 0);
+}
+}  // namespace utils